@@ -0,0 +1,647 @@
+/*
+ * whisper archive - Append-only binary message log with a sorted sidecar index
+ *
+ * <dir>/messages.log: a file header, then one record per decrypted rumor,
+ *   an archive_record followed by the content, padded to 8 bytes.
+ * <dir>/messages.idx: rewritten whenever an archive is closed. It covers the
+ *   log up to `covered` with one entry per record sorted by created_at, then
+ *   the same records sorted by sender. Anything past `covered` is scanned.
+ * Both files are in host byte order; readers on another layout refuse them.
+ * `whisper log` maps both and prints straight out of the mapping.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#endif
+#include "whisper.h"
+
+#ifndef _WIN32
+
+#define ARCHIVE_LOG_MAGIC "WHSPLOG1"
+#define ARCHIVE_IDX_MAGIC "WHSPIDX1"
+#define ARCHIVE_BYTE_ORDER 0x01020304u
+#define ARCHIVE_RECORD_MAGIC 0x52535857u    /* "WXSR" little-endian */
+#define ARCHIVE_ALIGN(n) (((uint64_t)(n) + 7) & ~(uint64_t)7)
+
+/* Room for ids learned this session on top of the ones already archived */
+#define ARCHIVE_SEEN_HEADROOM 65536
+
+/* whisper log output is written out once this much is buffered */
+#define LOG_OUTPUT_HIGH_WATER (64 * 1024)
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;         /* ARCHIVE_BYTE_ORDER as the writer stored it */
+    uint32_t reserved;
+} archive_file_header;
+
+typedef struct {
+    archive_file_header h;
+    uint64_t covered;            /* log bytes the entries describe */
+    uint64_t count;              /* entries in each of the two sections */
+} archive_index_header;
+
+/* 120 bytes; every field sits on its natural alignment in the mapping */
+typedef struct {
+    uint32_t magic;
+    uint32_t content_len;
+    int64_t created_at;          /* rumor */
+    int64_t wrap_at;             /* gift wrap, randomized by NIP-59 */
+    uint8_t wrap_id[32];
+    uint8_t sender[32];
+    uint8_t recipient[32];
+} archive_record;
+
+typedef struct {
+    int64_t created_at;
+    uint64_t offset;
+} time_entry;
+
+typedef struct {
+    uint64_t sender;             /* leading 8 bytes of the pubkey */
+    int64_t created_at;
+    uint64_t offset;
+} sender_entry;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+} archive_map;
+
+typedef struct {
+    archive_map map;
+    uint64_t covered;
+    uint64_t count;
+    const time_entry* by_time;
+    const sender_entry* by_sender;
+} archive_index;
+
+static int archive_path(char* path, size_t size, const char* dir, const char* name) {
+    return snprintf(path, size, "%s/%s", dir, name) < (int)size ? 0 : -1;
+}
+
+static int map_file(const char* path, archive_map* m) {
+    m->data = NULL;
+    m->size = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    m->data = (const uint8_t*)p;
+    m->size = (size_t)st.st_size;
+    return 0;
+}
+
+static void unmap_file(archive_map* m) {
+    if (m->data) munmap((void*)m->data, m->size);
+    m->data = NULL;
+    m->size = 0;
+}
+
+static bool header_ok(const archive_map* m, const char* magic) {
+    const archive_file_header* h = (const archive_file_header*)m->data;
+    return m->size >= sizeof(*h) && memcmp(h->magic, magic, sizeof(h->magic)) == 0 &&
+           h->byte_order == ARCHIVE_BYTE_ORDER;
+}
+
+/* The record at offset, or NULL if there is no complete one there */
+static const archive_record* record_at(const archive_map* log, uint64_t offset) {
+    if (offset % 8 != 0 || offset + sizeof(archive_record) > log->size) return NULL;
+    const archive_record* r = (const archive_record*)(log->data + offset);
+    if (r->magic != ARCHIVE_RECORD_MAGIC || r->content_len > WHISPER_ARCHIVE_MAX_CONTENT) {
+        return NULL;
+    }
+    if (offset + ARCHIVE_ALIGN(sizeof(*r) + r->content_len) > log->size) return NULL;
+    return r;
+}
+
+static uint64_t record_next(uint64_t offset, const archive_record* r) {
+    return offset + ARCHIVE_ALIGN(sizeof(*r) + r->content_len);
+}
+
+static uint64_t sender_key(const uint8_t pubkey[32]) {
+    uint64_t key;
+    memcpy(&key, pubkey, sizeof(key));
+    return key;
+}
+
+/* Map the index if it fits this log; otherwise the whole log counts as tail */
+static void index_load(archive_index* idx, const char* path, uint64_t log_size) {
+    memset(idx, 0, sizeof(*idx));
+    idx->covered = sizeof(archive_file_header);
+    if (map_file(path, &idx->map) != 0) return;
+
+    const archive_index_header* h = (const archive_index_header*)idx->map.data;
+    size_t room = idx->map.size >= sizeof(*h) ? idx->map.size - sizeof(*h) : 0;
+    if (!header_ok(&idx->map, ARCHIVE_IDX_MAGIC) || idx->map.size < sizeof(*h) ||
+        h->covered < sizeof(archive_file_header) || h->covered > log_size ||
+        h->count > room / (sizeof(time_entry) + sizeof(sender_entry))) {
+        unmap_file(&idx->map);
+        return;
+    }
+    idx->covered = h->covered;
+    idx->count = h->count;
+    idx->by_time = (const time_entry*)(idx->map.data + sizeof(*h));
+    idx->by_sender = (const sender_entry*)(idx->by_time + h->count);
+}
+
+static int compare_time(const void* a, const void* b) {
+    const time_entry* x = (const time_entry*)a;
+    const time_entry* y = (const time_entry*)b;
+    if (x->created_at != y->created_at) return x->created_at < y->created_at ? -1 : 1;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+static int compare_sender(const void* a, const void* b) {
+    const sender_entry* x = (const sender_entry*)a;
+    const sender_entry* y = (const sender_entry*)b;
+    if (x->sender != y->sender) return x->sender < y->sender ? -1 : 1;
+    if (x->created_at != y->created_at) return x->created_at < y->created_at ? -1 : 1;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+static int write_all(int fd, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Extend the index over records appended since it was written: the old
+ * entries are kept, the new ones added and both sections sorted again */
+static int index_rebuild(const char* dir) {
+    char log_path[600], idx_path[600], tmp_path[600];
+    if (archive_path(log_path, sizeof(log_path), dir, "messages.log") != 0 ||
+        archive_path(idx_path, sizeof(idx_path), dir, "messages.idx") != 0 ||
+        archive_path(tmp_path, sizeof(tmp_path), dir, "messages.idx.tmp") != 0) {
+        return -1;
+    }
+
+    archive_map log;
+    if (map_file(log_path, &log) != 0) return -1;
+    archive_index old;
+    index_load(&old, idx_path, log.size);
+
+    size_t tail = 0;
+    uint64_t offset = old.covered;
+    const archive_record* r;
+    while ((r = record_at(&log, offset)) != NULL) {
+        offset = record_next(offset, r);
+        tail++;
+    }
+    uint64_t covered = offset;
+
+    size_t count = (size_t)old.count + tail;
+    time_entry* times = malloc((count ? count : 1) * sizeof(*times));
+    sender_entry* senders = malloc((count ? count : 1) * sizeof(*senders));
+    int rc = -1;
+    if (!times || !senders) goto done;
+
+    if (old.count > 0) {
+        memcpy(times, old.by_time, (size_t)old.count * sizeof(*times));
+        memcpy(senders, old.by_sender, (size_t)old.count * sizeof(*senders));
+    }
+    size_t n = (size_t)old.count;
+    for (offset = old.covered; n < count; offset = record_next(offset, r), n++) {
+        r = record_at(&log, offset);
+        times[n].created_at = r->created_at;
+        times[n].offset = offset;
+        senders[n].sender = sender_key(r->sender);
+        senders[n].created_at = r->created_at;
+        senders[n].offset = offset;
+    }
+    /* Old entries are already in order, so this is mostly a merge */
+    if (tail > 0) {
+        qsort(times, count, sizeof(*times), compare_time);
+        qsort(senders, count, sizeof(*senders), compare_sender);
+    }
+
+    archive_index_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.h.magic, ARCHIVE_IDX_MAGIC, sizeof(h.h.magic));
+    h.h.byte_order = ARCHIVE_BYTE_ORDER;
+    h.covered = covered;
+    h.count = count;
+
+    /* Readers keep whichever index they mapped; rename swaps in the new one */
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) goto done;
+    if (write_all(fd, &h, sizeof(h)) == 0 &&
+        write_all(fd, times, count * sizeof(*times)) == 0 &&
+        write_all(fd, senders, count * sizeof(*senders)) == 0 && fsync(fd) == 0) {
+        rc = 0;
+    }
+    close(fd);
+    if (rc == 0 && rename(tmp_path, idx_path) != 0) rc = -1;
+    if (rc != 0) unlink(tmp_path);
+
+done:
+    free(times);
+    free(senders);
+    unmap_file(&old.map);
+    unmap_file(&log);
+    return rc;
+}
+
+int whisper_archive_open(whisper_archive* ar, const char* dir) {
+    memset(ar, 0, sizeof(*ar));
+    ar->fd = -1;
+
+    char path[600];
+    if (snprintf(ar->dir, sizeof(ar->dir), "%s", dir) >= (int)sizeof(ar->dir) ||
+        whisper_make_dirs(dir) != 0 || archive_path(path, sizeof(path), dir, "messages.log") != 0) {
+        fprintf(stderr, "Error: Cannot create archive directory: %s\n", dir);
+        return -1;
+    }
+
+    ar->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (ar->fd < 0) {
+        fprintf(stderr, "Error: Cannot open archive: %s\n", path);
+        return -1;
+    }
+    /* One writer at a time: it alone may cut a torn record off the end */
+    if (flock(ar->fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Error: Archive is in use by another process: %s\n", path);
+        goto fail;
+    }
+
+    struct stat st;
+    if (fstat(ar->fd, &st) != 0) goto fail;
+    if (st.st_size == 0) {
+        archive_file_header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, ARCHIVE_LOG_MAGIC, sizeof(h.magic));
+        h.byte_order = ARCHIVE_BYTE_ORDER;
+        if (write_all(ar->fd, &h, sizeof(h)) != 0) {
+            fprintf(stderr, "Error: Cannot write archive: %s\n", path);
+            goto fail;
+        }
+    }
+
+    archive_map log;
+    if (map_file(path, &log) != 0 || !header_ok(&log, ARCHIVE_LOG_MAGIC)) {
+        unmap_file(&log);
+        fprintf(stderr, "Error: Not a whisper archive (or written on another architecture): %s\n",
+                path);
+        goto fail;
+    }
+
+    /* Every wrap id goes in the seen set, so a rerun never archives twice */
+    size_t records = 0;
+    uint64_t offset = sizeof(archive_file_header);
+    const archive_record* r;
+    while ((r = record_at(&log, offset)) != NULL) {
+        offset = record_next(offset, r);
+        records++;
+    }
+    if (whisper_idset_init(&ar->ids, records + ARCHIVE_SEEN_HEADROOM) != 0) {
+        unmap_file(&log);
+        fprintf(stderr, "Error: Out of memory\n");
+        goto fail;
+    }
+    for (offset = sizeof(archive_file_header); (r = record_at(&log, offset)) != NULL;
+         offset = record_next(offset, r)) {
+        whisper_idset_insert(&ar->ids, r->wrap_id);
+    }
+
+    /* A crash mid-append leaves a partial record; nothing valid follows it */
+    if (offset < log.size) {
+        fprintf(stderr, "Warning: Dropping %llu bytes of incomplete record from %s\n",
+                (unsigned long long)(log.size - offset), path);
+        if (ftruncate(ar->fd, (off_t)offset) != 0) {
+            unmap_file(&log);
+            fprintf(stderr, "Error: Cannot repair archive: %s\n", path);
+            whisper_idset_destroy(&ar->ids);
+            goto fail;
+        }
+    }
+    unmap_file(&log);
+
+    /* An index left behind by a crash is brought up to date at close */
+    char idx_path[600];
+    archive_index idx;
+    if (archive_path(idx_path, sizeof(idx_path), dir, "messages.idx") == 0) {
+        index_load(&idx, idx_path, offset);
+        ar->reindex = idx.covered != offset;
+        unmap_file(&idx.map);
+    }
+
+    ar->size = offset;
+    whisper_mutex_init(&ar->lock);
+    ar->open = true;
+    return 0;
+
+fail:
+    close(ar->fd);
+    ar->fd = -1;
+    return -1;
+}
+
+int whisper_archive_append(whisper_archive* ar, const whisper_unwrapped* msg,
+                           const nostr_key* recipient) {
+    const char* content = msg->rumor->content ? msg->rumor->content : "";
+    size_t len = strlen(content);
+    if (len > WHISPER_ARCHIVE_MAX_CONTENT) {
+        fprintf(stderr, "Warning: Message too large to archive\n");
+        return -1;
+    }
+
+    size_t size = (size_t)ARCHIVE_ALIGN(sizeof(archive_record) + len);
+    uint8_t* buf = calloc(1, size);
+    if (!buf) return -1;
+    archive_record* r = (archive_record*)buf;
+    r->magic = ARCHIVE_RECORD_MAGIC;
+    r->content_len = (uint32_t)len;
+    r->created_at = msg->rumor->created_at;
+    r->wrap_at = msg->wrap_created_at;
+    memcpy(r->wrap_id, msg->wrap_id, sizeof(r->wrap_id));
+    memcpy(r->sender, msg->sender.data, sizeof(r->sender));
+    memcpy(r->recipient, recipient->data, sizeof(r->recipient));
+    memcpy(buf + sizeof(*r), content, len);
+
+    int rc = 0;
+    whisper_mutex_lock(&ar->lock);
+    if (whisper_idset_insert(&ar->ids, msg->wrap_id)) {
+        /* One write per record; a short one is cut back off */
+        rc = write_all(ar->fd, buf, size);
+        if (rc == 0) {
+            ar->size += size;
+            ar->message_count++;
+        } else if (ftruncate(ar->fd, (off_t)ar->size) != 0) {
+            fprintf(stderr, "Warning: Partial archive record left for the next run to drop\n");
+        }
+    }
+    whisper_mutex_unlock(&ar->lock);
+
+    secure_wipe(buf, size);
+    free(buf);
+    if (rc != 0) fprintf(stderr, "Warning: Failed to write message to archive\n");
+    return rc;
+}
+
+void whisper_archive_close(whisper_archive* ar) {
+    if (!ar->open) return;
+    /* Still holding the lock, so no other writer can be appending */
+    if ((ar->message_count > 0 || ar->reindex) && index_rebuild(ar->dir) != 0) {
+        fprintf(stderr, "Warning: Failed to update archive index in %s\n", ar->dir);
+    }
+    close(ar->fd);
+    ar->fd = -1;
+    whisper_idset_destroy(&ar->ids);
+    whisper_mutex_destroy(&ar->lock);
+    ar->open = false;
+}
+
+/* First entry not older than since */
+static size_t time_lower_bound(const time_entry* e, size_t n, int64_t since) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (e[mid].created_at < since) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* First entry of sender not older than since */
+static size_t sender_lower_bound(const sender_entry* e, size_t n, uint64_t sender,
+                                 int64_t since) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (e[mid].sender < sender || (e[mid].sender == sender && e[mid].created_at < since)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+typedef struct {
+    const archive_map* log;
+    int64_t since;
+    int64_t until;
+    const nostr_key* from;       /* NULL = any sender */
+    const nostr_key* to;         /* NULL = any recipient */
+    time_entry* matches;
+    size_t count;
+    size_t cap;
+} log_query;
+
+/* Check the record itself: the index holds only a sender prefix */
+static int query_consider(log_query* q, uint64_t offset) {
+    const archive_record* r = record_at(q->log, offset);
+    if (!r || r->created_at < q->since || r->created_at > q->until) return 0;
+    if (q->from && memcmp(r->sender, q->from->data, sizeof(r->sender)) != 0) return 0;
+    if (q->to && memcmp(r->recipient, q->to->data, sizeof(r->recipient)) != 0) return 0;
+
+    if (q->count == q->cap) {
+        size_t cap = q->cap ? q->cap * 2 : 1024;
+        time_entry* grown = realloc(q->matches, cap * sizeof(*grown));
+        if (!grown) return -1;
+        q->matches = grown;
+        q->cap = cap;
+    }
+    q->matches[q->count].created_at = r->created_at;
+    q->matches[q->count].offset = offset;
+    q->count++;
+    return 0;
+}
+
+static void log_print(whisper_buf* out, whisper_peer_cache* peers, const archive_record* r,
+                      bool json_output) {
+    const char* content = (const char*)(r + 1);
+    size_t len = r->content_len;
+    nostr_key key;
+    char from_npub[100];
+    memcpy(key.data, r->sender, sizeof(key.data));
+    whisper_peer_npub(peers, &key, from_npub, sizeof(from_npub));
+
+    if (json_output) {
+        char to_npub[100];
+        memcpy(key.data, r->recipient, sizeof(key.data));
+        whisper_peer_npub(peers, &key, to_npub, sizeof(to_npub));
+        whisper_buf_puts(out, "{\"from\":\"");
+        whisper_buf_append_json(out, from_npub, strlen(from_npub));
+        whisper_buf_puts(out, "\",\"to\":\"");
+        whisper_buf_append_json(out, to_npub, strlen(to_npub));
+        whisper_buf_puts(out, "\",\"content\":\"");
+        whisper_buf_append_json(out, content, len);
+        whisper_buf_printf(out, "\",\"created_at\":%lld}\n", (long long)r->created_at);
+        return;
+    }
+
+    time_t ts = (time_t)r->created_at;
+    struct tm tm_buf;
+    struct tm* tm_info = localtime_r(&ts, &tm_buf);
+    char time_str[32];
+    if (tm_info) {
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
+    } else {
+        snprintf(time_str, sizeof(time_str), "(invalid time)");
+    }
+    whisper_buf_printf(out, "%s %.12s... ", time_str, from_npub);
+    if (len == 0) {
+        whisper_buf_puts(out, "(empty)");
+    } else if (whisper_buf_reserve(out, len + 1) == 0) {
+        out->len += whisper_strip_control_chars_into(content, len, out->data + out->len);
+    }
+    whisper_buf_puts(out, "\n");
+}
+
+int whisper_log(const whisper_log_config* config) {
+    nostr_key from, to;
+    if (config->from && whisper_parse_pubkey(config->from, &from) != 0) {
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+    if (config->to && whisper_parse_pubkey(config->to, &to) != 0) {
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+
+    char log_path[600], idx_path[600];
+    if (archive_path(log_path, sizeof(log_path), config->dir, "messages.log") != 0 ||
+        archive_path(idx_path, sizeof(idx_path), config->dir, "messages.idx") != 0) {
+        fprintf(stderr, "Error: Archive path too long: %s\n", config->dir);
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+
+    archive_map log;
+    if (map_file(log_path, &log) != 0) {
+        fprintf(stderr, "Error: No archive in %s\n", config->dir);
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+    if (!header_ok(&log, ARCHIVE_LOG_MAGIC)) {
+        fprintf(stderr, "Error: Not a whisper archive (or written on another architecture): %s\n",
+                log_path);
+        unmap_file(&log);
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+    archive_index idx;
+    index_load(&idx, idx_path, log.size);
+
+    log_query q = {
+        .log = &log,
+        .since = config->since,
+        .until = config->until > 0 ? config->until : INT64_MAX,
+        .from = config->from ? &from : NULL,
+        .to = config->to ? &to : NULL
+    };
+    int ret = WHISPER_EXIT_OK;
+    int rc = 0;
+
+    /* Indexed part: binary search to the first match, read until past the range */
+    if (q.from) {
+        uint64_t key = sender_key(from.data);
+        size_t n = (size_t)idx.count;
+        for (size_t i = sender_lower_bound(idx.by_sender, n, key, q.since);
+             rc == 0 && i < n && idx.by_sender[i].sender == key &&
+             idx.by_sender[i].created_at <= q.until; i++) {
+            rc = query_consider(&q, idx.by_sender[i].offset);
+        }
+    } else {
+        size_t n = (size_t)idx.count;
+        for (size_t i = time_lower_bound(idx.by_time, n, q.since);
+             rc == 0 && i < n && idx.by_time[i].created_at <= q.until; i++) {
+            rc = query_consider(&q, idx.by_time[i].offset);
+        }
+    }
+
+    /* Records appended since the index was written */
+    size_t indexed = q.count;
+    const archive_record* r;
+    for (uint64_t offset = idx.covered; rc == 0 && (r = record_at(&log, offset)) != NULL;
+         offset = record_next(offset, r)) {
+        rc = query_consider(&q, offset);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = WHISPER_EXIT_CRYPTO_ERROR;
+        goto cleanup;
+    }
+    if (q.count > indexed) qsort(q.matches, q.count, sizeof(*q.matches), compare_time);
+
+    /* Like recv --limit: the newest n, printed oldest first */
+    size_t first = 0;
+    if (config->limit > 0 && q.count > (size_t)config->limit) first = q.count - config->limit;
+
+    whisper_peer_cache peers;
+    if (whisper_peer_cache_init(&peers, 0) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = WHISPER_EXIT_CRYPTO_ERROR;
+        goto cleanup;
+    }
+    whisper_buf out = {0};
+    for (size_t i = first; i < q.count; i++) {
+        log_print(&out, &peers, record_at(&log, q.matches[i].offset), config->json_output);
+        if (out.len >= LOG_OUTPUT_HIGH_WATER) {
+            fwrite(out.data, 1, out.len, stdout);
+            out.len = 0;
+        }
+    }
+    if (out.len > 0) fwrite(out.data, 1, out.len, stdout);
+    fflush(stdout);
+    whisper_buf_free(&out);
+    whisper_peer_cache_destroy(&peers);
+
+cleanup:
+    free(q.matches);
+    unmap_file(&idx.map);
+    unmap_file(&log);
+    return ret;
+}
+
+#else
+
+int whisper_archive_open(whisper_archive* ar, const char* dir) {
+    (void)dir;
+    memset(ar, 0, sizeof(*ar));
+    fprintf(stderr, "Error: --archive not supported on Windows\n");
+    return -1;
+}
+
+int whisper_archive_append(whisper_archive* ar, const whisper_unwrapped* msg,
+                           const nostr_key* recipient) {
+    (void)ar;
+    (void)msg;
+    (void)recipient;
+    return -1;
+}
+
+void whisper_archive_close(whisper_archive* ar) {
+    (void)ar;
+}
+
+int whisper_log(const whisper_log_config* config) {
+    (void)config;
+    fprintf(stderr, "Error: whisper log not supported on Windows\n");
+    return WHISPER_EXIT_INVALID_ARGS;
+}
+
+#endif
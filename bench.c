@@ -0,0 +1,279 @@
+/*
+ * whisper benchmarks - Hot-path throughput, one JSON object per line
+ *
+ * Build and run with `make bench`. Output is NDJSON so runs against two
+ * builds of libnostr-c/noscrypt can be diffed or fed to jq:
+ *   {"bench":"nip17_send_dm","size":1024,"iters":512,"ns_per_op":...,"mb_per_s":...}
+ *
+ * Usage: whisper_bench [-t <ms per bench>] [name-substring...]
+ */
+
+#ifndef WHISPER_BENCH
+#define WHISPER_BENCH
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "whisper.h"
+#include "text.h"
+#include "tui.h"
+
+#define BENCH_DEFAULT_MS 300
+#define TUI_MESSAGES 10000
+#define TUI_ROUNDS 200
+
+/* Fixed test keys so runs are comparable */
+#define SENDER_HEX    "0000000000000000000000000000000000000000000000000000000000000001"
+#define RECIPIENT_HEX "0000000000000000000000000000000000000000000000000000000000000002"
+
+static const size_t crypto_sizes[] = { 16, 1024, 16384, 65000 };
+static const size_t text_sizes[] = { 64, 1024, 16384, 65536 };
+
+static int64_t g_min_ns = (int64_t)BENCH_DEFAULT_MS * 1000000;
+static char** g_filters;
+static int g_filter_count;
+
+typedef int (*bench_fn)(void* arg, size_t size);
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool wanted(const char* name) {
+    if (g_filter_count == 0) return true;
+    for (int i = 0; i < g_filter_count; i++) {
+        if (strstr(name, g_filters[i])) return true;
+    }
+    return false;
+}
+
+static void emit(const char* name, size_t size, long iters, double ns_per_op) {
+    printf("{\"bench\":\"%s\",\"size\":%zu,\"iters\":%ld,\"ns_per_op\":%.1f",
+           name, size, iters, ns_per_op);
+    if (size > 0) printf(",\"mb_per_s\":%.2f", (double)size * 1e3 / ns_per_op);
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* Run fn in growing batches until the minimum time is spent, then report */
+static void run(const char* name, size_t size, bench_fn fn, void* arg) {
+    if (!wanted(name)) return;
+    if (fn(arg, size) != 0) {
+        printf("{\"bench\":\"%s\",\"size\":%zu,\"error\":\"failed\"}\n", name, size);
+        return;
+    }
+
+    long iters = 0;
+    long batch = 1;
+    int64_t start = now_ns();
+    int64_t elapsed = 0;
+    while (elapsed < g_min_ns) {
+        for (long i = 0; i < batch; i++) {
+            if (fn(arg, size) != 0) {
+                printf("{\"bench\":\"%s\",\"size\":%zu,\"error\":\"failed\"}\n", name, size);
+                return;
+            }
+        }
+        iters += batch;
+        elapsed = now_ns() - start;
+        if (batch < (1L << 20)) batch *= 2;
+    }
+    emit(name, size, iters, (double)elapsed / iters);
+}
+
+/* Printable text with an escape sequence, quote or newline now and then */
+static void fill_text(char* buf, size_t size) {
+    uint32_t rng = 2463534242u;
+    for (size_t i = 0; i < size; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        switch (rng % 211) {
+            case 0:  buf[i] = '\x1b'; break;
+            case 1:  buf[i] = '"'; break;
+            case 2:  buf[i] = '\n'; break;
+            default: buf[i] = (char)(' ' + rng % 95); break;
+        }
+    }
+    buf[size] = '\0';
+}
+
+typedef struct {
+    char* in;
+    char* out;
+    whisper_buf json;
+} text_bench;
+
+static int bench_strip(void* arg, size_t size) {
+    text_bench* t = (text_bench*)arg;
+    whisper_strip_control_chars_into(t->in, size, t->out);
+    return 0;
+}
+
+static int bench_strip_scalar(void* arg, size_t size) {
+    text_bench* t = (text_bench*)arg;
+    whisper_strip_control_chars_scalar(t->in, size, t->out);
+    return 0;
+}
+
+static int bench_json_escape(void* arg, size_t size) {
+    text_bench* t = (text_bench*)arg;
+    t->json.len = 0;
+    return whisper_buf_append_json(&t->json, t->in, size);
+}
+
+static void run_text(void) {
+    size_t max = text_sizes[sizeof(text_sizes) / sizeof(text_sizes[0]) - 1];
+    text_bench t = {0};
+    t.in = malloc(max + 1);
+    t.out = malloc(max + 1);
+    if (!t.in || !t.out) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(t.in);
+        free(t.out);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(text_sizes) / sizeof(text_sizes[0]); i++) {
+        size_t size = text_sizes[i];
+        fill_text(t.in, size);
+        run("strip_control_chars", size, bench_strip, &t);
+        run("strip_control_chars_scalar", size, bench_strip_scalar, &t);
+        run("json_escape", size, bench_json_escape, &t);
+    }
+
+    whisper_buf_free(&t.json);
+    free(t.in);
+    free(t.out);
+}
+
+typedef struct {
+    nostr_privkey sender;
+    nostr_privkey recipient;
+    nostr_key recipient_pub;
+    char* content;
+    nostr_event* wrap;           /* pre-made for the unwrap bench */
+} crypto_bench;
+
+static int bench_send_dm(void* arg, size_t size) {
+    crypto_bench* c = (crypto_bench*)arg;
+    (void)size;
+    nostr_event* dm = NULL;
+    if (nostr_nip17_send_dm(&dm, c->content, &c->sender, &c->recipient_pub,
+                            NULL, NULL, 0) != NOSTR_OK || !dm) {
+        return -1;
+    }
+    nostr_event_destroy(dm);
+    return 0;
+}
+
+static int bench_unwrap_dm(void* arg, size_t size) {
+    crypto_bench* c = (crypto_bench*)arg;
+    (void)size;
+    nostr_event* rumor = NULL;
+    nostr_key sender;
+    if (nostr_nip17_unwrap_dm(c->wrap, &c->recipient, &rumor, &sender) != NOSTR_OK || !rumor) {
+        return -1;
+    }
+    nostr_event_destroy(rumor);
+    return 0;
+}
+
+static void run_crypto(void) {
+    if (!wanted("nip17_send_dm") && !wanted("nip17_unwrap_dm")) return;
+
+    crypto_bench c;
+    memset(&c, 0, sizeof(c));
+    nostr_keypair recipient;
+    if (nostr_privkey_from_hex(SENDER_HEX, &c.sender) != NOSTR_OK ||
+        nostr_privkey_from_hex(RECIPIENT_HEX, &c.recipient) != NOSTR_OK ||
+        nostr_keypair_from_private_key(&recipient, &c.recipient) != NOSTR_OK) {
+        fprintf(stderr, "Error: Failed to load benchmark keys\n");
+        return;
+    }
+    c.recipient_pub = recipient.pubkey;
+    nostr_keypair_destroy(&recipient);
+
+    size_t max = crypto_sizes[sizeof(crypto_sizes) / sizeof(crypto_sizes[0]) - 1];
+    c.content = malloc(max + 1);
+    if (!c.content) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(crypto_sizes) / sizeof(crypto_sizes[0]); i++) {
+        size_t size = crypto_sizes[i];
+        memset(c.content, 'x', size);
+        c.content[size] = '\0';
+        run("nip17_send_dm", size, bench_send_dm, &c);
+
+        if (!wanted("nip17_unwrap_dm")) continue;
+        if (nostr_nip17_send_dm(&c.wrap, c.content, &c.sender, &c.recipient_pub,
+                                NULL, NULL, 0) != NOSTR_OK || !c.wrap) {
+            printf("{\"bench\":\"nip17_unwrap_dm\",\"size\":%zu,\"error\":\"failed\"}\n", size);
+            continue;
+        }
+        run("nip17_unwrap_dm", size, bench_unwrap_dm, &c);
+        nostr_event_destroy(c.wrap);
+        c.wrap = NULL;
+    }
+
+    free(c.content);
+    secure_wipe(&c, sizeof(c));
+}
+
+static void run_tui(void) {
+#ifdef HAVE_NOTCURSES
+    if (!wanted("tui_")) return;
+
+    whisper_tui_bench_result r;
+    if (whisper_tui_bench(TUI_MESSAGES, TUI_ROUNDS, &r) != 0) {
+        printf("{\"bench\":\"tui\",\"error\":\"headless notcurses unavailable\"}\n");
+        return;
+    }
+    printf("{\"bench\":\"tui_add_message_sorted\",\"messages\":%d,\"iters\":%d,\"ns_per_op\":%.1f}\n",
+           r.messages, TUI_MESSAGES, r.add_ns);
+    printf("{\"bench\":\"tui_render_messages_full\",\"messages\":%d,\"iters\":%d,\"ns_per_op\":%.1f}\n",
+           r.messages, TUI_ROUNDS, r.render_full_ns);
+    printf("{\"bench\":\"tui_render_messages_row\",\"messages\":%d,\"iters\":%d,\"ns_per_op\":%.1f}\n",
+           r.messages, TUI_ROUNDS, r.render_row_ns);
+    printf("{\"bench\":\"tui_render_messages_idle\",\"messages\":%d,\"iters\":%d,\"ns_per_op\":%.1f}\n",
+           r.messages, TUI_ROUNDS, r.render_idle_ns);
+    fflush(stdout);
+#endif
+}
+
+int main(int argc, char** argv) {
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        long ms = strtol(argv[2], NULL, 10);
+        if (ms < 1) {
+            fprintf(stderr, "Error: Invalid -t value: %s\n", argv[2]);
+            return WHISPER_EXIT_INVALID_ARGS;
+        }
+        g_min_ns = (int64_t)ms * 1000000;
+        first = 3;
+    }
+    g_filters = argv + first;
+    g_filter_count = argc - first;
+
+    if (nostr_init() != NOSTR_OK) {
+        fprintf(stderr, "Error: Failed to initialize libnostr\n");
+        return WHISPER_EXIT_CRYPTO_ERROR;
+    }
+
+#ifdef __VERSION__
+    printf("{\"bench\":\"meta\",\"cc\":\"%s\",\"ms_per_bench\":%lld}\n",
+           __VERSION__, (long long)(g_min_ns / 1000000));
+#endif
+    run_text();
+    run_crypto();
+    run_tui();
+
+    nostr_cleanup();
+    return WHISPER_EXIT_OK;
+}
@@ -0,0 +1,985 @@
+/*
+ * whisper daemon - Resident key, relay connections and inbox behind a
+ * Unix domain socket, so send/recv can run as thin clients.
+ *
+ * Protocol: one JSON object per line in each direction.
+ *   {"op":"send","to":...,"content":...,"subject":...}
+ *       -> {"id":"<hex>"} or {"error":"...","code":N}
+ *   {"op":"recv","since":N}
+ *       -> stream of {"from":...,"content":...,"created_at":N} lines,
+ *          replaying recent history first, until the client disconnects
+ *   {"op":"stats","format":"prometheus"|"json"}
+ *       -> {"prometheus":"<text exposition>"} or {"stats":{...}}
+ *   {"op":"key","name":"<keep key name>"}   (only with --key-agent)
+ *       -> {"privkey":"<hex>","pubkey":"<hex>"} or {"error":"...","code":N}
+ */
+
+#define _GNU_SOURCE  /* struct ucred */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <ctype.h>
+#include "whisper.h"
+
+#ifdef _WIN32
+
+int whisper_daemon(const whisper_daemon_config* config) {
+    (void)config;
+    fprintf(stderr, "Error: daemon mode not supported on Windows\n");
+    return WHISPER_EXIT_INVALID_ARGS;
+}
+
+const char* whisper_daemon_default_socket(char* buf, size_t size) {
+    if (size > 0) buf[0] = '\0';
+    return NULL;
+}
+
+int whisper_daemon_connect(const char* path) {
+    (void)path;
+    fprintf(stderr, "Error: daemon mode not supported on Windows\n");
+    return -1;
+}
+
+int whisper_daemon_request(int fd, const cJSON* request) {
+    (void)fd;
+    (void)request;
+    return -1;
+}
+
+cJSON* whisper_daemon_read(FILE* in) {
+    (void)in;
+    return NULL;
+}
+
+int whisper_daemon_stats(const char* socket_path, bool json_output) {
+    (void)socket_path;
+    (void)json_output;
+    fprintf(stderr, "Error: daemon mode not supported on Windows\n");
+    return WHISPER_EXIT_INVALID_ARGS;
+}
+
+int whisper_daemon_key(const char* socket_path, const char* name,
+                       nostr_privkey* privkey, nostr_key* pubkey) {
+    (void)socket_path;
+    (void)name;
+    (void)privkey;
+    (void)pubkey;
+    return -1;
+}
+
+#else
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_MESSAGE_SIZE (64 * 1024)
+#define DAEMON_HISTORY 1000            /* messages replayed to new recv clients */
+#define DAEMON_IDLE_CHECK_MS 1000
+#define DAEMON_CLIENT_SEND_TIMEOUT_S 2 /* drop recv clients that stop reading */
+#define DAEMON_KEY_TIMEOUT_S 2         /* key agent lookups fall back to keep after this */
+#define DAEMON_STATS_INTERVAL_MS 60000 /* --stats summary period */
+
+typedef struct daemon_client {
+    int fd;
+    whisper_mutex write_lock;          /* one reply or record on the fd at a time */
+    bool subscribed;
+    int pending_sends;                 /* submitted, reply not yet written */
+    int refs;                          /* fan-out writes in flight, with clients_lock */
+    struct daemon_client* next;
+} daemon_client;
+
+typedef struct {
+    char* line;                        /* serialized record, '\n'-terminated */
+    int64_t created_at;
+} daemon_record;
+
+typedef struct {
+    /* Receives for every identity; sends go out as the first */
+    nostr_privkey privkeys[WHISPER_MAX_IDENTITIES];
+    nostr_key pubkeys[WHISPER_MAX_IDENTITIES];
+    char npubs[WHISPER_MAX_IDENTITIES][100];
+    const char* keep_names[WHISPER_MAX_IDENTITIES];
+    int identity_count;
+    bool key_agent;
+    whisper_pool pool;
+    whisper_unwrapper unwrap;
+    whisper_peer_cache peers;
+    int quorum;
+    int timeout_ms;
+
+    /* Sends from every client share the wrap workers and one window of
+     * events awaiting OKs */
+    whisper_wrapper wrap;
+    whisper_publisher publisher;
+    pthread_cond_t sends_done;         /* with clients_lock: a send replied or refs dropped */
+
+    /* History ring and client list */
+    whisper_mutex clients_lock;
+    daemon_record history[DAEMON_HISTORY];
+    int history_head;
+    int history_count;
+    daemon_client* clients;
+    int active_clients;
+} daemon_state;
+
+static volatile sig_atomic_t g_running = 1;
+static whisper_wakeup g_stop = WHISPER_WAKEUP_INIT;
+static daemon_state g_daemon;
+
+static void signal_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+    whisper_wakeup_signal(&g_stop);
+}
+
+const char* whisper_daemon_default_socket(char* buf, size_t size) {
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && runtime[0]) {
+        snprintf(buf, size, "%s/whisper/daemon.sock", runtime);
+    } else {
+        snprintf(buf, size, "/tmp/whisper-%lu/daemon.sock", (unsigned long)getuid());
+    }
+    return buf;
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int whisper_daemon_request(int fd, const cJSON* request) {
+    char* line = cJSON_PrintUnformatted(request);
+    if (!line) return -1;
+    int rc = write_all(fd, line, strlen(line));
+    if (rc == 0) rc = write_all(fd, "\n", 1);
+    secure_wipe(line, strlen(line));
+    cJSON_free(line);
+    return rc;
+}
+
+cJSON* whisper_daemon_read(FILE* in) {
+    char* line = NULL;
+    size_t cap = 0;
+    cJSON* obj = NULL;
+
+    if (getline(&line, &cap, in) > 0) {
+        obj = cJSON_Parse(line);
+    }
+    if (line) {
+        secure_wipe(line, cap);
+        free(line);
+    }
+    return obj;
+}
+
+int whisper_daemon_connect(const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create socket\n");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error: Could not reach whisper daemon at %s\n", path);
+        fprintf(stderr, "Hint: Start it with 'whisper daemon --relay <url> [key options]'\n");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int whisper_daemon_stats(const char* socket_path, bool json_output) {
+    int fd = whisper_daemon_connect(socket_path);
+    if (fd < 0) return WHISPER_EXIT_RELAY_ERROR;
+
+    int ret = WHISPER_EXIT_RELAY_ERROR;
+    FILE* in = fdopen(fd, "r");
+    cJSON* request = cJSON_CreateObject();
+    cJSON* reply = NULL;
+    if (!in || !request ||
+        !cJSON_AddStringToObject(request, "op", "stats") ||
+        !cJSON_AddStringToObject(request, "format", json_output ? "json" : "prometheus") ||
+        whisper_daemon_request(fd, request) != 0 ||
+        !(reply = whisper_daemon_read(in))) {
+        fprintf(stderr, "Error: No reply from whisper daemon\n");
+        goto out;
+    }
+
+    const cJSON* text = cJSON_GetObjectItemCaseSensitive(reply, "prometheus");
+    const cJSON* stats = cJSON_GetObjectItemCaseSensitive(reply, "stats");
+    const cJSON* error = cJSON_GetObjectItemCaseSensitive(reply, "error");
+    if (cJSON_IsString(text)) {
+        fputs(text->valuestring, stdout);
+        ret = WHISPER_EXIT_OK;
+    } else if (cJSON_IsObject(stats)) {
+        char* json = cJSON_PrintUnformatted(stats);
+        if (json) {
+            printf("%s\n", json);
+            cJSON_free(json);
+            ret = WHISPER_EXIT_OK;
+        }
+    } else {
+        fprintf(stderr, "Error: %s\n", cJSON_IsString(error) ? error->valuestring
+                                                             : "Unexpected reply from daemon");
+    }
+
+out:
+    cJSON_Delete(reply);
+    cJSON_Delete(request);
+    if (in) {
+        fclose(in);
+    } else {
+        close(fd);
+    }
+    return ret;
+}
+
+/* Only the daemon's own user may talk to it */
+static bool peer_allowed(int fd) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) return false;
+    return uid == getuid();
+#endif
+}
+
+/* Read one short reply line straight into buf, so nothing secret lands in
+ * stdio or cJSON buffers that are freed unwiped */
+static int read_line(int fd, char* buf, size_t size) {
+    size_t len = 0;
+    while (len + 1 < size) {
+        ssize_t n = recv(fd, buf + len, size - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len += (size_t)n;
+        char* nl = memchr(buf, '\n', len);
+        if (nl) {
+            *nl = '\0';
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Hex value of "field":"..." in a reply line we formatted ourselves */
+static const char* reply_hex(const char* line, const char* field, char out[65]) {
+    char key[32];
+    snprintf(key, sizeof(key), "\"%s\":\"", field);
+    const char* p = strstr(line, key);
+    if (!p) return NULL;
+    p += strlen(key);
+    size_t n = 0;
+    while (n < 64 && isxdigit((unsigned char)p[n])) n++;
+    if (n != 64 || p[n] != '"') return NULL;
+    memcpy(out, p, 64);
+    out[64] = '\0';
+    return out;
+}
+
+int whisper_daemon_key(const char* socket_path, const char* name,
+                       nostr_privkey* privkey, nostr_key* pubkey) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+    memcpy(addr.sun_path, socket_path, strlen(socket_path) + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int rc = -1;
+    char line[512];
+    char hex[65];
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || !peer_allowed(fd)) goto out;
+
+    struct timeval tv = { .tv_sec = DAEMON_KEY_TIMEOUT_S };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    cJSON* req = cJSON_CreateObject();
+    if (!req) goto out;
+    cJSON_AddStringToObject(req, "op", "key");
+    cJSON_AddStringToObject(req, "name", name);
+    int sent = whisper_daemon_request(fd, req);
+    cJSON_Delete(req);
+    if (sent != 0 || read_line(fd, line, sizeof(line)) != 0) goto out;
+
+    if (reply_hex(line, "privkey", hex) && nostr_privkey_from_hex(hex, privkey) == NOSTR_OK) {
+        if (reply_hex(line, "pubkey", hex) && nostr_key_from_hex(hex, pubkey) == NOSTR_OK) {
+            rc = 0;
+        } else {
+            secure_wipe(privkey, sizeof(*privkey));
+        }
+    }
+
+out:
+    secure_wipe(line, sizeof(line));
+    secure_wipe(hex, sizeof(hex));
+    close(fd);
+    return rc;
+}
+
+/* Create the socket directory 0700, refusing one owned by someone else */
+static int prepare_socket_dir(const char* path) {
+    char dir[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char* slash = strrchr(dir, '/');
+    if (!slash || slash == dir) return 0;
+    *slash = '\0';
+
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Could not create %s\n", dir);
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(dir, &st) != 0 || st.st_uid != getuid()) {
+        fprintf(stderr, "Error: Socket directory %s is not owned by you\n", dir);
+        return -1;
+    }
+    if ((st.st_mode & 077) != 0) {
+        fprintf(stderr, "Warning: Socket directory '%s' has insecure permissions\n", dir);
+        fprintf(stderr, "  Recommended: chmod 700 %s\n", dir);
+    }
+    return 0;
+}
+
+static int listen_socket(const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    if (prepare_socket_dir(path) != 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create socket\n");
+        return -1;
+    }
+
+    /* A stale socket from a crashed daemon refuses connections */
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        if (connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            fprintf(stderr, "Error: A whisper daemon is already listening on %s\n", path);
+            close(probe);
+            close(fd);
+            return -1;
+        }
+        close(probe);
+    }
+    unlink(path);
+
+    mode_t old_mask = umask(077);
+    int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (rc != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Everything written to a client goes through these, so publisher, wrap,
+ * unwrap and client threads never interleave lines on the socket */
+static int client_write(daemon_client* c, const char* data, size_t len) {
+    whisper_mutex_lock(&c->write_lock);
+    int rc = write_all(c->fd, data, len);
+    whisper_mutex_unlock(&c->write_lock);
+    return rc;
+}
+
+static int client_reply(daemon_client* c, const cJSON* reply) {
+    whisper_mutex_lock(&c->write_lock);
+    int rc = whisper_daemon_request(c->fd, reply);
+    whisper_mutex_unlock(&c->write_lock);
+    return rc;
+}
+
+static void reply_error(daemon_client* c, const char* message, int code) {
+    cJSON* reply = cJSON_CreateObject();
+    if (!reply) return;
+    cJSON_AddStringToObject(reply, "error", message);
+    cJSON_AddNumberToObject(reply, "code", code);
+    client_reply(c, reply);
+    cJSON_Delete(reply);
+}
+
+/* Publisher thread: reply to the client that submitted the event */
+static void send_done(const whisper_publish_result* result, void* user_data) {
+    daemon_state* d = (daemon_state*)user_data;
+    daemon_client* c = (daemon_client*)result->token;
+
+    if (result->code != WHISPER_EXIT_OK &&
+        !(result->code == WHISPER_EXIT_TIMEOUT && d->quorum <= 1)) {
+        reply_error(c, result->error, result->code);
+    } else {
+        cJSON* reply = cJSON_CreateObject();
+        if (reply) {
+            cJSON_AddStringToObject(reply, "id", result->id);
+            if (result->code == WHISPER_EXIT_TIMEOUT) cJSON_AddBoolToObject(reply, "unconfirmed", 1);
+            client_reply(c, reply);
+            cJSON_Delete(reply);
+        }
+    }
+
+    whisper_mutex_lock(&d->clients_lock);
+    c->pending_sends--;
+    pthread_cond_broadcast(&d->sends_done);
+    whisper_mutex_unlock(&d->clients_lock);
+}
+
+/* Keep replies in request order: earlier sends answer first */
+static void wait_sends(daemon_state* d, daemon_client* c) {
+    whisper_mutex_lock(&d->clients_lock);
+    while (c->pending_sends > 0) {
+        pthread_cond_wait(&d->sends_done, &d->clients_lock);
+    }
+    whisper_mutex_unlock(&d->clients_lock);
+}
+
+static void send_error(daemon_state* d, daemon_client* c, const char* message, int code) {
+    wait_sends(d, c);
+    reply_error(c, message, code);
+}
+
+/* A pending send the pipeline refused because it is stopping: answer it
+ * here, since no send_done will */
+static void send_refused(daemon_state* d, daemon_client* c) {
+    reply_error(c, "Daemon is shutting down", WHISPER_EXIT_RELAY_ERROR);
+    whisper_mutex_lock(&d->clients_lock);
+    c->pending_sends--;
+    pthread_cond_broadcast(&d->sends_done);
+    whisper_mutex_unlock(&d->clients_lock);
+}
+
+/* Wrap worker: publish, or queue the failure behind the client's earlier sends */
+static void send_wrapped(const whisper_wrapped* result, void* user_data) {
+    daemon_state* d = (daemon_state*)user_data;
+    int rc = result->event
+        ? whisper_publisher_submit(&d->publisher, result->event, result->token)
+        : whisper_publisher_fail(&d->publisher, result->code, result->error, result->token);
+    if (rc != 0) send_refused(d, (daemon_client*)result->token);
+}
+
+static void handle_send(daemon_state* d, daemon_client* c, const cJSON* req) {
+    const cJSON* to = cJSON_GetObjectItemCaseSensitive(req, "to");
+    const cJSON* content = cJSON_GetObjectItemCaseSensitive(req, "content");
+    const cJSON* subject = cJSON_GetObjectItemCaseSensitive(req, "subject");
+    nostr_key recipient;
+
+    const char* error = NULL;
+    int code = WHISPER_EXIT_INVALID_ARGS;
+    if (!cJSON_IsString(to)) {
+        error = "Missing \"to\"";
+    } else if (!cJSON_IsString(content) || !content->valuestring[0]) {
+        error = "Missing \"content\"";
+    } else if (strlen(content->valuestring) >= MAX_MESSAGE_SIZE) {
+        error = "Message too large";
+    } else if (whisper_peer_parse(&d->peers, to->valuestring, &recipient) != 0) {
+        code = WHISPER_EXIT_KEY_ERROR;
+        error = "Invalid recipient pubkey";
+    }
+
+    /* Every reply is written by send_done, in the order requests arrived */
+    whisper_mutex_lock(&d->clients_lock);
+    c->pending_sends++;
+    whisper_mutex_unlock(&d->clients_lock);
+    int rc = error
+        ? whisper_wrap_fail(&d->wrap, code, error, c)
+        : whisper_wrap_submit(&d->wrap, &recipient, content->valuestring,
+                              cJSON_IsString(subject) ? subject->valuestring : NULL, c);
+    if (rc != 0) send_refused(d, c);
+}
+
+static void reply_stats(daemon_client* c, const cJSON* req) {
+    const cJSON* format = cJSON_GetObjectItemCaseSensitive(req, "format");
+    bool json = cJSON_IsString(format) && strcmp(format->valuestring, "json") == 0;
+
+    whisper_buf out = {0};
+    int rc = json ? whisper_stats_json(&out) : whisper_stats_prometheus(&out);
+    if (rc != 0 || whisper_buf_append(&out, "", 1) != 0) {
+        whisper_buf_free(&out);
+        reply_error(c, "Out of memory", WHISPER_EXIT_CRYPTO_ERROR);
+        return;
+    }
+
+    cJSON* reply = cJSON_CreateObject();
+    if (reply) {
+        if (json) {
+            cJSON* stats = cJSON_Parse(out.data);
+            if (stats) cJSON_AddItemToObject(reply, "stats", stats);
+        } else {
+            cJSON_AddStringToObject(reply, "prometheus", out.data);
+        }
+        client_reply(c, reply);
+        cJSON_Delete(reply);
+    }
+    whisper_buf_free(&out);
+}
+
+/* Key agent: hand a keep-vault key to a same-user client (peer_allowed ran
+ * at accept), so it skips the keep fork/exec and unlock */
+static void reply_key(daemon_state* d, daemon_client* c, const cJSON* req) {
+    const cJSON* name = cJSON_GetObjectItemCaseSensitive(req, "name");
+    if (!d->key_agent) {
+        reply_error(c, "Key agent is off (start the daemon with --key-agent)",
+                    WHISPER_EXIT_KEY_ERROR);
+        return;
+    }
+    int i = 0;
+    while (i < d->identity_count &&
+           !(cJSON_IsString(name) && d->keep_names[i] &&
+             strcmp(d->keep_names[i], name->valuestring) == 0)) {
+        i++;
+    }
+    if (i == d->identity_count) {
+        reply_error(c, "No such keep key", WHISPER_EXIT_KEY_ERROR);
+        return;
+    }
+
+    char privkey_hex[65];
+    char pubkey_hex[65];
+    char line[160];
+    nostr_privkey_to_hex(&d->privkeys[i], privkey_hex, sizeof(privkey_hex));
+    nostr_key_to_hex(&d->pubkeys[i], pubkey_hex, sizeof(pubkey_hex));
+    int n = snprintf(line, sizeof(line), "{\"privkey\":\"%s\",\"pubkey\":\"%s\"}\n",
+                     privkey_hex, pubkey_hex);
+    if (n > 0 && (size_t)n < sizeof(line)) client_write(c, line, (size_t)n);
+    secure_wipe(privkey_hex, sizeof(privkey_hex));
+    secure_wipe(line, sizeof(line));
+}
+
+/* Replay history newer than since, then start live delivery. The replay
+ * is copied out under clients_lock and written under write_lock alone;
+ * live records queue on write_lock behind it, so none is lost or early. */
+static void attach_recv(daemon_state* d, daemon_client* c, int64_t since) {
+    struct timeval tv = { .tv_sec = DAEMON_CLIENT_SEND_TIMEOUT_S };
+    setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    whisper_mutex_lock(&c->write_lock);
+    whisper_mutex_lock(&d->clients_lock);
+    whisper_buf replay = {0};
+    int start = (d->history_head - d->history_count + DAEMON_HISTORY) % DAEMON_HISTORY;
+    bool ok = true;
+    for (int i = 0; i < d->history_count && ok; i++) {
+        const daemon_record* r = &d->history[(start + i) % DAEMON_HISTORY];
+        if (r->created_at >= since) ok = whisper_buf_puts(&replay, r->line) == 0;
+    }
+    c->subscribed = ok;
+    whisper_mutex_unlock(&d->clients_lock);
+
+    if (ok && replay.len > 0 && write_all(c->fd, replay.data, replay.len) != 0) ok = false;
+    if (!ok) {
+        whisper_mutex_lock(&d->clients_lock);
+        c->subscribed = false;
+        whisper_mutex_unlock(&d->clients_lock);
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    whisper_mutex_unlock(&c->write_lock);
+
+    if (replay.data) secure_wipe(replay.data, replay.len);
+    whisper_buf_free(&replay);
+}
+
+static void* client_thread(void* arg) {
+    daemon_client* c = (daemon_client*)arg;
+    daemon_state* d = &g_daemon;
+
+    int read_fd = dup(c->fd);
+    FILE* in = read_fd >= 0 ? fdopen(read_fd, "r") : NULL;
+    if (!in && read_fd >= 0) close(read_fd);
+
+    cJSON* req;
+    while (in && g_running && (req = whisper_daemon_read(in)) != NULL) {
+        const cJSON* op = cJSON_GetObjectItemCaseSensitive(req, "op");
+        const char* name = cJSON_IsString(op) ? op->valuestring : "send";
+
+        if (strcmp(name, "send") == 0) {
+            handle_send(d, c, req);
+        } else if (strcmp(name, "recv") == 0) {
+            const cJSON* since = cJSON_GetObjectItemCaseSensitive(req, "since");
+            wait_sends(d, c);
+            attach_recv(d, c, cJSON_IsNumber(since) ? (int64_t)since->valuedouble : 0);
+        } else if (strcmp(name, "stats") == 0) {
+            wait_sends(d, c);
+            reply_stats(c, req);
+        } else if (strcmp(name, "key") == 0) {
+            wait_sends(d, c);
+            reply_key(d, c, req);
+        } else {
+            send_error(d, c, "Unknown op", WHISPER_EXIT_INVALID_ARGS);
+        }
+        cJSON_Delete(req);
+    }
+    if (in) fclose(in);
+    wait_sends(d, c);
+
+    whisper_mutex_lock(&d->clients_lock);
+    for (daemon_client** p = &d->clients; *p; p = &(*p)->next) {
+        if (*p == c) {
+            *p = c->next;
+            break;
+        }
+    }
+    d->active_clients--;
+    /* A fan-out may still be writing to us outside the lock */
+    while (c->refs > 0) {
+        pthread_cond_wait(&d->sends_done, &d->clients_lock);
+    }
+    whisper_mutex_unlock(&d->clients_lock);
+
+    close(c->fd);
+    whisper_mutex_destroy(&c->write_lock);
+    free(c);
+    whisper_wakeup_signal(&g_stop);
+    return NULL;
+}
+
+static void record_free(daemon_record* r) {
+    if (r->line) {
+        secure_wipe(r->line, strlen(r->line));
+        free(r->line);
+        r->line = NULL;
+    }
+}
+
+/* Relay thread: hand the gift wrap to the unwrap workers */
+static void event_cb(whisper_pool_relay* conn, const nostr_event* event, void* user_data) {
+    daemon_state* d = (daemon_state*)user_data;
+    whisper_unwrap_submit(&d->unwrap, event,
+                          whisper_prefilter_recipient(&conn->pool->filter, event));
+}
+
+/* Unwrap worker: record the message and fan it out to recv clients */
+static void rumor_cb(const whisper_unwrapped* msg, void* user_data) {
+    const nostr_event* rumor = msg->rumor;
+    const nostr_key* sender_pubkey = &msg->sender;
+    daemon_state* d = (daemon_state*)user_data;
+
+    char sender_npub[100];
+    whisper_peer_npub(&d->peers, sender_pubkey, sender_npub, sizeof(sender_npub));
+
+    cJSON* obj = cJSON_CreateObject();
+    char* json = NULL;
+    if (obj) {
+        cJSON_AddStringToObject(obj, "from", sender_npub);
+        if (d->identity_count > 1) cJSON_AddStringToObject(obj, "to", d->npubs[msg->identity]);
+        cJSON_AddStringToObject(obj, "content", rumor->content ? rumor->content : "");
+        cJSON_AddNumberToObject(obj, "created_at", (double)rumor->created_at);
+        json = cJSON_PrintUnformatted(obj);
+        cJSON_Delete(obj);
+    }
+
+    size_t len = json ? strlen(json) : 0;
+    char* line = json ? malloc(len + 2) : NULL;
+    if (line) {
+        memcpy(line, json, len);
+        line[len] = '\n';
+        line[len + 1] = '\0';
+    }
+    if (json) {
+        secure_wipe(json, len);
+        cJSON_free(json);
+    }
+
+    if (!line) return;
+
+    /* Record it and pin the subscribers; the writes happen unlocked, so a
+     * slow reader holds up only this fan-out, never sends or accepts */
+    whisper_mutex_lock(&d->clients_lock);
+    daemon_record* r = &d->history[d->history_head];
+    record_free(r);
+    r->line = line;
+    r->created_at = rumor->created_at;
+    d->history_head = (d->history_head + 1) % DAEMON_HISTORY;
+    if (d->history_count < DAEMON_HISTORY) d->history_count++;
+
+    int count = 0;
+    daemon_client** targets = d->active_clients > 0
+        ? malloc((size_t)d->active_clients * sizeof(*targets)) : NULL;
+    for (daemon_client* c = d->clients; c; c = c->next) {
+        if (!c->subscribed) continue;
+        if (!targets) {
+            /* Cut off rather than skip a message */
+            c->subscribed = false;
+            shutdown(c->fd, SHUT_RDWR);
+            continue;
+        }
+        c->refs++;
+        targets[count++] = c;
+    }
+    /* The line stays ours: rumor_cb calls are serialized, and only the
+     * next one can evict it from the history ring */
+    whisper_mutex_unlock(&d->clients_lock);
+
+    for (int i = 0; i < count; i++) {
+        daemon_client* c = targets[i];
+        if (client_write(c, line, len + 1) != 0) {
+            /* Wakes the client thread, which cleans up */
+            whisper_mutex_lock(&d->clients_lock);
+            c->subscribed = false;
+            whisper_mutex_unlock(&d->clients_lock);
+            shutdown(c->fd, SHUT_RDWR);
+        }
+    }
+
+    whisper_mutex_lock(&d->clients_lock);
+    for (int i = 0; i < count; i++) targets[i]->refs--;
+    if (count > 0) pthread_cond_broadcast(&d->sends_done);
+    whisper_mutex_unlock(&d->clients_lock);
+    free(targets);
+}
+
+static void message_cb(whisper_pool_relay* conn, const char* message_type,
+                       const char* data, void* user_data) {
+    (void)user_data;
+    if (strcmp(message_type, "NOTICE") == 0) {
+        fprintf(stderr, "Relay notice (%s): %s\n", conn->url, data);
+    }
+}
+
+static void accept_client(daemon_state* d, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    if (!peer_allowed(fd)) {
+        close(fd);
+        return;
+    }
+
+    daemon_client* c = calloc(1, sizeof(daemon_client));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    c->fd = fd;
+    whisper_mutex_init(&c->write_lock);
+
+    whisper_mutex_lock(&d->clients_lock);
+    c->next = d->clients;
+    d->clients = c;
+    d->active_clients++;
+    whisper_mutex_unlock(&d->clients_lock);
+
+    pthread_attr_t attr;
+    pthread_t tid;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&tid, &attr, client_thread, c) != 0) {
+        whisper_mutex_lock(&d->clients_lock);
+        d->clients = c->next;
+        d->active_clients--;
+        whisper_mutex_unlock(&d->clients_lock);
+        close(fd);
+        whisper_mutex_destroy(&c->write_lock);
+        free(c);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/* Disconnect every client and wait for their threads to exit. Nothing is
+ * torn down before that: client threads use the wrapper, the publisher,
+ * clients_lock and g_stop to the end. The pipeline keeps running, so each
+ * in-flight send is answered within the publisher's timeout. */
+static void drain_clients(daemon_state* d) {
+    whisper_mutex_lock(&d->clients_lock);
+    for (daemon_client* c = d->clients; c; c = c->next) {
+        c->subscribed = false;
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    whisper_mutex_unlock(&d->clients_lock);
+
+    for (;;) {
+        whisper_mutex_lock(&d->clients_lock);
+        int active = d->active_clients;
+        whisper_mutex_unlock(&d->clients_lock);
+
+        if (active == 0) break;
+        whisper_wakeup_wait(&g_stop, DAEMON_IDLE_CHECK_MS);
+    }
+}
+
+int whisper_daemon(const whisper_daemon_config* config) {
+    int ret = WHISPER_EXIT_OK;
+    daemon_state* d = &g_daemon;
+    int listen_fd = -1;
+    char default_path[108];
+    const char* socket_path = config->socket_path;
+    if (!socket_path) {
+        socket_path = whisper_daemon_default_socket(default_path, sizeof(default_path));
+    }
+
+    d->quorum = config->quorum > 0 ? config->quorum : 1;
+    d->timeout_ms = config->timeout_ms;
+    whisper_mutex_init(&d->clients_lock);
+    pthread_cond_init(&d->sends_done, NULL);
+
+    if (whisper_wakeup_init(&g_stop) != 0) {
+        fprintf(stderr, "Error: Failed to create wakeup channel\n");
+        ret = WHISPER_EXIT_RELAY_ERROR;
+        goto out;
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (nostr_init() != NOSTR_OK) {
+        fprintf(stderr, "Error: Failed to initialize libnostr\n");
+        ret = WHISPER_EXIT_CRYPTO_ERROR;
+        goto out;
+    }
+
+    /* Resident for the daemon's lifetime: keep it out of swap and core dumps */
+    whisper_lock_memory(d->privkeys, sizeof(d->privkeys));
+    d->identity_count = whisper_load_identities(config->keys, config->key_count, config->nsec,
+                                                config->nsec_file, d->privkeys, d->pubkeys);
+    if (d->identity_count <= 0) {
+        fprintf(stderr, "Error: Failed to load private key\n");
+        d->identity_count = 0;
+        ret = WHISPER_EXIT_KEY_ERROR;
+        goto cleanup;
+    }
+    for (int i = 0; i < d->identity_count && d->identity_count > 1; i++) {
+        nostr_key_to_bech32(&d->pubkeys[i], "npub", d->npubs[i], sizeof(d->npubs[i]));
+    }
+    for (int i = 0; i < config->key_count && i < d->identity_count; i++) {
+        d->keep_names[i] = config->keys[i].keep_name;
+    }
+    d->key_agent = config->key_agent;
+
+    listen_fd = listen_socket(socket_path);
+    if (listen_fd < 0) {
+        ret = WHISPER_EXIT_INVALID_ARGS;
+        goto cleanup;
+    }
+
+    if (whisper_peer_cache_init(&d->peers, 0) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = WHISPER_EXIT_CRYPTO_ERROR;
+        goto cleanup;
+    }
+    whisper_unwrap_start(&d->unwrap, d->privkeys, d->identity_count, config->jobs, false,
+                         rumor_cb, d);
+
+    d->pool.on_message = message_cb;
+    d->pool.on_event = event_cb;
+    d->pool.user_data = d;
+    whisper_prefilter_init(&d->pool.filter, &d->pubkeys[0], 0, config->rate_cap);
+    for (int i = 1; i < d->identity_count; i++) {
+        whisper_prefilter_add(&d->pool.filter, &d->pubkeys[i]);
+    }
+    if (whisper_pool_open(&d->pool, config->relay_urls, config->relay_count) <= 0 ||
+        whisper_pool_wait_connected(&d->pool, 1, config->timeout_ms) == 0) {
+        fprintf(stderr, "Error: Failed to connect to relay\n");
+        ret = WHISPER_EXIT_RELAY_ERROR;
+        goto cleanup;
+    }
+    if (whisper_publisher_start(&d->publisher, &d->pool, config->window, d->quorum,
+                                d->timeout_ms, send_done, d) != 0) {
+        fprintf(stderr, "Error: Failed to start publisher\n");
+        ret = WHISPER_EXIT_RELAY_ERROR;
+        goto cleanup;
+    }
+    whisper_wrap_start(&d->wrap, &d->privkeys[0], config->jobs, send_wrapped, d);
+
+    char filter[WHISPER_DM_FILTER_SIZE];
+    whisper_dm_filter(filter, sizeof(filter), &d->pool.filter, 0, 0, 0);
+
+    if (whisper_pool_subscribe(&d->pool, "dm-inbox", filter) <= 0) {
+        fprintf(stderr, "Error: Failed to subscribe\n");
+        ret = WHISPER_EXIT_RELAY_ERROR;
+        goto cleanup;
+    }
+
+    fprintf(stderr, "whisper daemon listening on %s\n", socket_path);
+
+    int64_t next_stats_ms = whisper_now_ms() + DAEMON_STATS_INTERVAL_MS;
+    while (g_running) {
+        struct pollfd pfds[2] = {
+            { .fd = listen_fd, .events = POLLIN },
+            { .fd = g_stop.fds[0], .events = POLLIN },
+        };
+        int rc = poll(pfds, 2, DAEMON_IDLE_CHECK_MS);
+        if (rc > 0 && (pfds[1].revents & POLLIN)) {
+            whisper_wakeup_wait(&g_stop, 0);
+        }
+        if (rc > 0 && (pfds[0].revents & POLLIN)) {
+            accept_client(d, listen_fd);
+        }
+
+        if (config->stats && whisper_now_ms() >= next_stats_ms) {
+            whisper_stats_print(stderr);
+            next_stats_ms += DAEMON_STATS_INTERVAL_MS;
+        }
+
+        /* Dropped relays are redialed and resume where they left off */
+        int retry_ms = whisper_pool_maintain(&d->pool);
+        whisper_pool_subscribe(&d->pool, "dm-inbox", filter);
+        if (retry_ms < 0) {
+            fprintf(stderr, "Error: Lost connection to all relays\n");
+            ret = WHISPER_EXIT_RELAY_ERROR;
+            break;
+        }
+    }
+
+cleanup:
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    drain_clients(d);
+    whisper_wrap_stop(&d->wrap);
+    whisper_publisher_stop(&d->publisher);
+    whisper_pool_close(&d->pool);
+    whisper_unwrap_stop(&d->unwrap);
+    whisper_peer_cache_destroy(&d->peers);
+    if (config->stats) whisper_stats_print(stderr);
+
+    whisper_unlock_memory(d->privkeys, sizeof(d->privkeys));
+    for (int i = 0; i < DAEMON_HISTORY; i++) {
+        record_free(&d->history[i]);
+    }
+    nostr_cleanup();
+
+out:
+    whisper_wakeup_destroy(&g_stop);
+    pthread_cond_destroy(&d->sends_done);
+    whisper_mutex_destroy(&d->clients_lock);
+    return ret;
+}
+
+#endif /* _WIN32 */
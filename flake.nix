@@ -99,11 +99,41 @@
             $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
               -I${libnostrC}/include \
               -c -o util.o util.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o pool.o pool.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o daemon.o daemon.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o unwrap.o unwrap.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o store.o store.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o archive.o archive.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o peers.o peers.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o text.o text.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o publish.o publish.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o wrap.o wrap.c
+            $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
+              -I${libnostrC}/include \
+              -c -o stats.o stats.c
             $CC -Wall -Wextra -O2 -std=c99 -D_DEFAULT_SOURCE \
               -I${libnostrC}/include -I${pkgs.notcurses}/include \
               -DHAVE_NOTCURSES \
               -c -o tui.o tui.c
-            $CC -o whisper main.o send.o recv.o util.o tui.o \
+            $CC -o whisper main.o send.o recv.o util.o pool.o unwrap.o store.o archive.o peers.o text.o publish.o wrap.o stats.o daemon.o tui.o \
               -L${libnostrC}/lib -lnostr \
               -L${noscryptLib}/lib -lnoscrypt \
               -L${pkgs.notcurses}/lib -lnotcurses-core \
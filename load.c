@@ -0,0 +1,746 @@
+/*
+ * whisper load - Local mock relay and throughput driver
+ *
+ * Runs a minimal Nostr relay on 127.0.0.1 that replays pre-generated
+ * kind-1059 gift wraps to every REQ (a --foreign share of them addressed
+ * to someone else, so they fail to decrypt) and answers each published
+ * EVENT with an OK after --ok-latency ms. Then drives whisper against it
+ * and prints one JSON object per scenario:
+ *   {"scenario":"recv","messages":...,"msgs_per_s":...,"p50_ms":...,"p99_ms":...}
+ *
+ *   recv  `whisper recv --json`: relay write -> line on stdout
+ *   send  `whisper send --batch`: record on stdin -> event id on stdout
+ *   tui   the TUI receive path in-process: relay write -> message filed
+ *
+ * Usage: whisper_load [options] [recv|send|tui ...]   (see usage())
+ */
+
+#ifndef WHISPER_BENCH
+#define WHISPER_BENCH
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <libwebsockets.h>
+#include "whisper.h"
+#include "text.h"
+#include "tui.h"
+
+/* Fixed test keys: the sender publishes, the recipient receives */
+#define SENDER_HEX    "0000000000000000000000000000000000000000000000000000000000000001"
+#define RECIPIENT_HEX "0000000000000000000000000000000000000000000000000000000000000002"
+#define STRANGER_HEX  "0000000000000000000000000000000000000000000000000000000000000003"
+
+#define CONTENT_TAG "load:"
+#define OK_QUEUE 4096
+
+typedef struct {
+    int port;
+    int messages;
+    double foreign;              /* share of replayed wraps not for us */
+    int size;                    /* content bytes per message */
+    int ok_latency_ms;
+    int reject_every;            /* every Nth publish is refused (0 = none) */
+    int window;
+    int jobs;
+    int timeout_ms;
+    const char* whisper;         /* binary under test */
+} load_config;
+
+typedef struct {
+    char id[65];
+    bool accepted;
+    int64_t due_us;
+} pending_ok;
+
+/* One client connection to the mock relay */
+typedef struct {
+    struct lws* wsi;
+    whisper_buf rx;              /* frame being reassembled */
+    whisper_buf tx;              /* LWS_PRE bytes of headroom, then payload */
+    char sub_id[65];
+    bool replaying;
+    bool eose_pending;
+    int replay_next;
+    pending_ok oks[OK_QUEUE];
+    int ok_head;
+    int ok_count;
+    lws_sorted_usec_list_t sul;  /* fires when the oldest OK is due */
+} relay_session;
+
+/* Relay-wide state; the driver reads it under lock */
+static struct {
+    load_config config;
+    struct lws_context* context;
+    pthread_t thread;
+    volatile sig_atomic_t stop;
+    char** events;               /* replayed wraps, serialized */
+    int event_count;
+    int foreign_count;
+    pthread_mutex_t lock;
+    int64_t* sent_ns;            /* when events[i] went out, 0 = not yet */
+    unsigned long published;
+} g_relay;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : (x > y);
+}
+
+static double percentile(double* sorted, int count, double p) {
+    if (count == 0) return 0;
+    int i = (int)(p * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+/* Index encoded in a load-test message, or -1 */
+static int content_index(const char* s) {
+    const char* tag = s ? strstr(s, CONTENT_TAG) : NULL;
+    if (!tag) return -1;
+    return atoi(tag + strlen(CONTENT_TAG));
+}
+
+/* ---- Mock relay ---------------------------------------------------------- */
+
+/* Queue one text frame; the caller asks for a writeable callback */
+static int session_write(relay_session* s, const char* data, size_t len) {
+    s->tx.len = 0;
+    if (whisper_buf_reserve(&s->tx, LWS_PRE + len) != 0) return -1;
+    memcpy(s->tx.data + LWS_PRE, data, len);
+    int n = lws_write(s->wsi, (unsigned char*)s->tx.data + LWS_PRE, len, LWS_WRITE_TEXT);
+    return n < (int)len ? -1 : 0;
+}
+
+static void ok_due_cb(lws_sorted_usec_list_t* sul) {
+    relay_session* s = lws_container_of(sul, relay_session, sul);
+    lws_callback_on_writable(s->wsi);
+}
+
+static void schedule_oks(relay_session* s) {
+    if (s->ok_count == 0) return;
+    int64_t wait = s->oks[s->ok_head].due_us - now_ns() / 1000;
+    lws_sul_schedule(lws_get_context(s->wsi), 0, &s->sul, ok_due_cb,
+                     wait > 0 ? (lws_usec_t)wait : 1);
+}
+
+static void handle_frame(relay_session* s, const char* data, size_t len) {
+    cJSON* msg = cJSON_ParseWithLength(data, len);
+    const cJSON* type = cJSON_IsArray(msg) ? cJSON_GetArrayItem(msg, 0) : NULL;
+    if (!cJSON_IsString(type)) {
+        cJSON_Delete(msg);
+        return;
+    }
+
+    if (strcmp(type->valuestring, "REQ") == 0) {
+        const cJSON* sub = cJSON_GetArrayItem(msg, 1);
+        snprintf(s->sub_id, sizeof(s->sub_id), "%s",
+                 cJSON_IsString(sub) ? sub->valuestring : "");
+        s->replaying = true;
+        s->eose_pending = true;
+        s->replay_next = 0;
+        lws_callback_on_writable(s->wsi);
+    } else if (strcmp(type->valuestring, "CLOSE") == 0) {
+        s->replaying = false;
+        s->eose_pending = false;
+    } else if (strcmp(type->valuestring, "EVENT") == 0) {
+        const cJSON* event = cJSON_GetArrayItem(msg, 1);
+        const cJSON* id = cJSON_GetObjectItemCaseSensitive(event, "id");
+        if (cJSON_IsString(id) && s->ok_count < OK_QUEUE) {
+            pthread_mutex_lock(&g_relay.lock);
+            unsigned long n = ++g_relay.published;
+            pthread_mutex_unlock(&g_relay.lock);
+
+            pending_ok* ok = &s->oks[(s->ok_head + s->ok_count) % OK_QUEUE];
+            snprintf(ok->id, sizeof(ok->id), "%s", id->valuestring);
+            ok->accepted = !(g_relay.config.reject_every > 0 &&
+                             n % (unsigned long)g_relay.config.reject_every == 0);
+            ok->due_us = now_ns() / 1000 + (int64_t)g_relay.config.ok_latency_ms * 1000;
+            if (s->ok_count++ == 0) schedule_oks(s);
+        }
+    }
+    cJSON_Delete(msg);
+}
+
+/* One frame per writeable callback: due OKs first, then replay, then EOSE */
+static int session_writeable(relay_session* s) {
+    char frame[256];
+    int64_t now_us = now_ns() / 1000;
+
+    if (s->ok_count > 0 && s->oks[s->ok_head].due_us <= now_us) {
+        pending_ok* ok = &s->oks[s->ok_head];
+        int n = snprintf(frame, sizeof(frame), "[\"OK\",\"%s\",%s,\"%s\"]", ok->id,
+                         ok->accepted ? "true" : "false",
+                         ok->accepted ? "" : "blocked: load test");
+        s->ok_head = (s->ok_head + 1) % OK_QUEUE;
+        s->ok_count--;
+        if (session_write(s, frame, (size_t)n) != 0) return -1;
+    } else if (s->replaying && s->replay_next < g_relay.event_count) {
+        int i = s->replay_next++;
+        whisper_buf out = {0};
+        whisper_buf_printf(&out, "[\"EVENT\",\"%s\",%s]", s->sub_id, g_relay.events[i]);
+        int rc = out.data ? session_write(s, out.data, out.len) : -1;
+        whisper_buf_free(&out);
+        if (rc != 0) return -1;
+
+        pthread_mutex_lock(&g_relay.lock);
+        g_relay.sent_ns[i] = now_ns();
+        pthread_mutex_unlock(&g_relay.lock);
+    } else if (s->eose_pending) {
+        int n = snprintf(frame, sizeof(frame), "[\"EOSE\",\"%s\"]", s->sub_id);
+        s->eose_pending = false;
+        if (session_write(s, frame, (size_t)n) != 0) return -1;
+    }
+
+    bool more = (s->replaying && s->replay_next < g_relay.event_count) || s->eose_pending ||
+                (s->ok_count > 0 && s->oks[s->ok_head].due_us <= now_ns() / 1000);
+    if (more) {
+        lws_callback_on_writable(s->wsi);
+    } else {
+        schedule_oks(s);
+    }
+    return 0;
+}
+
+static int relay_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user,
+                          void* in, size_t len) {
+    relay_session* s = (relay_session*)user;
+
+    switch (reason) {
+        case LWS_CALLBACK_ESTABLISHED:
+            s->wsi = wsi;
+            break;
+        case LWS_CALLBACK_RECEIVE:
+            if (whisper_buf_append(&s->rx, (const char*)in, len) != 0) return -1;
+            if (lws_is_final_fragment(wsi) && lws_remaining_packet_payload(wsi) == 0) {
+                handle_frame(s, s->rx.data, s->rx.len);
+                s->rx.len = 0;
+            }
+            break;
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            return session_writeable(s);
+        case LWS_CALLBACK_CLOSED:
+            lws_sul_schedule(lws_get_context(wsi), 0, &s->sul, NULL,
+                             LWS_SET_TIMER_USEC_CANCEL);
+            whisper_buf_free(&s->rx);
+            whisper_buf_free(&s->tx);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static const struct lws_protocols relay_protocols[] = {
+    { "nostr", relay_callback, sizeof(relay_session), 65536, 0, NULL, 0 },
+    LWS_PROTOCOL_LIST_TERM
+};
+
+static void* relay_main(void* arg) {
+    (void)arg;
+    while (!g_relay.stop) {
+        if (lws_service(g_relay.context, 0) < 0) break;
+    }
+    return NULL;
+}
+
+static int relay_start(const load_config* config) {
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port = config->port;
+    info.iface = "127.0.0.1";
+    info.protocols = relay_protocols;
+    info.gid = -1;
+    info.uid = -1;
+
+    lws_set_log_level(0, NULL);
+    g_relay.context = lws_create_context(&info);
+    if (!g_relay.context) {
+        fprintf(stderr, "Error: Could not listen on 127.0.0.1:%d\n", config->port);
+        return -1;
+    }
+    if (pthread_create(&g_relay.thread, NULL, relay_main, NULL) != 0) {
+        lws_context_destroy(g_relay.context);
+        return -1;
+    }
+    return 0;
+}
+
+static void relay_stop(void) {
+    g_relay.stop = 1;
+    lws_cancel_service(g_relay.context);
+    pthread_join(g_relay.thread, NULL);
+    lws_context_destroy(g_relay.context);
+}
+
+static void relay_reset(void) {
+    pthread_mutex_lock(&g_relay.lock);
+    memset(g_relay.sent_ns, 0, (size_t)g_relay.event_count * sizeof(*g_relay.sent_ns));
+    g_relay.published = 0;
+    pthread_mutex_unlock(&g_relay.lock);
+}
+
+static int64_t relay_sent_ns(int i) {
+    if (i < 0 || i >= g_relay.event_count) return 0;
+    pthread_mutex_lock(&g_relay.lock);
+    int64_t t = g_relay.sent_ns[i];
+    pthread_mutex_unlock(&g_relay.lock);
+    return t;
+}
+
+/* "load:<i>:" padded with filler to `size` bytes */
+static void make_content(char* buf, int size, int i) {
+    int n = snprintf(buf, (size_t)size + 1, CONTENT_TAG "%d:", i);
+    if (n < size) memset(buf + n, 'x', (size_t)(size - n));
+    buf[size] = '\0';
+}
+
+static int generate_events(const load_config* config) {
+    nostr_privkey sender;
+    nostr_keypair recipient, stranger;
+    if (nostr_privkey_from_hex(SENDER_HEX, &sender) != NOSTR_OK) return -1;
+    nostr_privkey recipient_priv, stranger_priv;
+    if (nostr_privkey_from_hex(RECIPIENT_HEX, &recipient_priv) != NOSTR_OK ||
+        nostr_privkey_from_hex(STRANGER_HEX, &stranger_priv) != NOSTR_OK ||
+        nostr_keypair_from_private_key(&recipient, &recipient_priv) != NOSTR_OK ||
+        nostr_keypair_from_private_key(&stranger, &stranger_priv) != NOSTR_OK) {
+        return -1;
+    }
+
+    g_relay.events = calloc((size_t)config->messages, sizeof(char*));
+    g_relay.sent_ns = calloc((size_t)config->messages, sizeof(int64_t));
+    char* content = malloc((size_t)config->size + 1);
+    if (!g_relay.events || !g_relay.sent_ns || !content) {
+        free(content);
+        return -1;
+    }
+
+    /* Spread foreign wraps evenly through the replay */
+    double owed = 0;
+    for (int i = 0; i < config->messages; i++) {
+        owed += config->foreign;
+        bool foreign = owed >= 1.0;
+        if (foreign) {
+            owed -= 1.0;
+            g_relay.foreign_count++;
+        }
+
+        make_content(content, config->size, i);
+        nostr_event* wrap = NULL;
+        const nostr_key* to = foreign ? &stranger.pubkey : &recipient.pubkey;
+        if (nostr_nip17_send_dm(&wrap, content, &sender, to, NULL, NULL, 0) != NOSTR_OK ||
+            !wrap || nostr_event_to_json(wrap, &g_relay.events[i]) != NOSTR_OK) {
+            if (wrap) nostr_event_destroy(wrap);
+            free(content);
+            return -1;
+        }
+        nostr_event_destroy(wrap);
+        g_relay.event_count++;
+    }
+    free(content);
+    nostr_keypair_destroy(&recipient);
+    nostr_keypair_destroy(&stranger);
+    return 0;
+}
+
+/* ---- Driver -------------------------------------------------------------- */
+
+typedef struct {
+    const char* scenario;
+    double* latency_ms;
+    int count;
+    int errors;
+    int64_t first_ns;
+    int64_t last_ns;
+} load_result;
+
+static void result_add(load_result* r, int64_t start_ns, int64_t end_ns) {
+    if (start_ns <= 0) return;
+    r->latency_ms[r->count++] = (double)(end_ns - start_ns) / 1e6;
+    if (r->first_ns == 0 || start_ns < r->first_ns) r->first_ns = start_ns;
+    if (end_ns > r->last_ns) r->last_ns = end_ns;
+}
+
+static void result_print(load_result* r, int expected) {
+    qsort(r->latency_ms, (size_t)r->count, sizeof(double), compare_double);
+    double secs = r->last_ns > r->first_ns ? (double)(r->last_ns - r->first_ns) / 1e9 : 0;
+    const load_config* c = &g_relay.config;
+    printf("{\"scenario\":\"%s\",\"messages\":%d,\"expected\":%d,\"errors\":%d,"
+           "\"jobs\":%d,\"window\":%d,\"ok_latency_ms\":%d,\"size\":%d,"
+           "\"secs\":%.3f,\"msgs_per_s\":%.1f,\"p50_ms\":%.2f,\"p99_ms\":%.2f}\n",
+           r->scenario, r->count, expected, r->errors, c->jobs, c->window,
+           c->ok_latency_ms, c->size, secs, secs > 0 ? r->count / secs : 0,
+           percentile(r->latency_ms, r->count, 0.50),
+           percentile(r->latency_ms, r->count, 0.99));
+    fflush(stdout);
+}
+
+/* Start the whisper binary with stdin/stdout on pipes, key in NOSTR_NSEC */
+static pid_t spawn(char* const argv[], const char* nsec, int* to_child, int* from_child) {
+    int in[2], out[2];
+    if (pipe(in) != 0) return -1;
+    if (pipe(out) != 0) {
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        setenv("NOSTR_NSEC", nsec, 1);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    if (pid < 0) {
+        close(in[1]);
+        close(out[0]);
+        return -1;
+    }
+    *to_child = in[1];
+    *from_child = out[0];
+    return pid;
+}
+
+static void relay_url(char* buf, size_t size) {
+    snprintf(buf, size, "ws://127.0.0.1:%d", g_relay.config.port);
+}
+
+static void format_int(char* buf, size_t size, int value) {
+    snprintf(buf, size, "%d", value);
+}
+
+static int run_recv(load_result* r, int expected) {
+    const load_config* c = &g_relay.config;
+    char url[64], jobs[16], timeout[16];
+    relay_url(url, sizeof(url));
+    format_int(jobs, sizeof(jobs), c->jobs);
+    format_int(timeout, sizeof(timeout), c->timeout_ms);
+    /* --jobs is left off (argv ends early) when unset */
+    char* argv[] = { (char*)c->whisper, "recv", "--relay", url, "--json", "--timeout", timeout,
+                     c->jobs > 0 ? "--jobs" : NULL, jobs, NULL };
+
+    int to_child, from_child;
+    pid_t pid = spawn(argv, RECIPIENT_HEX, &to_child, &from_child);
+    if (pid < 0) return -1;
+    close(to_child);
+
+    FILE* out = fdopen(from_child, "r");
+    char* line = NULL;
+    size_t cap = 0;
+    int64_t deadline = now_ns() + (int64_t)c->timeout_ms * 1000000 * 4;
+    while (out && r->count + r->errors < expected && now_ns() < deadline) {
+        struct pollfd pfd = { .fd = from_child, .events = POLLIN };
+        int wait = (int)((deadline - now_ns()) / 1000000);
+        if (poll(&pfd, 1, wait > 0 ? wait : 0) <= 0) break;
+        if (getline(&line, &cap, out) < 0) break;
+
+        int64_t at = now_ns();
+        int i = content_index(line);
+        if (i < 0) {
+            r->errors++;
+            continue;
+        }
+        result_add(r, relay_sent_ns(i), at);
+    }
+    free(line);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    if (out) fclose(out);
+    return 0;
+}
+
+typedef struct {
+    int fd;
+    int count;
+    int size;
+    int64_t* written_ns;
+} send_feed;
+
+/* Writer thread: feed records as fast as whisper takes them */
+static void* feed_main(void* arg) {
+    send_feed* f = (send_feed*)arg;
+    char* content = malloc((size_t)f->size + 1);
+    whisper_buf line = {0};
+
+    for (int i = 0; content && i < f->count; i++) {
+        make_content(content, f->size, i);
+        line.len = 0;
+        whisper_buf_printf(&line, "{\"content\":\"%s\"}\n", content);
+        f->written_ns[i] = now_ns();
+        const char* p = line.data;
+        size_t left = line.len;
+        while (left > 0) {
+            ssize_t n = write(f->fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) goto out;
+            p += n;
+            left -= (size_t)n;
+        }
+    }
+out:
+    close(f->fd);
+    whisper_buf_free(&line);
+    free(content);
+    return NULL;
+}
+
+static int run_send(load_result* r, int count) {
+    const load_config* c = &g_relay.config;
+    char url[64], recipient[65], jobs[16], window[16], timeout[16];
+    relay_url(url, sizeof(url));
+    format_int(jobs, sizeof(jobs), c->jobs);
+    format_int(window, sizeof(window), c->window);
+    format_int(timeout, sizeof(timeout), c->timeout_ms);
+
+    nostr_privkey priv;
+    nostr_keypair kp;
+    if (nostr_privkey_from_hex(RECIPIENT_HEX, &priv) != NOSTR_OK ||
+        nostr_keypair_from_private_key(&kp, &priv) != NOSTR_OK) {
+        return -1;
+    }
+    nostr_key_to_hex(&kp.pubkey, recipient, sizeof(recipient));
+    nostr_keypair_destroy(&kp);
+
+    char* argv[14];
+    int n = 0;
+    argv[n++] = (char*)c->whisper;
+    argv[n++] = "send";
+    argv[n++] = "--batch";
+    argv[n++] = "--to";
+    argv[n++] = recipient;
+    argv[n++] = "--relay";
+    argv[n++] = url;
+    argv[n++] = "--timeout";
+    argv[n++] = timeout;
+    if (c->window > 0) {
+        argv[n++] = "--window";
+        argv[n++] = window;
+    }
+    if (c->jobs > 0) {
+        argv[n++] = "--jobs";
+        argv[n++] = jobs;
+    }
+    argv[n] = NULL;
+
+    int to_child, from_child;
+    pid_t pid = spawn(argv, SENDER_HEX, &to_child, &from_child);
+    if (pid < 0) return -1;
+
+    send_feed feed = { .fd = to_child, .count = count, .size = c->size };
+    feed.written_ns = calloc((size_t)count, sizeof(int64_t));
+    pthread_t writer;
+    if (!feed.written_ns || pthread_create(&writer, NULL, feed_main, &feed) != 0) {
+        close(to_child);
+        close(from_child);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        free(feed.written_ns);
+        return -1;
+    }
+
+    FILE* out = fdopen(from_child, "r");
+    char* line = NULL;
+    size_t cap = 0;
+    for (int i = 0; out && i < count && getline(&line, &cap, out) >= 0; i++) {
+        int64_t at = now_ns();
+        if (strncmp(line, "error:", 6) == 0) {
+            r->errors++;
+            continue;
+        }
+        result_add(r, feed.written_ns[i], at);
+    }
+    free(line);
+
+    pthread_join(writer, NULL);
+    waitpid(pid, NULL, 0);
+    if (out) fclose(out);
+    free(feed.written_ns);
+    return 0;
+}
+
+#ifdef HAVE_NOTCURSES
+static void tui_ingested(const char* content, void* user_data) {
+    load_result* r = (load_result*)user_data;
+    int64_t at = now_ns();
+    int i = content_index(content);
+    if (i < 0) {
+        r->errors++;
+        return;
+    }
+    result_add(r, relay_sent_ns(i), at);
+}
+
+static int run_tui(load_result* r, int expected) {
+    const load_config* c = &g_relay.config;
+    char url[64];
+    relay_url(url, sizeof(url));
+    int filed = whisper_tui_bench_ingest(url, RECIPIENT_HEX, c->jobs, expected,
+                                         c->timeout_ms * 4, tui_ingested, r);
+    return filed < 0 ? -1 : 0;
+}
+#else
+static int run_tui(load_result* r, int expected) {
+    (void)r;
+    (void)expected;
+    fprintf(stderr, "Error: Built without notcurses, no TUI scenario\n");
+    return -1;
+}
+#endif
+
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: whisper_load [options] [recv|send|tui ...]\n"
+            "  --messages <n>      Gift wraps replayed / records sent (default: 2000)\n"
+            "  --foreign <ratio>   Share of replayed wraps not for us (default: 0.2)\n"
+            "  --size <bytes>      Content per message (default: 64)\n"
+            "  --ok-latency <ms>   Delay before each OK (default: 20)\n"
+            "  --reject-every <n>  Refuse every nth publish (default: never)\n"
+            "  --window <n>        Passed to send --batch\n"
+            "  --jobs <n>          Passed to recv/send; TUI unwrap workers\n"
+            "  --port <n>          Mock relay port (default: 7447)\n"
+            "  --whisper <path>    Binary under test (default: ./whisper)\n"
+            "  --timeout <ms>      Relay timeout passed through (default: 5000)\n");
+}
+
+static struct option load_options[] = {
+    {"messages",     required_argument, 0, 'n'},
+    {"foreign",      required_argument, 0, 'f'},
+    {"size",         required_argument, 0, 's'},
+    {"ok-latency",   required_argument, 0, 'l'},
+    {"reject-every", required_argument, 0, 'r'},
+    {"window",       required_argument, 0, 'W'},
+    {"jobs",         required_argument, 0, 'J'},
+    {"port",         required_argument, 0, 'p'},
+    {"whisper",      required_argument, 0, 'w'},
+    {"timeout",      required_argument, 0, 'T'},
+    {"help",         no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+int main(int argc, char** argv) {
+    load_config* c = &g_relay.config;
+    c->port = 7447;
+    c->messages = 2000;
+    c->foreign = 0.2;
+    c->size = 64;
+    c->ok_latency_ms = 20;
+    c->timeout_ms = 5000;
+    c->whisper = "./whisper";
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:f:s:l:r:W:J:p:w:T:h", load_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': c->messages = atoi(optarg); break;
+            case 'f': c->foreign = atof(optarg); break;
+            case 's': c->size = atoi(optarg); break;
+            case 'l': c->ok_latency_ms = atoi(optarg); break;
+            case 'r': c->reject_every = atoi(optarg); break;
+            case 'W': c->window = atoi(optarg); break;
+            case 'J': c->jobs = atoi(optarg); break;
+            case 'p': c->port = atoi(optarg); break;
+            case 'w': c->whisper = optarg; break;
+            case 'T': c->timeout_ms = atoi(optarg); break;
+            default:
+                usage();
+                return opt == 'h' ? WHISPER_EXIT_OK : WHISPER_EXIT_INVALID_ARGS;
+        }
+    }
+    if (c->messages < 1 || c->size < 16 || c->size >= 64 * 1024 ||
+        c->foreign < 0 || c->foreign >= 1 || c->ok_latency_ms < 0 || c->timeout_ms < 1) {
+        fprintf(stderr, "Error: Invalid arguments\n");
+        usage();
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&g_relay.lock, NULL);
+    if (nostr_init() != NOSTR_OK) {
+        fprintf(stderr, "Error: Failed to initialize libnostr\n");
+        return WHISPER_EXIT_CRYPTO_ERROR;
+    }
+
+    int ret = WHISPER_EXIT_OK;
+    int64_t t0 = now_ns();
+    if (generate_events(c) != 0) {
+        fprintf(stderr, "Error: Failed to generate gift wraps\n");
+        ret = WHISPER_EXIT_CRYPTO_ERROR;
+        goto out;
+    }
+    int expected = g_relay.event_count - g_relay.foreign_count;
+    fprintf(stderr, "Generated %d gift wraps (%d for us) in %.1f s\n", g_relay.event_count,
+            expected, (double)(now_ns() - t0) / 1e9);
+
+    if (relay_start(c) != 0) {
+        ret = WHISPER_EXIT_RELAY_ERROR;
+        goto out;
+    }
+
+    bool all = optind == argc;
+    const char* scenarios[] = { "recv", "send", "tui" };
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        bool selected = all;
+        for (int i = optind; i < argc; i++) {
+            if (strcmp(argv[i], scenarios[s]) == 0) selected = true;
+        }
+        if (!selected) continue;
+
+        load_result r = { .scenario = scenarios[s] };
+        r.latency_ms = calloc((size_t)c->messages, sizeof(double));
+        if (!r.latency_ms) {
+            ret = WHISPER_EXIT_CRYPTO_ERROR;
+            break;
+        }
+        relay_reset();
+
+        int rc;
+        int want = expected;
+        if (strcmp(scenarios[s], "recv") == 0) {
+            rc = run_recv(&r, expected);
+        } else if (strcmp(scenarios[s], "send") == 0) {
+            want = c->messages;
+            rc = run_send(&r, c->messages);
+        } else {
+            rc = run_tui(&r, expected);
+        }
+        if (rc != 0) {
+            printf("{\"scenario\":\"%s\",\"error\":\"failed to run\"}\n", scenarios[s]);
+            ret = WHISPER_EXIT_RELAY_ERROR;
+        } else {
+            result_print(&r, want);
+        }
+        free(r.latency_ms);
+    }
+    relay_stop();
+
+out:
+    for (int i = 0; i < g_relay.event_count; i++) {
+        free(g_relay.events[i]);
+    }
+    free(g_relay.events);
+    free(g_relay.sent_ns);
+    nostr_cleanup();
+    return ret;
+}
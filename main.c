@@ -22,30 +22,83 @@ static void print_usage(void) {
     fprintf(stderr, "Usage:\n");
     fprintf(stderr, "  whisper send --to <npub> --relay <url> [key options]\n");
     fprintf(stderr, "  whisper recv --relay <url> [key options]\n");
-    fprintf(stderr, "  whisper tui --relay <url> [--to <npub>] [key options]\n\n");
+    fprintf(stderr, "  whisper tui --relay <url> [--to <npub>] [key options]\n");
+    fprintf(stderr, "  whisper daemon --relay <url> [--socket <path>] [key options]\n");
+    fprintf(stderr, "  whisper stats [--socket <path>] [--json]\n");
+    fprintf(stderr, "  whisper log --archive <dir> [--from <npub>] [--since <t>] [--until <t>]\n\n");
     fprintf(stderr, "Key options (in order of priority):\n");
     fprintf(stderr, "  --keep-key <name>     Use key from keep vault (recommended)\n");
     fprintf(stderr, "  --nsec-file <path>    Read key from file\n");
     fprintf(stderr, "  --nsec <nsec|hex>     Key as argument (WARNING: visible in ps/history)\n");
     fprintf(stderr, "  NOSTR_NSEC env var    Fallback if no key option\n");
+    fprintf(stderr, "  recv and daemon take several key options (any mix, up to %d) and\n",
+            WHISPER_MAX_IDENTITIES);
+    fprintf(stderr, "  receive for all of them over one subscription\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Security: Prefer --keep-key or --nsec-file over --nsec to avoid\n");
     fprintf(stderr, "          exposing your private key in shell history or process lists.\n\n");
     fprintf(stderr, "Send options:\n");
     fprintf(stderr, "  --to <npub|hex>       Recipient public key\n");
-    fprintf(stderr, "  --relay <url>         Relay URL\n");
+    fprintf(stderr, "  --relay <url>         Relay URL (repeat to publish to several)\n");
+    fprintf(stderr, "  --relay-file <path>   Read relay URLs from file, one per line\n");
+    fprintf(stderr, "  --quorum <n>          Relay OKs to wait for (default: 1 = first OK wins)\n");
     fprintf(stderr, "  --subject <text>      Optional subject\n");
     fprintf(stderr, "  --reply-to <id>       Reply to event ID\n");
+    fprintf(stderr, "  --split               Send input over 64 KB as numbered parts that recv and tui join\n");
+    fprintf(stderr, "  --prewarm             Dial relays while the key loads and the DM is wrapped\n");
+    fprintf(stderr, "                        (--timeout then counts from startup)\n");
+    fprintf(stderr, "  --batch               Read NDJSON {\"to\",\"content\",\"subject\"} lines from stdin\n");
+    fprintf(stderr, "  --window <n>          --batch: events awaiting OK at once (default: %d)\n",
+            WHISPER_DEFAULT_WINDOW);
+    fprintf(stderr, "  --jobs <n>            --batch: wrapping threads (default: one per CPU)\n");
+    fprintf(stderr, "  --daemon              Hand off to the running whisper daemon\n");
+    fprintf(stderr, "  --socket <path>       Daemon socket (implies --daemon)\n");
+    fprintf(stderr, "  --stats               Print timings and counters as JSON on stderr at exit\n");
     fprintf(stderr, "  --timeout <ms>        Timeout (default: 5000)\n\n");
     fprintf(stderr, "Recv options:\n");
-    fprintf(stderr, "  --relay <url>         Relay URL\n");
+    fprintf(stderr, "  --relay <url>         Relay URL (repeat to merge several)\n");
+    fprintf(stderr, "  --relay-file <path>   Read relay URLs from file, one per line\n");
     fprintf(stderr, "  --since <timestamp>   Only messages after timestamp\n");
     fprintf(stderr, "  --limit <n>           Max messages (0 = stream)\n");
     fprintf(stderr, "  --json                Output raw JSON\n");
+    fprintf(stderr, "  --flush <mode>        line (default), batch or none\n");
+    fprintf(stderr, "  --jobs <n>            Decryption threads (default: one per CPU)\n");
+    fprintf(stderr, "  --rate-cap <n>        Decrypt at most n gift wraps per relay per second\n");
+    fprintf(stderr, "  --ordered             Print stored messages sorted by created_at\n");
+    fprintf(stderr, "  --store               Keep an inbox on disk; later runs fetch only new DMs\n");
+    fprintf(stderr, "                        (single key only)\n");
+    fprintf(stderr, "  --store-dir <dir>     Inbox location, also paged by tui (default: ~/.local/share/whisper)\n");
+    fprintf(stderr, "  --archive <dir>       Append every message to an indexed log for whisper log\n");
+    fprintf(stderr, "  --daemon              Attach to the running whisper daemon\n");
+    fprintf(stderr, "  --socket <path>       Daemon socket (implies --daemon)\n");
+    fprintf(stderr, "  --stats               Print timings and counters as JSON on stderr at exit\n");
     fprintf(stderr, "  --timeout <ms>        Timeout (default: 5000)\n\n");
+    fprintf(stderr, "Daemon options:\n");
+    fprintf(stderr, "  --relay <url>         Relay URL (repeatable, or --relay-file)\n");
+    fprintf(stderr, "  --quorum <n>          Relay OKs to wait for per send (default: 1)\n");
+    fprintf(stderr, "  --window <n>          Sends awaiting OK at once (default: %d)\n",
+            WHISPER_DEFAULT_WINDOW);
+    fprintf(stderr, "  --jobs <n>            Wrapping and decryption threads (default: one per CPU)\n");
+    fprintf(stderr, "  --rate-cap <n>        Decrypt at most n gift wraps per relay per second\n");
+    fprintf(stderr, "  --socket <path>       Listen socket (default: $XDG_RUNTIME_DIR/whisper/daemon.sock)\n");
+    fprintf(stderr, "  --stats               Print the stats summary on stderr every minute\n");
+    fprintf(stderr, "  --key-agent           Serve keep keys to --keep-key clients over the socket\n\n");
+    fprintf(stderr, "Stats options:\n");
+    fprintf(stderr, "  --socket <path>       Daemon socket to query\n");
+    fprintf(stderr, "  --json                JSON summary instead of Prometheus text\n\n");
+    fprintf(stderr, "Log options:\n");
+    fprintf(stderr, "  --archive <dir>       Archive written by recv --archive\n");
+    fprintf(stderr, "  --from <npub|hex>     Only messages from this sender\n");
+    fprintf(stderr, "  --to <npub|hex>       Only messages to this key\n");
+    fprintf(stderr, "  --since <timestamp>   Only messages created at or after timestamp\n");
+    fprintf(stderr, "  --until <timestamp>   Only messages created at or before timestamp\n");
+    fprintf(stderr, "  --limit <n>           Newest n matches (default: all)\n");
+    fprintf(stderr, "  --json                NDJSON, as recv --json plus a \"to\" field\n\n");
     fprintf(stderr, "TUI options:\n");
-    fprintf(stderr, "  --relay <url>         Relay URL\n");
+    fprintf(stderr, "  --relay <url>         Relay URL (repeatable, or --relay-file)\n");
     fprintf(stderr, "  --to <npub|hex>       Initial recipient (can change with /to)\n");
+    fprintf(stderr, "  --jobs <n>            Decryption threads (default: one per CPU)\n");
+    fprintf(stderr, "  --rate-cap <n>        Decrypt at most n gift wraps per relay per second\n");
     fprintf(stderr, "  Commands: /to <npub>, /clear, /quit, /help\n");
     fprintf(stderr, "  Keys: Enter=send, Ctrl+Q=quit, PgUp/PgDn=scroll\n\n");
     fprintf(stderr, "Examples:\n");
@@ -53,9 +106,14 @@ static void print_usage(void) {
     fprintf(stderr, "  echo \"hello\" | whisper send --to npub1... --keep-key main --relay wss://relay.damus.io\n\n");
     fprintf(stderr, "  # Using key file\n");
     fprintf(stderr, "  echo \"hello\" | whisper send --to npub1... --nsec-file ~/.nostr/key --relay wss://relay.damus.io\n\n");
+    fprintf(stderr, "  # Many DMs over one connection\n");
+    fprintf(stderr, "  notify-gen | whisper send --batch --keep-key main --relay wss://relay.damus.io\n\n");
     fprintf(stderr, "  # Using environment variable\n");
     fprintf(stderr, "  export NOSTR_NSEC=nsec1...\n");
     fprintf(stderr, "  whisper recv --relay wss://relay.damus.io\n\n");
+    fprintf(stderr, "  # Resident daemon; send/recv become thin clients\n");
+    fprintf(stderr, "  whisper daemon --keep-key main --relay wss://relay.damus.io &\n");
+    fprintf(stderr, "  echo \"hello\" | whisper send --daemon --to npub1...\n\n");
     fprintf(stderr, "  # Interactive TUI mode\n");
     fprintf(stderr, "  whisper tui --relay wss://relay.damus.io --to npub1... --keep-key main\n");
 }
@@ -66,12 +124,31 @@ static struct option long_options[] = {
     {"nsec-file", required_argument, 0, 'f'},
     {"keep-key",  required_argument, 0, 'k'},
     {"relay",     required_argument, 0, 'r'},
+    {"relay-file", required_argument, 0, 'R'},
+    {"quorum",    required_argument, 0, 'Q'},
     {"subject",   required_argument, 0, 's'},
     {"reply-to",  required_argument, 0, 'p'},
     {"since",     required_argument, 0, 'S'},
     {"limit",     required_argument, 0, 'l'},
     {"json",      no_argument,       0, 'j'},
     {"timeout",   required_argument, 0, 'T'},
+    {"batch",     no_argument,       0, 'b'},
+    {"window",    required_argument, 0, 'W'},
+    {"daemon",    no_argument,       0, 'D'},
+    {"socket",    required_argument, 0, 'u'},
+    {"jobs",      required_argument, 0, 'J'},
+    {"ordered",   no_argument,       0, 'O'},
+    {"flush",     required_argument, 0, 'F'},
+    {"store",     no_argument,       0, 'i'},
+    {"store-dir", required_argument, 0, 'd'},
+    {"stats",     no_argument,       0, 'x'},
+    {"rate-cap",  required_argument, 0, 'C'},
+    {"key-agent", no_argument,       0, 'K'},
+    {"split",     no_argument,       0, 'M'},
+    {"archive",   required_argument, 0, 'A'},
+    {"from",      required_argument, 0, 'm'},
+    {"until",     required_argument, 0, 'U'},
+    {"prewarm",   no_argument,       0, 'P'},
     {"help",      no_argument,       0, 'h'},
     {0, 0, 0, 0}
 };
@@ -168,27 +245,107 @@ int main(int argc, char* argv[]) {
     const char* nsec_file = NULL;
     const char* keep_key = NULL;
     char* keep_nsec = NULL;
-    const char* relay_url = NULL;
+    bool repeated_key = false;
+
+    /* Every key option in order: recv and daemon listen for each of them */
+    whisper_key_source keys[WHISPER_MAX_IDENTITIES];
+    char* keep_secrets[WHISPER_MAX_IDENTITIES] = {0};
+    int key_count = 0;
+
+    /* Keys a daemon's key agent handed over, already derived */
+    nostr_privkey agent_privkeys[WHISPER_MAX_IDENTITIES];
+    nostr_key agent_pubkeys[WHISPER_MAX_IDENTITIES];
+    bool key_agent = false;
+    char agent_socket[108];
+    whisper_lock_memory(agent_privkeys, sizeof(agent_privkeys));
+    const char* relay_urls[WHISPER_MAX_RELAYS];
+    char* relay_file_urls[WHISPER_MAX_RELAYS];
+    int relay_count = 0;
+    int relay_file_count = 0;
+    const char* relay_file = NULL;
     int timeout_ms = WHISPER_DEFAULT_TIMEOUT_MS;
 
     /* Send-specific options */
     const char* recipient = NULL;
     const char* subject = NULL;
     const char* reply_to = NULL;
+    bool batch = false;
+    bool split = false;
+    bool prewarm = false;
+    int quorum = 1;
+
+    /* Daemon options */
+    bool use_daemon = false;
+    const char* socket_path = NULL;
+    char default_socket[108];
 
     /* Recv-specific options */
     int64_t since = 0;
     int limit = 0;
     bool json_output = false;
+    bool ordered = false;
+    int flush_mode = WHISPER_FLUSH_LINE;
+    bool use_store = false;
+    const char* store_dir = NULL;
+    char default_store[512];
+    const char* archive_dir = NULL;
+
+    /* Log-specific options */
+    const char* sender = NULL;
+    int64_t until = 0;
+
+    /* Unwrap workers for recv/daemon/tui (0 = one per CPU) */
+    int jobs = 0;
+    int window = 0;
+    bool stats = false;
+    int rate_cap = 0;
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "t:n:f:k:r:s:p:S:l:jT:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "t:n:f:k:r:R:Q:s:p:S:l:jT:bW:Du:J:Oid:F:xC:KMA:m:U:Ph", long_options, NULL)) != -1) {
         switch (opt) {
             case 't': recipient = optarg; break;
-            case 'n': nsec = optarg; break;
-            case 'f': nsec_file = optarg; break;
-            case 'k': keep_key = optarg; break;
-            case 'r': relay_url = optarg; break;
+            case 'n':
+            case 'f':
+            case 'k':
+                if (key_count >= WHISPER_MAX_IDENTITIES) {
+                    fprintf(stderr, "Error: Too many keys (max %d)\n", WHISPER_MAX_IDENTITIES);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                memset(&keys[key_count], 0, sizeof(keys[key_count]));
+                keys[key_count].nsec = opt == 'n' ? optarg : NULL;
+                keys[key_count].nsec_file = opt == 'f' ? optarg : NULL;
+                keys[key_count].keep_name = opt == 'k' ? optarg : NULL;
+                key_count++;
+                if (opt == 'n') {
+                    if (nsec) repeated_key = true;
+                    nsec = optarg;
+                } else if (opt == 'f') {
+                    if (nsec_file) repeated_key = true;
+                    nsec_file = optarg;
+                } else {
+                    if (keep_key) repeated_key = true;
+                    keep_key = optarg;
+                }
+                break;
+            case 'r':
+                if (relay_count >= WHISPER_MAX_RELAYS) {
+                    fprintf(stderr, "Error: Too many relays (max %d)\n", WHISPER_MAX_RELAYS);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                relay_urls[relay_count++] = optarg;
+                break;
+            case 'R': relay_file = optarg; break;
+            case 'Q': {
+                char* endptr;
+                errno = 0;
+                long val = strtol(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || val < 1 || val > WHISPER_MAX_RELAYS) {
+                    fprintf(stderr, "Error: Invalid --quorum value: %s\n", optarg);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                quorum = (int)val;
+                break;
+            }
             case 's': subject = optarg; break;
             case 'p': reply_to = optarg; break;
             case 'S': {
@@ -213,6 +370,76 @@ int main(int argc, char* argv[]) {
                 break;
             }
             case 'j': json_output = true; break;
+            case 'O': ordered = true; break;
+            case 'F':
+                if (strcmp(optarg, "line") == 0) {
+                    flush_mode = WHISPER_FLUSH_LINE;
+                } else if (strcmp(optarg, "batch") == 0) {
+                    flush_mode = WHISPER_FLUSH_BATCH;
+                } else if (strcmp(optarg, "none") == 0) {
+                    flush_mode = WHISPER_FLUSH_NONE;
+                } else {
+                    fprintf(stderr, "Error: Invalid --flush value: %s (line, batch or none)\n",
+                            optarg);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                break;
+            case 'i': use_store = true; break;
+            case 'x': stats = true; break;
+            case 'C': {
+                char* endptr;
+                errno = 0;
+                long val = strtol(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || val < 1 || val > INT_MAX) {
+                    fprintf(stderr, "Error: Invalid --rate-cap value: %s\n", optarg);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                rate_cap = (int)val;
+                break;
+            }
+            case 'd': store_dir = optarg; use_store = true; break;
+            case 'K': key_agent = true; break;
+            case 'M': split = true; break;
+            case 'P': prewarm = true; break;
+            case 'A': archive_dir = optarg; break;
+            case 'm': sender = optarg; break;
+            case 'U': {
+                char* endptr;
+                errno = 0;
+                until = strtoll(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || until < 0) {
+                    fprintf(stderr, "Error: Invalid --until value: %s\n", optarg);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                break;
+            }
+            case 'J': {
+                char* endptr;
+                errno = 0;
+                long val = strtol(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || val < 1 || val > WHISPER_MAX_JOBS) {
+                    fprintf(stderr, "Error: Invalid --jobs value: %s (1-%d)\n",
+                            optarg, WHISPER_MAX_JOBS);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                jobs = (int)val;
+                break;
+            }
+            case 'b': batch = true; break;
+            case 'W': {
+                char* endptr;
+                errno = 0;
+                long val = strtol(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || val < 1 || val > WHISPER_MAX_WINDOW) {
+                    fprintf(stderr, "Error: Invalid --window value: %s (1-%d)\n",
+                            optarg, WHISPER_MAX_WINDOW);
+                    return WHISPER_EXIT_INVALID_ARGS;
+                }
+                window = (int)val;
+                break;
+            }
+            case 'D': use_daemon = true; break;
+            case 'u': socket_path = optarg; use_daemon = true; break;
             case 'T': {
                 char* endptr;
                 errno = 0;
@@ -233,58 +460,224 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    int ret;
+
+    /* Merge relays from --relay-file after any given with --relay */
+    if (relay_file) {
+        relay_file_count = whisper_read_relay_file(relay_file, relay_file_urls,
+                                                   WHISPER_MAX_RELAYS - relay_count);
+        if (relay_file_count < 0) return WHISPER_EXIT_INVALID_ARGS;
+        for (int i = 0; i < relay_file_count; i++) {
+            relay_urls[relay_count++] = relay_file_urls[i];
+        }
+    }
+    const char* relay_url = relay_count > 0 ? relay_urls[0] : NULL;
+
+    bool is_daemon = strcmp(command, "daemon") == 0;
+    bool is_stats = strcmp(command, "stats") == 0;
+    bool is_log = strcmp(command, "log") == 0;
+    if (!socket_path && (use_daemon || is_daemon || is_stats)) {
+        socket_path = getenv("WHISPER_SOCKET");
+        if (!socket_path || !socket_path[0]) {
+            socket_path = whisper_daemon_default_socket(default_socket, sizeof(default_socket));
+        }
+    }
+
+    /* Thin clients leave the key to the daemon */
+    bool needs_key = !is_stats && !is_log && !(use_daemon && (strcmp(command, "send") == 0 ||
+                                                   strcmp(command, "recv") == 0));
+
+    /* recv and daemon take one identity per key option; the rest keep the
+     * single key picked by priority. The daemon always gets the list so its
+     * key agent knows the keep names. */
+    bool multi_key = (key_count > 1 && strcmp(command, "recv") == 0) ||
+                     (key_count > 0 && is_daemon);
+    if (repeated_key && needs_key && !multi_key) {
+        fprintf(stderr, "Error: Only recv and daemon take several keys\n");
+        ret = WHISPER_EXIT_INVALID_ARGS;
+        goto cleanup;
+    }
+    /* send --prewarm: the handshakes overlap keep export below */
+    if (prewarm && strcmp(command, "send") == 0 && !use_daemon && relay_count > 0) {
+        whisper_send_prewarm(relay_urls, relay_count);
+    }
+
+    /* A daemon started with --key-agent already holds keep keys unlocked */
+    const char* agent_path = NULL;
+    if (needs_key && !is_daemon && keep_key) {
+        agent_path = socket_path ? socket_path : getenv("WHISPER_SOCKET");
+        if (!agent_path || !agent_path[0]) {
+            agent_path = whisper_daemon_default_socket(agent_socket, sizeof(agent_socket));
+        }
+    }
+
+    if (multi_key && needs_key) {
+        for (int i = 0; i < key_count; i++) {
+            if (!keys[i].keep_name) continue;
+            if (agent_path && whisper_daemon_key(agent_path, keys[i].keep_name,
+                                                 &agent_privkeys[i], &agent_pubkeys[i]) == 0) {
+                keys[i].privkey = &agent_privkeys[i];
+                keys[i].pubkey = &agent_pubkeys[i];
+                continue;
+            }
+            keep_secrets[i] = get_nsec_from_keep(keys[i].keep_name);
+            if (!keep_secrets[i]) {
+                ret = WHISPER_EXIT_KEY_ERROR;
+                goto cleanup;
+            }
+            keys[i].nsec = keep_secrets[i];
+        }
+    }
+
     /* Resolve keep key if specified */
-    if (keep_key) {
+    if (keep_key && needs_key && !multi_key && agent_path &&
+        whisper_daemon_key(agent_path, keep_key, &agent_privkeys[0], &agent_pubkeys[0]) == 0) {
+        whisper_set_agent_key(&agent_privkeys[0], &agent_pubkeys[0]);
+    } else if (keep_key && needs_key && !multi_key) {
         keep_nsec = get_nsec_from_keep(keep_key);
-        if (!keep_nsec) return WHISPER_EXIT_KEY_ERROR;
+        if (!keep_nsec) {
+            ret = WHISPER_EXIT_KEY_ERROR;
+            goto cleanup;
+        }
         nsec = keep_nsec;
     }
 
-    int ret;
-
     if (strcmp(command, "send") == 0) {
-        if (!recipient) {
+        if (!recipient && !batch) {
             fprintf(stderr, "Error: --to is required for send\n");
             ret = WHISPER_EXIT_INVALID_ARGS;
             goto cleanup;
         }
-        if (!relay_url) {
+        if (!relay_url && !use_daemon) {
             fprintf(stderr, "Error: --relay is required\n");
             ret = WHISPER_EXIT_INVALID_ARGS;
             goto cleanup;
         }
+        if (quorum > relay_count && !use_daemon) {
+            fprintf(stderr, "Error: --quorum %d exceeds the number of relays (%d)\n",
+                    quorum, relay_count);
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
 
         whisper_send_config config = {
             .recipient = recipient,
             .nsec = nsec,
             .nsec_file = nsec_file,
-            .relay_url = relay_url,
+            .relay_urls = relay_urls,
+            .relay_count = relay_count,
+            .quorum = quorum,
             .subject = subject,
             .reply_to = reply_to,
-            .timeout_ms = timeout_ms
+            .timeout_ms = timeout_ms,
+            .batch = batch,
+            .split = split,
+            .prewarm = prewarm,
+            .socket_path = use_daemon ? socket_path : NULL,
+            .window = window,
+            .jobs = jobs
         };
 
         ret = whisper_send(&config);
 
     } else if (strcmp(command, "recv") == 0) {
-        if (!relay_url) {
+        if (!relay_url && !use_daemon) {
             fprintf(stderr, "Error: --relay is required\n");
             ret = WHISPER_EXIT_INVALID_ARGS;
             goto cleanup;
         }
 
+        if (archive_dir && use_daemon) {
+            fprintf(stderr, "Error: --archive needs its own relay connection, not --daemon\n");
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
+
+        if (use_store && !store_dir) {
+            store_dir = whisper_store_default_dir(default_store, sizeof(default_store));
+            if (!store_dir) {
+                fprintf(stderr, "Error: Cannot locate data directory, use --store-dir\n");
+                ret = WHISPER_EXIT_INVALID_ARGS;
+                goto cleanup;
+            }
+        }
+
         whisper_recv_config config = {
             .nsec = nsec,
             .nsec_file = nsec_file,
-            .relay_url = relay_url,
+            .relay_urls = relay_urls,
+            .relay_count = relay_count,
             .since = since,
             .limit = limit,
             .json_output = json_output,
-            .timeout_ms = timeout_ms
+            .timeout_ms = timeout_ms,
+            .socket_path = use_daemon ? socket_path : NULL,
+            .jobs = jobs,
+            .ordered = ordered,
+            .store_dir = use_store ? store_dir : NULL,
+            .archive_dir = archive_dir,
+            .flush_mode = flush_mode,
+            .rate_cap = rate_cap,
+            .keys = multi_key ? keys : NULL,
+            .key_count = multi_key ? key_count : 0
         };
 
         ret = whisper_recv(&config);
 
+    } else if (is_daemon) {
+        if (!relay_url) {
+            fprintf(stderr, "Error: --relay is required\n");
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
+        if (quorum > relay_count) {
+            fprintf(stderr, "Error: --quorum %d exceeds the number of relays (%d)\n",
+                    quorum, relay_count);
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
+
+        whisper_daemon_config config = {
+            .nsec = nsec,
+            .nsec_file = nsec_file,
+            .relay_urls = relay_urls,
+            .relay_count = relay_count,
+            .quorum = quorum,
+            .socket_path = socket_path,
+            .timeout_ms = timeout_ms,
+            .jobs = jobs,
+            .window = window,
+            .stats = stats,
+            .rate_cap = rate_cap,
+            .keys = multi_key ? keys : NULL,
+            .key_count = multi_key ? key_count : 0,
+            .key_agent = key_agent
+        };
+
+        ret = whisper_daemon(&config);
+
+    } else if (is_stats) {
+        ret = whisper_daemon_stats(socket_path, json_output);
+
+    } else if (is_log) {
+        if (!archive_dir) {
+            fprintf(stderr, "Error: --archive is required for log\n");
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
+
+        whisper_log_config config = {
+            .dir = archive_dir,
+            .since = since,
+            .until = until,
+            .from = sender,
+            .to = recipient,
+            .limit = limit,
+            .json_output = json_output
+        };
+
+        ret = whisper_log(&config);
+
     } else if (strcmp(command, "tui") == 0) {
         if (!relay_url) {
             fprintf(stderr, "Error: --relay is required\n");
@@ -295,9 +688,13 @@ int main(int argc, char* argv[]) {
         whisper_tui_config config = {
             .nsec = nsec,
             .nsec_file = nsec_file,
-            .relay_url = relay_url,
+            .relay_urls = relay_urls,
+            .relay_count = relay_count,
             .recipient = recipient,
-            .timeout_ms = timeout_ms
+            .timeout_ms = timeout_ms,
+            .jobs = jobs,
+            .rate_cap = rate_cap,
+            .store_dir = store_dir
         };
 
         ret = whisper_tui(&config);
@@ -311,10 +708,24 @@ int main(int argc, char* argv[]) {
         ret = WHISPER_EXIT_INVALID_ARGS;
     }
 
+    /* The daemon prints its own, periodically */
+    if (stats && !is_daemon && !is_stats && !is_log) whisper_stats_print(stderr);
+
 cleanup:
+    whisper_send_prewarm_close();
     if (keep_nsec) {
         secure_wipe(keep_nsec, strlen(keep_nsec));
         free(keep_nsec);
     }
+    whisper_set_agent_key(NULL, NULL);
+    whisper_unlock_memory(agent_privkeys, sizeof(agent_privkeys));
+    for (int i = 0; i < key_count; i++) {
+        if (!keep_secrets[i]) continue;
+        secure_wipe(keep_secrets[i], strlen(keep_secrets[i]));
+        free(keep_secrets[i]);
+    }
+    for (int i = 0; i < relay_file_count; i++) {
+        free(relay_file_urls[i]);
+    }
     return ret;
 }
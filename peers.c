@@ -0,0 +1,116 @@
+/*
+ * whisper peers - Per-peer cache of npub/hex encodings
+ *
+ * Batch, daemon and TUI sessions talk to a small set of peers thousands
+ * of times. Each entry keeps a peer's public key with its npub and hex
+ * encodings, so that bech32 encoding and parsing the string the user gave
+ * happen once per peer instead of once per message. Everything cached is
+ * public, so entries are simply overwritten on eviction and freed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "whisper.h"
+
+int whisper_peer_cache_init(whisper_peer_cache* cache, size_t capacity) {
+    memset(cache, 0, sizeof(*cache));
+    if (capacity == 0) capacity = WHISPER_PEER_CACHE_SIZE;
+
+    cache->entries = calloc(capacity, sizeof(*cache->entries));
+    if (!cache->entries) return -1;
+    cache->capacity = capacity;
+    whisper_mutex_init(&cache->lock);
+    return 0;
+}
+
+void whisper_peer_cache_destroy(whisper_peer_cache* cache) {
+    if (!cache->entries) return;
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->count = 0;
+    whisper_mutex_destroy(&cache->lock);
+}
+
+/* Caller holds the lock */
+static whisper_peer* find_key(whisper_peer_cache* cache, const nostr_key* key) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (memcmp(&cache->entries[i].key, key, sizeof(*key)) == 0) return &cache->entries[i];
+    }
+    return NULL;
+}
+
+static whisper_peer* find_text(whisper_peer_cache* cache, const char* text) {
+    for (size_t i = 0; i < cache->count; i++) {
+        whisper_peer* p = &cache->entries[i];
+        if (strcmp(p->npub, text) == 0 || strcmp(p->hex, text) == 0) return p;
+    }
+    return NULL;
+}
+
+/* Fill a slot for key, evicting the least recently used when full */
+static whisper_peer* insert(whisper_peer_cache* cache, const nostr_key* key) {
+    whisper_peer* p;
+    if (cache->count < cache->capacity) {
+        p = &cache->entries[cache->count++];
+    } else {
+        p = &cache->entries[0];
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used < p->last_used) p = &cache->entries[i];
+        }
+        cache->evictions++;
+    }
+
+    p->key = *key;
+    if (nostr_key_to_bech32(key, "npub", p->npub, sizeof(p->npub)) != NOSTR_OK) p->npub[0] = '\0';
+    if (nostr_key_to_hex(key, p->hex, sizeof(p->hex)) != NOSTR_OK) p->hex[0] = '\0';
+    return p;
+}
+
+void whisper_peer_npub(whisper_peer_cache* cache, const nostr_key* key,
+                       char* out, size_t out_size) {
+    if (!cache->entries) {
+        /* Cache failed to allocate: compute directly */
+        if (nostr_key_to_bech32(key, "npub", out, out_size) != NOSTR_OK && out_size) out[0] = '\0';
+        return;
+    }
+
+    whisper_mutex_lock(&cache->lock);
+    whisper_peer* p = find_key(cache, key);
+    if (p) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+        p = insert(cache, key);
+    }
+    p->last_used = ++cache->tick;
+    snprintf(out, out_size, "%s", p->npub);
+    whisper_mutex_unlock(&cache->lock);
+}
+
+int whisper_peer_parse(whisper_peer_cache* cache, const char* text, nostr_key* key) {
+    if (!text) return -1;
+    if (!cache->entries) return whisper_parse_pubkey(text, key);
+
+    whisper_mutex_lock(&cache->lock);
+    whisper_peer* p = find_text(cache, text);
+    if (p) {
+        cache->hits++;
+        p->last_used = ++cache->tick;
+        *key = p->key;
+        whisper_mutex_unlock(&cache->lock);
+        return 0;
+    }
+    whisper_mutex_unlock(&cache->lock);
+
+    /* Decode outside the lock; errors are reported by whisper_parse_pubkey */
+    if (whisper_parse_pubkey(text, key) != 0) return -1;
+
+    whisper_mutex_lock(&cache->lock);
+    cache->misses++;
+    p = find_key(cache, key);
+    if (!p) p = insert(cache, key);
+    p->last_used = ++cache->tick;
+    whisper_mutex_unlock(&cache->lock);
+    return 0;
+}
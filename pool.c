@@ -0,0 +1,740 @@
+/*
+ * whisper relay pool - Parallel connections and fan-out publishing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "whisper.h"
+
+/* Gift wrap ids remembered for cross-relay deduplication */
+#define POOL_SEEN_CAPACITY 16384
+
+static void pool_state_cb(nostr_relay* relay, nostr_relay_state state, void* user_data) {
+    (void)relay;
+    whisper_pool_relay* conn = (whisper_pool_relay*)user_data;
+    whisper_pool* pool = conn->pool;
+
+    switch (state) {
+        case NOSTR_RELAY_CONNECTED:
+            if (conn->connected != 1) {
+                int64_t since_ms = conn->dialed_ms ? conn->dialed_ms : pool->opened_ms;
+                whisper_stats_observe(WHISPER_LAT_CONNECT, whisper_now_us() - since_ms * 1000);
+            }
+            conn->connected = 1;
+            conn->was_up = true;
+            conn->dialed_ms = 0;
+            break;
+        case NOSTR_RELAY_ERROR:     conn->connected = -1; break;
+        case NOSTR_RELAY_DISCONNECTED:
+            if (conn->connected == 1) conn->connected = -1;
+            break;
+        default: break;
+    }
+
+    if (pool->on_state) pool->on_state(conn, state, pool->user_data);
+    whisper_wakeup_signal(&pool->wakeup);
+    whisper_publisher* publisher = pool->publisher;
+    if (publisher) whisper_publisher_wake(publisher);
+}
+
+/* EOSE carries the subscription id; relays that omit it match anything */
+static bool eose_for(const char* data, const char* sub_id) {
+    return sub_id && (!data || strstr(data, sub_id) != NULL);
+}
+
+static void pool_message_cb(const char* message_type, const char* data, void* user_data) {
+    whisper_pool_relay* conn = (whisper_pool_relay*)user_data;
+    whisper_pool* pool = conn->pool;
+
+    if (strcmp(message_type, "EOSE") == 0) {
+        if (conn->page_pending && eose_for(data, pool->page_id)) {
+            conn->page_pending = 0;
+        } else if (eose_for(data, pool->sub_id)) {
+            if (!conn->eose && conn->subscribed_us) {
+                whisper_stats_observe(WHISPER_LAT_EOSE, whisper_now_us() - conn->subscribed_us);
+            }
+            conn->eose = 1;
+            conn->retries = 0;  /* healthy again: next drop starts the backoff over */
+        }
+        whisper_wakeup_signal(&pool->wakeup);
+    }
+
+    if (strcmp(message_type, "OK") == 0) {
+        char id_hex[65];
+        bool accepted;
+        char msg[sizeof(conn->ok_message)];
+        if (whisper_parse_ok(data, id_hex, &accepted, msg, sizeof(msg)) == 0) {
+            if (strcmp(id_hex, conn->pending_id) == 0) {
+                if (conn->ok_state == 0 && conn->published) {
+                    whisper_stats_observe(WHISPER_LAT_OK, whisper_now_us() - conn->sent_us);
+                    whisper_stats_count(accepted ? WHISPER_STAT_OK_ACCEPTED
+                                                 : WHISPER_STAT_OK_REJECTED, 1);
+                }
+                memcpy(conn->ok_message, msg, sizeof(conn->ok_message));
+                conn->ok_state = accepted ? 1 : -1;
+                whisper_wakeup_signal(&pool->wakeup);
+            }
+            whisper_publisher* publisher = pool->publisher;
+            if (publisher) whisper_publisher_ok(publisher, conn->index, id_hex, accepted, msg);
+        }
+    }
+
+    if (pool->on_message) pool->on_message(conn, message_type, data, pool->user_data);
+}
+
+/* Stats counter for each WHISPER_DROP_* stage */
+static const int drop_stat[WHISPER_DROP_STAGES] = {
+    WHISPER_STAT_DROP_KIND,
+    WHISPER_STAT_DROP_RECIPIENT,
+    WHISPER_STAT_DROP_SIZE,
+    WHISPER_STAT_DROP_AGE,
+    WHISPER_STAT_DUPLICATES,
+    WHISPER_STAT_DROP_RATE,
+};
+
+static void drop(whisper_pool* pool, int stage) {
+    pool->dropped[stage]++;
+    whisper_stats_count(drop_stat[stage], 1);
+}
+
+void whisper_prefilter_init(whisper_prefilter* f, const nostr_key* recipient, int64_t since,
+                            int max_per_second) {
+    memset(f, 0, sizeof(*f));
+    f->enabled = true;
+    f->since = since;
+    f->max_per_second = max_per_second;
+    if (recipient) whisper_prefilter_add(f, recipient);
+}
+
+int whisper_prefilter_add(whisper_prefilter* f, const nostr_key* recipient) {
+    if (f->recipient_count >= WHISPER_MAX_IDENTITIES) return -1;
+    nostr_key_to_hex(recipient, f->recipients[f->recipient_count],
+                     sizeof(f->recipients[0]));
+    f->recipient_count++;
+    return 0;
+}
+
+/* Tag values come from the relay; NIP-01 says lowercase but be lenient */
+static bool hex_equal(const char* a, const char* b) {
+    for (; *a && *b; a++, b++) {
+        if (tolower((unsigned char)*a) != *b) return false;
+    }
+    return *a == *b;
+}
+
+int whisper_prefilter_recipient(const whisper_prefilter* f, const nostr_event* event) {
+    if (f->recipient_count == 0) return 0;
+    for (size_t i = 0; i < event->tags_count; i++) {
+        const nostr_tag* tag = &event->tags[i];
+        if (tag->count < 2 || !tag->values[0] || strcmp(tag->values[0], "p") != 0 ||
+            !tag->values[1]) {
+            continue;
+        }
+        for (int k = 0; k < f->recipient_count; k++) {
+            if (hex_equal(tag->values[1], f->recipients[k])) return k;
+        }
+    }
+    return -1;
+}
+
+int whisper_dm_filter(char* buf, size_t size, const whisper_prefilter* f,
+                      int64_t since, int64_t until, int limit) {
+    size_t n = (size_t)snprintf(buf, size, "{\"kinds\":[1059],\"#p\":[");
+    for (int k = 0; k < f->recipient_count && n < size; k++) {
+        n += (size_t)snprintf(buf + n, size - n, "%s\"%s\"", k ? "," : "", f->recipients[k]);
+    }
+    if (n < size) n += (size_t)snprintf(buf + n, size - n, "]");
+    if (since > 0 && n < size) {
+        n += (size_t)snprintf(buf + n, size - n, ",\"since\":%lld", (long long)since);
+    }
+    if (until > 0 && n < size) {
+        n += (size_t)snprintf(buf + n, size - n, ",\"until\":%lld", (long long)until);
+    }
+    if (limit > 0 && n < size) n += (size_t)snprintf(buf + n, size - n, ",\"limit\":%d", limit);
+    if (n < size) n += (size_t)snprintf(buf + n, size - n, "}");
+    return n < size ? 0 : -1;
+}
+
+int whisper_prefilter_check(const whisper_prefilter* f, const nostr_event* event, int64_t now) {
+    if (!f->enabled) return -1;
+    if (event->kind != 1059) return WHISPER_DROP_KIND;
+    if (whisper_prefilter_recipient(f, event) < 0) return WHISPER_DROP_RECIPIENT;
+
+    size_t len = event->content ? strlen(event->content) : 0;
+    if (len < WHISPER_NIP44_MIN_B64 || len > WHISPER_NIP44_MAX_B64) return WHISPER_DROP_SIZE;
+
+    /* Backdating is part of NIP-59; allow the same skew forward for clocks */
+    if (event->created_at > now + WHISPER_NIP59_SKEW_S ||
+        (f->since > 0 && event->created_at < f->since)) {
+        return WHISPER_DROP_AGE;
+    }
+    return -1;
+}
+
+/* Fixed one-second window per relay */
+static bool over_rate(whisper_pool_relay* conn, int max_per_second) {
+    if (max_per_second <= 0) return false;
+    int64_t second = whisper_now_ms() / 1000;
+    if (second != conn->rate_second) {
+        conn->rate_second = second;
+        conn->rate_count = 0;
+    }
+    return ++conn->rate_count > max_per_second;
+}
+
+/* Caller holds event_lock: created_at bounds feed store cursors and
+ * reconnect resume, so they move only past wraps someone has received */
+static void note_created_at(whisper_pool_relay* conn, const nostr_event* event) {
+    if (event->created_at > conn->newest_created_at) {
+        conn->newest_created_at = event->created_at;
+    }
+    if (conn->oldest_created_at == 0 || event->created_at < conn->oldest_created_at) {
+        conn->oldest_created_at = event->created_at;
+    }
+}
+
+/* Caller holds event_lock. Returns true if the event was new. */
+static bool dispatch_event(whisper_pool_relay* conn, const nostr_event* event) {
+    whisper_pool* pool = conn->pool;
+
+    conn->events_received++;
+    whisper_stats_count(WHISPER_STAT_EVENTS, 1);
+
+    /* Everything up to the rate cap is cheaper than one ECDH */
+    int stage = whisper_prefilter_check(&pool->filter, event, (int64_t)time(NULL));
+    if (stage >= 0) {
+        drop(pool, stage);
+        return false;
+    }
+
+    /* Drop copies from other relays before anyone pays for decryption; the
+     * first copy was delivered, so this relay has it covered too */
+    if (whisper_idset_contains(&pool->seen, event->id)) {
+        note_created_at(conn, event);
+        pool->duplicates++;
+        drop(pool, WHISPER_DROP_DUPLICATE);
+        return false;
+    }
+    /* Not marked seen: another relay or the reconnect replay may deliver it */
+    if (over_rate(conn, pool->filter.max_per_second)) {
+        if (conn->rate_floor == 0 || event->created_at < conn->rate_floor) {
+            conn->rate_floor = event->created_at;
+        }
+        drop(pool, WHISPER_DROP_RATE);
+        return false;
+    }
+    whisper_idset_insert(&pool->seen, event->id);
+    note_created_at(conn, event);
+    if (pool->on_event) pool->on_event(conn, event, pool->user_data);
+    return true;
+}
+
+static void pool_event_cb(const nostr_event* event, void* user_data) {
+    whisper_pool_relay* conn = (whisper_pool_relay*)user_data;
+    whisper_pool* pool = conn->pool;
+
+    whisper_mutex_lock(&pool->event_lock);
+    dispatch_event(conn, event);
+    whisper_mutex_unlock(&pool->event_lock);
+}
+
+static void pool_page_event_cb(const nostr_event* event, void* user_data) {
+    whisper_pool_relay* conn = (whisper_pool_relay*)user_data;
+    whisper_pool* pool = conn->pool;
+
+    whisper_mutex_lock(&pool->event_lock);
+    pool->page_events++;
+    conn->page_events++;
+    if (conn->page_oldest == 0 || event->created_at < conn->page_oldest) {
+        conn->page_oldest = event->created_at;
+    }
+    if (dispatch_event(conn, event)) pool->page_fresh++;
+    whisper_mutex_unlock(&pool->event_lock);
+}
+
+int whisper_pool_open(whisper_pool* pool, const char* const* urls, int count) {
+    if (count < 1 || count > WHISPER_MAX_RELAYS) return -1;
+
+    pool->count = count;
+    pool->opened_ms = whisper_now_ms();
+    if (whisper_wakeup_init(&pool->wakeup) != 0) {
+        fprintf(stderr, "Error: Failed to create wakeup channel\n");
+        pool->count = 0;
+        return -1;
+    }
+    whisper_mutex_init(&pool->event_lock);
+    pool->open = true;
+
+    /* Start every handshake before waiting on any of them */
+    int started = 0;
+    for (int i = 0; i < count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        memset(conn, 0, sizeof(*conn));
+        conn->pool = pool;
+        conn->index = i;
+        conn->url = urls[i];
+
+        if (nostr_relay_create(&conn->relay, urls[i]) != NOSTR_OK) {
+            fprintf(stderr, "Warning: %s: failed to create relay\n", urls[i]);
+            conn->relay = NULL;
+            conn->connected = -1;
+            continue;
+        }
+
+        nostr_relay_set_message_callback(conn->relay, pool_message_cb, conn);
+
+        if (nostr_relay_connect(conn->relay, pool_state_cb, conn) != NOSTR_OK) {
+            fprintf(stderr, "Warning: %s: failed to connect\n", urls[i]);
+            conn->connected = -1;
+            continue;
+        }
+        started++;
+    }
+
+    return started;
+}
+
+int whisper_pool_connected_count(const whisper_pool* pool) {
+    int n = 0;
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->relays[i].connected == 1) n++;
+    }
+    return n;
+}
+
+int whisper_pool_wait_connected(whisper_pool* pool, int min_connected, int timeout_ms) {
+    int64_t deadline = pool->opened_ms + timeout_ms;
+
+    for (;;) {
+        int up = 0, pending = 0;
+        for (int i = 0; i < pool->count; i++) {
+            if (pool->relays[i].connected == 1) up++;
+            else if (pool->relays[i].connected == 0) pending++;
+        }
+        if (up >= min_connected || pending == 0) return up;
+
+        int64_t remaining = deadline - whisper_now_ms();
+        if (remaining <= 0) return up;
+        whisper_wakeup_wait(&pool->wakeup, (int)remaining);
+    }
+}
+
+bool whisper_pool_write(whisper_pool_relay* conn, const nostr_event* event) {
+    int64_t start = whisper_now_us();
+    if (nostr_publish_event(conn->relay, event) != NOSTR_OK) return false;
+    int64_t now = whisper_now_us();
+    whisper_stats_observe(WHISPER_LAT_PUBLISH, now - start);
+    whisper_stats_count(WHISPER_STAT_PUBLISHED, 1);
+    conn->sent_us = now;
+    return true;
+}
+
+/* Relays written to that never answered count as OK timeouts */
+static int publish_finished(whisper_pool* pool, int accepted) {
+    for (int i = 0; i < pool->count; i++) {
+        const whisper_pool_relay* conn = &pool->relays[i];
+        if (conn->published && conn->ok_state == 0) {
+            whisper_stats_count(WHISPER_STAT_OK_TIMEOUT, 1);
+        }
+    }
+    return accepted;
+}
+
+int whisper_pool_publish(whisper_pool* pool, const nostr_event* event,
+                         int quorum, int timeout_ms) {
+    char id_hex[65];
+    whisper_event_id_hex(event, id_hex);
+
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        conn->published = false;
+        conn->ok_message[0] = '\0';
+        conn->ok_state = 0;
+        memcpy(conn->pending_id, id_hex, sizeof(conn->pending_id));
+    }
+
+    /* Relays still handshaking get the event as soon as they come up */
+    int64_t connect_deadline = whisper_now_ms() + timeout_ms;
+
+    for (;;) {
+        int64_t now = whisper_now_ms();
+        int accepted = 0, outstanding = 0;
+        int64_t next_deadline = connect_deadline;
+
+        for (int i = 0; i < pool->count; i++) {
+            whisper_pool_relay* conn = &pool->relays[i];
+
+            if (!conn->published && conn->connected == 1) {
+                if (conn->relay->state == NOSTR_RELAY_CONNECTED &&
+                    whisper_pool_write(conn, event)) {
+                    conn->published = true;
+                    conn->deadline_ms = now + timeout_ms;
+                } else {
+                    snprintf(conn->ok_message, sizeof(conn->ok_message),
+                             "failed to publish");
+                    conn->ok_state = -1;
+                }
+            }
+
+            if (conn->ok_state == 1) {
+                accepted++;
+            } else if (conn->ok_state == 0) {
+                if (conn->published && conn->connected == 1 && now < conn->deadline_ms) {
+                    outstanding++;
+                    if (conn->deadline_ms > next_deadline) next_deadline = conn->deadline_ms;
+                } else if (!conn->published && conn->connected == 0 && now < connect_deadline) {
+                    outstanding++;
+                }
+            }
+        }
+
+        if (accepted >= quorum || outstanding == 0) return publish_finished(pool, accepted);
+
+        int64_t remaining = next_deadline - now;
+        if (remaining <= 0) return publish_finished(pool, accepted);
+        whisper_wakeup_wait(&pool->wakeup, (int)remaining);
+    }
+}
+
+int whisper_wrap_dm(const nostr_privkey* privkey, const nostr_key* recipient,
+                    const char* content, const char* subject, nostr_event** out,
+                    char* err_buf, size_t err_size) {
+    *out = NULL;
+    int64_t start = whisper_now_us();
+    nostr_error_t err = nostr_nip17_send_dm(
+        out,
+        content,
+        privkey,
+        recipient,
+        subject,
+        NULL,  /* reply_to - TODO: parse event ID */
+        0      /* created_at = now */
+    );
+    whisper_stats_observe(WHISPER_LAT_WRAP, whisper_now_us() - start);
+
+    if (err != NOSTR_OK || !*out) {
+        snprintf(err_buf, err_size, "Failed to create DM: %s", nostr_error_string(err));
+        return WHISPER_EXIT_CRYPTO_ERROR;
+    }
+    return WHISPER_EXIT_OK;
+}
+
+int whisper_pool_send_dm(whisper_pool* pool, const nostr_privkey* privkey,
+                         const nostr_key* recipient, const char* content,
+                         const char* subject, int quorum, int timeout_ms,
+                         char id_hex[65], char* err_buf, size_t err_size) {
+    nostr_event* dm = NULL;
+    int rc = whisper_wrap_dm(privkey, recipient, content, subject, &dm, err_buf, err_size);
+    if (rc != WHISPER_EXIT_OK) return rc;
+
+    rc = whisper_pool_send_wrapped(pool, dm, quorum, timeout_ms, id_hex, err_buf, err_size);
+    nostr_event_destroy(dm);
+    return rc;
+}
+
+int whisper_pool_send_wrapped(whisper_pool* pool, const nostr_event* dm, int quorum,
+                              int timeout_ms, char id_hex[65], char* err_buf, size_t err_size) {
+    whisper_event_id_hex(dm, id_hex);
+    int accepted = whisper_pool_publish(pool, dm, quorum, timeout_ms);
+
+    int published = 0, rejected = 0;
+    const char* reason = NULL;
+    for (int i = 0; i < pool->count; i++) {
+        const whisper_pool_relay* conn = &pool->relays[i];
+        if (conn->published) published++;
+        if (conn->ok_state == -1) {
+            rejected++;
+            if (!reason && conn->ok_message[0]) reason = conn->ok_message;
+        }
+    }
+    return whisper_publish_outcome(accepted, published, rejected, quorum, reason,
+                                   err_buf, err_size);
+}
+
+int whisper_publish_outcome(int accepted, int published, int rejected, int quorum,
+                            const char* reason, char* err_buf, size_t err_size) {
+    if (accepted >= quorum) return WHISPER_EXIT_OK;
+
+    if (published == 0) {
+        snprintf(err_buf, err_size, "Failed to publish event");
+        return WHISPER_EXIT_RELAY_ERROR;
+    }
+    if (accepted == 0 && rejected == published) {
+        snprintf(err_buf, err_size, "Relay rejected event: %s",
+                 reason ? reason : "no reason given");
+        return WHISPER_EXIT_RELAY_ERROR;
+    }
+    snprintf(err_buf, err_size, "Only %d of %d required relays confirmed",
+             accepted, quorum);
+    return WHISPER_EXIT_TIMEOUT;
+}
+
+int whisper_pool_broadcast(whisper_pool* pool, const nostr_event* event) {
+    char id_hex[65];
+    whisper_event_id_hex(event, id_hex);
+
+    int sent = 0;
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        conn->published = false;
+        conn->ok_message[0] = '\0';
+        conn->ok_state = 0;
+        memcpy(conn->pending_id, id_hex, sizeof(conn->pending_id));
+        if (conn->connected == 1 && conn->relay->state == NOSTR_RELAY_CONNECTED &&
+            whisper_pool_write(conn, event)) {
+            conn->published = true;
+            sent++;
+        }
+    }
+    return sent;
+}
+
+bool whisper_pool_alive(const whisper_pool* pool) {
+    for (int i = 0; i < pool->count; i++) {
+        const whisper_pool_relay* conn = &pool->relays[i];
+        if (conn->connected == 1 && conn->relay->state == NOSTR_RELAY_CONNECTED) return true;
+    }
+    return false;
+}
+
+/* The subscription filter with since moved up to resume a relay that came
+ * back, and no limit. malloc'd; NULL if the filter is not ours to edit. */
+static char* resume_filter(const char* filter, int64_t since) {
+    cJSON* f = cJSON_Parse(filter);
+    if (!cJSON_IsObject(f)) {
+        cJSON_Delete(f);
+        return NULL;
+    }
+    const cJSON* old = cJSON_GetObjectItemCaseSensitive(f, "since");
+    if (!cJSON_IsNumber(old) || (int64_t)old->valuedouble < since) {
+        cJSON_DeleteItemFromObjectCaseSensitive(f, "since");
+        cJSON_AddNumberToObject(f, "since", (double)since);
+    }
+    cJSON_DeleteItemFromObjectCaseSensitive(f, "limit");
+    char* out = cJSON_PrintUnformatted(f);
+    cJSON_Delete(f);
+    return out;
+}
+
+int whisper_pool_subscribe(whisper_pool* pool, const char* sub_id, const char* filter) {
+    if (!pool->sub_filter) {
+        if (whisper_idset_init(&pool->seen, POOL_SEEN_CAPACITY) != 0) return -1;
+        pool->sub_filter = strdup(filter);
+        if (!pool->sub_filter) return -1;
+        pool->sub_id = sub_id;
+    }
+
+    int subscribed = 0;
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        if (!conn->subscribed && conn->connected == 1 &&
+            conn->relay->state == NOSTR_RELAY_CONNECTED) {
+            char* resumed = conn->resume_since > 0 ? resume_filter(pool->sub_filter,
+                                                                   conn->resume_since) : NULL;
+            conn->subscribed_us = whisper_now_us();
+            nostr_error_t err = nostr_subscribe(conn->relay, pool->sub_id,
+                                                resumed ? resumed : pool->sub_filter,
+                                                pool_event_cb, conn);
+            if (resumed) cJSON_free(resumed);
+            if (err == NOSTR_OK) {
+                conn->subscribed = true;
+            } else {
+                fprintf(stderr, "Warning: %s: failed to subscribe\n", conn->url);
+                conn->connected = -1;
+            }
+        }
+        if (conn->subscribed) subscribed++;
+    }
+    return subscribed;
+}
+
+/* Uniform in [0, n) from a xorshift32 seeded on first use */
+static uint32_t jitter(whisper_pool* pool, uint32_t n) {
+    if (pool->jitter == 0) pool->jitter = (uint32_t)whisper_now_us() | 1;
+    uint32_t x = pool->jitter;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pool->jitter = x;
+    return n ? x % n : 0;
+}
+
+int whisper_pool_maintain(whisper_pool* pool) {
+    int64_t now = whisper_now_ms();
+    int64_t next = 0;
+    bool alive = false;
+
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        if (!conn->relay) continue;
+
+        if (conn->connected == 1) {
+            alive = true;
+            continue;
+        }
+        if (!conn->was_up) {
+            /* Never got through: left as failed, as before */
+            if (conn->connected == 0) alive = true;
+            continue;
+        }
+
+        /* A redial that hangs counts as failed */
+        if (conn->connected == 0 && conn->dialed_ms &&
+            now - conn->dialed_ms >= WHISPER_RECONNECT_DIAL_MS) {
+            conn->connected = -1;
+        }
+        if (conn->connected == 0) {
+            /* Come back when the dial times out if no callback says otherwise */
+            if (conn->dialed_ms) {
+                int64_t wait = conn->dialed_ms + WHISPER_RECONNECT_DIAL_MS - now;
+                if (next == 0 || wait < next) next = wait;
+            }
+            alive = true;
+            continue;
+        }
+
+        if (conn->retry_at_ms == 0) {
+            int shift = conn->retries < 16 ? conn->retries : 16;
+            int64_t delay = (int64_t)WHISPER_RECONNECT_BASE_MS << shift;
+            if (delay > WHISPER_RECONNECT_MAX_MS) delay = WHISPER_RECONNECT_MAX_MS;
+            delay = delay / 2 + jitter(pool, (uint32_t)(delay / 2 + 1));
+            conn->retry_at_ms = now + delay;
+            conn->retries++;
+        }
+        alive = true;
+
+        if (now < conn->retry_at_ms) {
+            int64_t wait = conn->retry_at_ms - now;
+            if (next == 0 || wait < next) next = wait;
+            continue;
+        }
+
+        /* Resume a little before the newest wrap seen: NIP-59 backdates
+         * created_at, and anything repeated is caught by the id set */
+        int64_t since = conn->newest_created_at - WHISPER_NIP59_SKEW_S;
+        if (since > conn->resume_since) conn->resume_since = since;
+        conn->retry_at_ms = 0;
+        conn->subscribed = false;
+        conn->eose = 0;
+        conn->connected = 0;
+        conn->dialed_ms = now;
+        whisper_stats_count(WHISPER_STAT_RECONNECTS, 1);
+        nostr_relay_disconnect(conn->relay);
+        if (nostr_relay_connect(conn->relay, pool_state_cb, conn) != NOSTR_OK) {
+            conn->connected = -1;
+            conn->dialed_ms = 0;
+        }
+    }
+
+    if (!alive) return -1;
+    return next > INT32_MAX ? INT32_MAX : (int)next;
+}
+
+int whisper_pool_fetch(whisper_pool* pool, const char* sub_id, const char* filter,
+                       int timeout_ms) {
+    if (!pool->sub_filter) return -1;  /* dedup set lives with the main subscription */
+
+    whisper_mutex_lock(&pool->event_lock);
+    pool->page_id = sub_id;
+    pool->page_events = 0;
+    pool->page_fresh = 0;
+    for (int i = 0; i < pool->count; i++) {
+        pool->relays[i].page_events = 0;
+        pool->relays[i].page_oldest = 0;
+    }
+    whisper_mutex_unlock(&pool->event_lock);
+
+    int asked = 0;
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        conn->paged = false;
+        if (conn->connected != 1 || conn->relay->state != NOSTR_RELAY_CONNECTED) continue;
+
+        conn->page_pending = 1;
+        if (nostr_subscribe(conn->relay, sub_id, filter, pool_page_event_cb, conn) == NOSTR_OK) {
+            conn->paged = true;
+            asked++;
+        } else {
+            conn->page_pending = 0;
+        }
+    }
+
+    int64_t deadline = whisper_now_ms() + timeout_ms;
+    for (;;) {
+        int pending = 0;
+        for (int i = 0; i < pool->count; i++) {
+            const whisper_pool_relay* conn = &pool->relays[i];
+            if (conn->paged && conn->page_pending && conn->connected == 1) pending++;
+        }
+        if (pending == 0) break;
+
+        int64_t remaining = deadline - whisper_now_ms();
+        if (remaining <= 0) break;
+        whisper_wakeup_wait(&pool->wakeup, (int)remaining);
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        if (conn->paged && conn->relay->state == NOSTR_RELAY_CONNECTED) {
+            nostr_relay_unsubscribe(conn->relay, sub_id);
+        }
+        conn->paged = false;
+        conn->page_pending = 0;
+    }
+    return asked;
+}
+
+int whisper_pool_fetch_older(whisper_pool* pool, const char* sub_id, int64_t since,
+                             int64_t* until, int limit, int timeout_ms, bool* exhausted) {
+    char filter[WHISPER_DM_FILTER_SIZE];
+    whisper_dm_filter(filter, sizeof(filter), &pool->filter, since, *until, limit);
+    if (whisper_pool_fetch(pool, sub_id, filter, timeout_ms) <= 0) return -1;
+
+    int64_t next_until = 0;
+    *exhausted = true;
+    whisper_mutex_lock(&pool->event_lock);
+    for (int i = 0; i < pool->count; i++) {
+        const whisper_pool_relay* conn = &pool->relays[i];
+        if (conn->page_events >= limit) *exhausted = false;
+        if (conn->page_oldest > next_until) next_until = conn->page_oldest;
+    }
+    int fresh = pool->page_fresh;
+    whisper_mutex_unlock(&pool->event_lock);
+
+    /* Everything in [next_until, until) came back, repeats or not; only a
+     * page stuck on one second needs stepping past it. One filter goes to
+     * every relay, so until is the newest of their page boundaries: slower
+     * relays resend a few events (dropped by the dedup) but none is skipped. */
+    *until = next_until < *until ? next_until : *until - 1;
+    return fresh;
+}
+
+void whisper_pool_close(whisper_pool* pool) {
+    if (!pool->open) return;
+
+    for (int i = 0; i < pool->count; i++) {
+        whisper_pool_relay* conn = &pool->relays[i];
+        if (conn->subscribed && conn->relay->state == NOSTR_RELAY_CONNECTED) {
+            nostr_relay_unsubscribe(conn->relay, pool->sub_id);
+        }
+        conn->subscribed = false;
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->relays[i].relay) {
+            /* Let nostr_relay_destroy handle cleanup - it checks state internally */
+            nostr_relay_destroy(pool->relays[i].relay);
+            pool->relays[i].relay = NULL;
+        }
+    }
+    pool->count = 0;
+    whisper_wakeup_destroy(&pool->wakeup);
+    whisper_mutex_destroy(&pool->event_lock);
+    whisper_idset_destroy(&pool->seen);
+    free(pool->sub_filter);
+    pool->sub_filter = NULL;
+    pool->open = false;
+}
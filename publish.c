@@ -0,0 +1,357 @@
+/*
+ * whisper publish - Pipelined publishing with a window of outstanding OKs
+ *
+ * whisper_pool_publish waits a full round trip per event. For a batch or a
+ * busy daemon that caps throughput at one event per RTT, so this keeps up to
+ * `window` events in flight: each is sent to every relay as soon as it is
+ * submitted, OKs are matched by event id, and results come back in
+ * submission order. A full window makes whisper_publisher_submit block,
+ * which is the backpressure, and also bounds each relay to `window`
+ * unanswered events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "whisper.h"
+
+/* Pause after a "rate-limited:" OK, doubling up to the cap */
+#define RATE_LIMIT_BACKOFF_MS 500
+#define RATE_LIMIT_BACKOFF_MAX_MS 8000
+#define RATE_LIMIT_SENDS 3           /* then the rate-limited OK counts as a rejection */
+
+static bool relay_up(const whisper_pool_relay* conn) {
+    return conn->connected == 1 && conn->relay && conn->relay->state == NOSTR_RELAY_CONNECTED;
+}
+
+static void fill_result(const whisper_publisher* p, const whisper_pub_entry* e,
+                        whisper_publish_result* result) {
+    memset(result, 0, sizeof(*result));
+    result->id = e->id;
+    result->token = e->token;
+    if (!e->event) {
+        result->code = e->code;
+        snprintf(result->error, sizeof(result->error), "%s", e->reason);
+        return;
+    }
+    for (int r = 0; r < p->pool->count; r++) {
+        if (e->sends[r]) result->published++;
+        if (e->state[r] == WHISPER_PUB_ACCEPTED) result->accepted++;
+        if (e->state[r] == WHISPER_PUB_REJECTED) result->rejected++;
+    }
+    result->code = whisper_publish_outcome(result->accepted, result->published,
+                                           result->rejected, p->quorum,
+                                           e->reason[0] ? e->reason : NULL,
+                                           result->error, sizeof(result->error));
+}
+
+#ifndef _WIN32
+static whisper_pub_entry* entry_at(whisper_publisher* p, int i) {
+    return &p->entries[(p->head + i) % p->window];
+}
+
+/*
+ * Advance one entry: send to relays that are up, give up on relays past
+ * their deadline. Returns the earliest time the entry needs looking at
+ * again (INT64_MAX if only an OK or state change can move it). Called with
+ * p->lock held; drops it around each relay write.
+ */
+static int64_t pump_entry(whisper_publisher* p, whisper_pub_entry* e, int64_t now) {
+    int64_t next = INT64_MAX;
+    int accepted = 0, outstanding = 0;
+
+    for (int r = 0; r < p->pool->count; r++) {
+        whisper_pool_relay* conn = &p->pool->relays[r];
+        int8_t* state = &e->state[r];
+
+        if (*state == WHISPER_PUB_UNSENT) {
+            if (conn->connected == -1) {
+                *state = e->sends[r] ? WHISPER_PUB_TIMEOUT : WHISPER_PUB_FAILED;
+            } else if (now >= e->deadline_ms[r]) {
+                *state = e->sends[r] ? WHISPER_PUB_TIMEOUT : WHISPER_PUB_FAILED;
+            } else if (relay_up(conn) && now >= p->paused_until[r]) {
+                /*
+                 * The write runs without p->lock: nostr_publish_event can
+                 * block on the relay, whose thread takes p->lock to deliver
+                 * OKs. Only this thread retires entries, so e stays put, and
+                 * an OK that beats the write back is taken as for SENT.
+                 */
+                *state = WHISPER_PUB_SENDING;
+                if (e->sends[r] < UINT8_MAX) e->sends[r]++;
+                e->sent_us[r] = whisper_now_us();
+                pthread_mutex_unlock(&p->lock);
+                bool written = whisper_pool_write(conn, e->event);
+                pthread_mutex_lock(&p->lock);
+                if (!written) {
+                    e->sends[r]--;
+                    if (*state == WHISPER_PUB_SENDING) *state = WHISPER_PUB_FAILED;
+                } else if (*state == WHISPER_PUB_SENDING) {
+                    *state = WHISPER_PUB_SENT;
+                    e->deadline_ms[r] = now + p->timeout_ms;
+                    e->sent_us[r] = conn->sent_us;
+                }
+            }
+        } else if (*state == WHISPER_PUB_SENT) {
+            if (conn->connected == -1 || now >= e->deadline_ms[r]) {
+                *state = WHISPER_PUB_TIMEOUT;
+                whisper_stats_count(WHISPER_STAT_OK_TIMEOUT, 1);
+            }
+        }
+
+        if (*state == WHISPER_PUB_ACCEPTED) accepted++;
+        if (*state == WHISPER_PUB_UNSENT || *state == WHISPER_PUB_SENT) {
+            outstanding++;
+            int64_t due = e->deadline_ms[r];
+            if (*state == WHISPER_PUB_UNSENT && relay_up(conn) && p->paused_until[r] < due) {
+                due = p->paused_until[r];
+            }
+            if (due < next) next = due;
+        }
+    }
+
+    if (accepted >= p->quorum || outstanding == 0) {
+        e->done = true;
+        return INT64_MAX;
+    }
+    return next;
+}
+
+static void* publisher_main(void* arg) {
+    whisper_publisher* p = (whisper_publisher*)arg;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        int64_t now = whisper_now_ms();
+        int64_t next = INT64_MAX;
+        for (int i = 0; i < p->count; i++) {
+            whisper_pub_entry* e = entry_at(p, i);
+            if (e->done) continue;
+            int64_t due = pump_entry(p, e, now);
+            if (due < next) next = due;
+        }
+
+        /* Report finished entries in submission order */
+        while (p->count > 0 && entry_at(p, 0)->done) {
+            whisper_pub_entry* e = entry_at(p, 0);
+            whisper_publish_result result;
+            fill_result(p, e, &result);
+            pthread_mutex_unlock(&p->lock);
+            if (p->on_done) p->on_done(&result, p->user_data);
+            if (e->event) nostr_event_destroy(e->event);
+            pthread_mutex_lock(&p->lock);
+            e->event = NULL;
+            p->head = (p->head + 1) % p->window;
+            p->count--;
+            pthread_cond_signal(&p->not_full);
+        }
+        if (p->count == 0) {
+            pthread_cond_broadcast(&p->idle);
+            if (p->stopping) break;
+        }
+
+        int wait_ms = -1;
+        if (next != INT64_MAX) {
+            int64_t remaining = next - whisper_now_ms();
+            wait_ms = remaining <= 0 ? 0 : (remaining > 60000 ? 60000 : (int)remaining);
+        }
+        pthread_mutex_unlock(&p->lock);
+        whisper_wakeup_wait(&p->wakeup, wait_ms);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+#endif
+
+int whisper_publisher_start(whisper_publisher* p, whisper_pool* pool, int window, int quorum,
+                            int timeout_ms, whisper_publish_cb on_done, void* user_data) {
+    memset(p, 0, sizeof(*p));
+    p->pool = pool;
+    p->window = window <= 0 ? WHISPER_DEFAULT_WINDOW
+                            : (window > WHISPER_MAX_WINDOW ? WHISPER_MAX_WINDOW : window);
+    p->quorum = quorum < 1 ? 1 : quorum;
+    p->timeout_ms = timeout_ms;
+    p->on_done = on_done;
+    p->user_data = user_data;
+
+#ifndef _WIN32
+    if (whisper_wakeup_init(&p->wakeup) != 0) return -1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->not_full, NULL);
+    pthread_cond_init(&p->idle, NULL);
+    pool->publisher = p;
+    if (pthread_create(&p->thread, NULL, publisher_main, p) != 0) {
+        pool->publisher = NULL;
+        pthread_cond_destroy(&p->not_full);
+        pthread_cond_destroy(&p->idle);
+        pthread_mutex_destroy(&p->lock);
+        whisper_wakeup_destroy(&p->wakeup);
+        return -1;
+    }
+#endif
+    p->started = true;
+    return 0;
+}
+
+int whisper_publisher_submit(whisper_publisher* p, nostr_event* event, void* token) {
+#ifndef _WIN32
+    pthread_mutex_lock(&p->lock);
+    while (p->count == p->window && !p->stopping) {
+        pthread_cond_wait(&p->not_full, &p->lock);
+    }
+    if (p->stopping) {
+        pthread_mutex_unlock(&p->lock);
+        nostr_event_destroy(event);
+        return -1;
+    }
+
+    whisper_pub_entry* e = entry_at(p, p->count);
+    memset(e, 0, sizeof(*e));
+    e->event = event;
+    e->token = token;
+    e->submitted_ms = whisper_now_ms();
+    whisper_event_id_hex(event, e->id);
+    for (int r = 0; r < p->pool->count; r++) {
+        e->deadline_ms[r] = e->submitted_ms + p->timeout_ms;
+    }
+    p->count++;
+    pthread_mutex_unlock(&p->lock);
+    whisper_wakeup_signal(&p->wakeup);
+    return 0;
+#else
+    /* No publisher thread on Windows: one round trip per event */
+    whisper_pub_entry e;
+    memset(&e, 0, sizeof(e));
+    e.event = event;
+    e.token = token;
+    whisper_event_id_hex(event, e.id);
+    whisper_pool_publish(p->pool, event, p->quorum, p->timeout_ms);
+    for (int r = 0; r < p->pool->count; r++) {
+        const whisper_pool_relay* conn = &p->pool->relays[r];
+        e.sends[r] = conn->published ? 1 : 0;
+        if (conn->ok_state == 1) e.state[r] = WHISPER_PUB_ACCEPTED;
+        if (conn->ok_state == -1) {
+            e.state[r] = WHISPER_PUB_REJECTED;
+            if (!e.reason[0]) snprintf(e.reason, sizeof(e.reason), "%s", conn->ok_message);
+        }
+    }
+    whisper_publish_result result;
+    fill_result(p, &e, &result);
+    if (p->on_done) p->on_done(&result, p->user_data);
+    nostr_event_destroy(event);
+    return 0;
+#endif
+}
+
+int whisper_publisher_fail(whisper_publisher* p, int code, const char* error, void* token) {
+#ifndef _WIN32
+    pthread_mutex_lock(&p->lock);
+    while (p->count == p->window && !p->stopping) {
+        pthread_cond_wait(&p->not_full, &p->lock);
+    }
+    if (p->stopping) {
+        pthread_mutex_unlock(&p->lock);
+        return -1;
+    }
+
+    whisper_pub_entry* e = entry_at(p, p->count);
+    memset(e, 0, sizeof(*e));
+    e->token = token;
+    e->code = code;
+    e->done = true;
+    snprintf(e->reason, sizeof(e->reason), "%s", error);
+    p->count++;
+    pthread_mutex_unlock(&p->lock);
+    whisper_wakeup_signal(&p->wakeup);
+    return 0;
+#else
+    whisper_publish_result result;
+    memset(&result, 0, sizeof(result));
+    result.id = "";
+    result.token = token;
+    result.code = code;
+    snprintf(result.error, sizeof(result.error), "%s", error);
+    if (p->on_done) p->on_done(&result, p->user_data);
+    return 0;
+#endif
+}
+
+void whisper_publisher_ok(whisper_publisher* p, int relay, const char* id_hex, bool accepted,
+                          const char* message) {
+#ifndef _WIN32
+    if (relay < 0 || relay >= WHISPER_MAX_RELAYS) return;
+
+    pthread_mutex_lock(&p->lock);
+    for (int i = 0; i < p->count; i++) {
+        whisper_pub_entry* e = entry_at(p, i);
+        if ((e->state[relay] != WHISPER_PUB_SENT && e->state[relay] != WHISPER_PUB_SENDING) ||
+            strcmp(e->id, id_hex) != 0) {
+            continue;
+        }
+        whisper_stats_observe(WHISPER_LAT_OK, whisper_now_us() - e->sent_us[relay]);
+
+        if (accepted || strncmp(message, "duplicate:", 10) == 0) {
+            e->state[relay] = WHISPER_PUB_ACCEPTED;
+            p->backoff_ms[relay] = 0;
+            whisper_stats_count(WHISPER_STAT_OK_ACCEPTED, 1);
+        } else if (strncmp(message, "rate-limited:", 13) == 0 &&
+                   e->sends[relay] < RATE_LIMIT_SENDS) {
+            /* Hold every event for this relay until it has cooled down, then resend */
+            int backoff = p->backoff_ms[relay] ? p->backoff_ms[relay] * 2 : RATE_LIMIT_BACKOFF_MS;
+            if (backoff > RATE_LIMIT_BACKOFF_MAX_MS) backoff = RATE_LIMIT_BACKOFF_MAX_MS;
+            p->backoff_ms[relay] = backoff;
+            p->paused_until[relay] = whisper_now_ms() + backoff;
+            e->state[relay] = WHISPER_PUB_UNSENT;
+            e->deadline_ms[relay] = p->paused_until[relay] + p->timeout_ms;
+            p->rate_limited++;
+        } else {
+            e->state[relay] = WHISPER_PUB_REJECTED;
+            whisper_stats_count(WHISPER_STAT_OK_REJECTED, 1);
+            if (!e->reason[0]) snprintf(e->reason, sizeof(e->reason), "%s", message);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&p->lock);
+    whisper_wakeup_signal(&p->wakeup);
+#else
+    (void)p; (void)relay; (void)id_hex; (void)accepted; (void)message;
+#endif
+}
+
+void whisper_publisher_wake(whisper_publisher* p) {
+#ifndef _WIN32
+    whisper_wakeup_signal(&p->wakeup);
+#else
+    (void)p;
+#endif
+}
+
+void whisper_publisher_drain(whisper_publisher* p) {
+    if (!p->started) return;
+#ifndef _WIN32
+    pthread_mutex_lock(&p->lock);
+    while (p->count > 0) {
+        pthread_cond_wait(&p->idle, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+void whisper_publisher_stop(whisper_publisher* p) {
+    if (!p->started) return;
+#ifndef _WIN32
+    pthread_mutex_lock(&p->lock);
+    p->stopping = true;
+    pthread_cond_broadcast(&p->not_full);
+    pthread_mutex_unlock(&p->lock);
+    whisper_wakeup_signal(&p->wakeup);
+    pthread_join(p->thread, NULL);
+
+    p->pool->publisher = NULL;
+    pthread_cond_destroy(&p->not_full);
+    pthread_cond_destroy(&p->idle);
+    pthread_mutex_destroy(&p->lock);
+    whisper_wakeup_destroy(&p->wakeup);
+#endif
+    p->started = false;
+}
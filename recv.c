@@ -9,97 +9,130 @@
 #include <time.h>
 #ifndef _WIN32
 #include <unistd.h>
-#else
-#include <windows.h>
-#define sleep(x) Sleep((x) * 1000)
 #endif
 #include "whisper.h"
 
+/* Safety net in case the relay drops without a state callback */
+#define RECV_IDLE_CHECK_MS 1000
+
+/* --limit history is fetched newest-first in pages of this many wraps */
+#define RECV_MIN_PAGE 20
+#define RECV_MAX_PAGE 500
+
+/* --flush=batch|none write out once this much output is buffered */
+#define RECV_OUTPUT_HIGH_WATER (64 * 1024)
+
 static volatile sig_atomic_t g_running = 1;
-static volatile sig_atomic_t g_connected = 0;
+static whisper_pool g_pool;
 static int g_message_count = 0;
 
 /* Recv context passed to callbacks */
 typedef struct {
-    nostr_privkey privkey;
-    nostr_key pubkey;
+    nostr_privkey privkeys[WHISPER_MAX_IDENTITIES];
+    nostr_key pubkeys[WHISPER_MAX_IDENTITIES];
+    char npubs[WHISPER_MAX_IDENTITIES][100];         /* set only with several keys */
+    int identity_count;
     bool json_output;
     int limit;
+    whisper_unwrapper unwrap;
+    bool history_partial;                            /* --limit stopped paging early */
+    int64_t cursor_saved[WHISPER_MAX_RELAYS];        /* last cursor written per relay */
+    int relay_count;                                 /* outlives whisper_pool_close */
+    whisper_store store;
+    bool store_backlog;                              /* --store --limit: hold output */
+    int backlog_count;                               /* stored while held */
+    whisper_archive archive;
+    whisper_peer_cache peers;
+    int64_t since;                                   /* --since, for local history */
 } recv_context;
 
 static void signal_handler(int sig) {
     (void)sig;
     g_running = 0;
+    if (g_pool.open) whisper_wakeup_signal(&g_pool.wakeup);
 }
 
-static void relay_state_cb(nostr_relay* relay, nostr_relay_state state, void* user_data) {
-    (void)relay;
+static void message_cb(whisper_pool_relay* conn, const char* message_type,
+                       const char* data, void* user_data) {
     (void)user_data;
-    switch (state) {
-        case NOSTR_RELAY_CONNECTED:    g_connected = 1; break;
-        case NOSTR_RELAY_ERROR:        g_connected = -1; break;
-        case NOSTR_RELAY_DISCONNECTED: g_running = 0; break;
-        default: break;
+    /* EOSE is tracked per relay by the pool (conn->eose) */
+    if (strcmp(message_type, "NOTICE") == 0) {
+        fprintf(stderr, "Relay notice (%s): %s\n", conn->url, data);
     }
 }
 
-static void message_cb(const char* message_type, const char* data, void* user_data) {
-    (void)user_data;
-    if (strcmp(message_type, "EOSE") == 0) {
-        /* End of stored events - now streaming live */
-    } else if (strcmp(message_type, "NOTICE") == 0) {
-        fprintf(stderr, "Relay notice: %s\n", data);
-    }
+/* Output buffer shared by the unwrap workers, drained per --flush policy */
+static struct {
+    whisper_buf buf;
+    whisper_mutex lock;
+    int flush_mode;
+    whisper_parts parts;         /* --split messages still missing parts */
+    whisper_buf joined;
+} g_out;
+
+static void output_init(int flush_mode) {
+    whisper_mutex_init(&g_out.lock);
+    g_out.flush_mode = flush_mode;
 }
 
-static void event_cb(const nostr_event* event, void* user_data) {
-    recv_context* ctx = (recv_context*)user_data;
-
-    if (event->kind != 1059) {
-        return;
+/* Caller holds g_out.lock */
+static void output_drain_locked(bool flush) {
+    if (g_out.buf.len > 0) {
+        fwrite(g_out.buf.data, 1, g_out.buf.len, stdout);
+        g_out.buf.len = 0;
     }
+    if (flush) fflush(stdout);
+}
 
-    nostr_event* rumor = NULL;
-    nostr_key sender_pubkey;
-    nostr_error_t err = nostr_nip17_unwrap_dm(event, &ctx->privkey, &rumor, &sender_pubkey);
+/* Push out anything buffered (--flush=batch calls this every loop tick) */
+static void output_flush(void) {
+    whisper_mutex_lock(&g_out.lock);
+    output_drain_locked(true);
+    whisper_mutex_unlock(&g_out.lock);
+}
 
-    if (err != NOSTR_OK) {
-        return;
-    }
+static void output_close(void) {
+    output_flush();
+    whisper_buf_free(&g_out.buf);
+    whisper_parts_free(&g_out.parts);
+    whisper_buf_free(&g_out.joined);
+    whisper_mutex_destroy(&g_out.lock);
+}
 
-    g_message_count++;
+/* Write one decrypted message to stdout in the selected format; to_npub
+ * names the receiving key when recv listens for several. Returns false
+ * for a --split part held until the rest arrive. */
+static bool print_message(bool json_output, const char* sender_npub, const char* to_npub,
+                          const char* raw_content, int64_t created_at) {
+    whisper_mutex_lock(&g_out.lock);
+    whisper_buf* out = &g_out.buf;
+
+    /* Parts of a --split message print once, joined, when the last arrives */
+    if (raw_content) {
+        int joined = whisper_parts_add(&g_out.parts, sender_npub, raw_content,
+                                       strlen(raw_content), created_at, &g_out.joined,
+                                       &created_at);
+        if (joined == 0) {
+            whisper_mutex_unlock(&g_out.lock);
+            return false;
+        }
+        if (joined == 1) raw_content = g_out.joined.data;
+    }
 
-    if (ctx->json_output) {
-        /* JSON output */
-        char sender_npub[100];
-        nostr_key_to_bech32(&sender_pubkey, "npub", sender_npub, sizeof(sender_npub));
-
-        /* Escape content for JSON */
-        const char* content = rumor->content ? rumor->content : "";
-        printf("{\"from\":\"%s\",\"content\":\"", sender_npub);
-        for (const char* p = content; *p; p++) {
-            switch (*p) {
-                case '"': printf("\\\""); break;
-                case '\\': printf("\\\\"); break;
-                case '\n': printf("\\n"); break;
-                case '\r': printf("\\r"); break;
-                case '\t': printf("\\t"); break;
-                default:
-                    if ((unsigned char)*p < 32) {
-                        printf("\\u%04x", (unsigned char)*p);
-                    } else {
-                        putchar(*p);
-                    }
-            }
+    if (json_output) {
+        const char* content = raw_content ? raw_content : "";
+        whisper_buf_puts(out, "{\"from\":\"");
+        whisper_buf_append_json(out, sender_npub, strlen(sender_npub));
+        if (to_npub) {
+            whisper_buf_puts(out, "\",\"to\":\"");
+            whisper_buf_append_json(out, to_npub, strlen(to_npub));
         }
-        printf("\",\"created_at\":%lld}\n", (long long)rumor->created_at);
+        whisper_buf_puts(out, "\",\"content\":\"");
+        whisper_buf_append_json(out, content, strlen(content));
+        whisper_buf_printf(out, "\",\"created_at\":%lld}\n", (long long)created_at);
     } else {
-        /* Human-readable output */
-        char sender_npub[100];
-        nostr_key_to_bech32(&sender_pubkey, "npub", sender_npub, sizeof(sender_npub));
-
         /* Format timestamp */
-        time_t ts = (time_t)rumor->created_at;
+        time_t ts = (time_t)created_at;
         struct tm tm_buf;
         struct tm* tm_info = localtime_r(&ts, &tm_buf);
         char time_str[32];
@@ -113,25 +146,362 @@ static void event_cb(const nostr_event* event, void* user_data) {
         char short_npub[16];
         snprintf(short_npub, sizeof(short_npub), "%.12s...", sender_npub);
 
-        const char* raw_content = rumor->content ? rumor->content : "(empty)";
-        char* content = whisper_strip_control_chars(raw_content);
-        printf("%s %s %s\n", time_str, short_npub, content ? content : "(empty)");
-        free(content);
+        /* Filter straight into the output buffer, no per-message copy */
+        const char* content = raw_content ? raw_content : "(empty)";
+        size_t len = strlen(content);
+        if (to_npub) {
+            whisper_buf_printf(out, "%s %s to %.12s... ", time_str, short_npub, to_npub);
+        } else {
+            whisper_buf_printf(out, "%s %s ", time_str, short_npub);
+        }
+        if (whisper_buf_reserve(out, len + 1) == 0) {
+            out->len += whisper_strip_control_chars_into(content, len, out->data + out->len);
+        }
+        whisper_buf_puts(out, "\n");
+    }
+
+    if (g_out.flush_mode == WHISPER_FLUSH_LINE) {
+        output_drain_locked(true);
+    } else if (out->len >= RECV_OUTPUT_HIGH_WATER) {
+        output_drain_locked(g_out.flush_mode == WHISPER_FLUSH_BATCH);
+    }
+    whisper_mutex_unlock(&g_out.lock);
+    return true;
+}
+
+/* Runs once per distinct gift wrap; decryption happens on the workers */
+static void event_cb(whisper_pool_relay* conn, const nostr_event* event, void* user_data) {
+    recv_context* ctx = (recv_context*)user_data;
+
+    /* Already in the local store: skip the decryption entirely */
+    if (ctx->store.open && !whisper_store_claim(&ctx->store, event->id)) return;
+
+    /* The p tag says whose wrap it is, so each is decrypted with one key */
+    whisper_unwrap_submit(&ctx->unwrap, event,
+                          whisper_prefilter_recipient(&conn->pool->filter, event));
+}
+
+/* Called by the unwrap workers, one rumor at a time */
+static void rumor_cb(const whisper_unwrapped* msg, void* user_data) {
+    const nostr_event* rumor = msg->rumor;
+    const nostr_key* sender = &msg->sender;
+    recv_context* ctx = (recv_context*)user_data;
+
+    char sender_npub[100];
+    whisper_peer_npub(&ctx->peers, sender, sender_npub, sizeof(sender_npub));
+
+    /* Store even past --limit so the cursor never skips a message */
+    if (ctx->store.open) whisper_store_append(&ctx->store, msg, sender_npub);
+    if (ctx->archive.open) {
+        whisper_archive_append(&ctx->archive, msg, &ctx->pubkeys[msg->identity]);
+    }
+
+    /* Printed from the store with the rest of the newest --limit */
+    if (ctx->store_backlog) {
+        ctx->backlog_count++;
+        return;
+    }
+
+    if (ctx->limit > 0 && g_message_count >= ctx->limit) {
+        return;
     }
 
-    fflush(stdout);
-    nostr_event_destroy(rumor);
+    /* A --split message counts once, when it prints whole */
+    if (!print_message(ctx->json_output, sender_npub,
+                       ctx->identity_count > 1 ? ctx->npubs[msg->identity] : NULL,
+                       rumor->content, rumor->created_at)) {
+        return;
+    }
+    g_message_count++;
 
     /* Check limit */
     if (ctx->limit > 0 && g_message_count >= ctx->limit) {
         g_running = 0;
+        whisper_wakeup_signal(&g_pool.wakeup);
     }
 }
 
+/* History served from the local store before any relay is contacted */
+static void stored_cb(const char* from_npub, const char* content, int64_t created_at,
+                      void* user_data) {
+    recv_context* ctx = (recv_context*)user_data;
+    if (created_at < ctx->since) return;
+    if (ctx->limit > 0 && g_message_count >= ctx->limit) return;
+
+    if (print_message(ctx->json_output, from_npub, NULL, content, created_at)) {
+        g_message_count++;
+    }
+}
+
+/* One message of the newest --limit, collected from the store */
+typedef struct {
+    char* from;
+    char* content;
+    int64_t created_at;
+} stored_message;
+
+typedef struct {
+    stored_message* items;
+    int count;
+    int cap;
+    int messages;                /* items that start a message (see below) */
+    bool full;                   /* out of memory: stop collecting */
+    int64_t since;
+} stored_page;
+
+static void stored_page_cb(const uint8_t wrap_id[32], const char* from_npub,
+                           const char* content, int64_t created_at, void* user_data) {
+    (void)wrap_id;
+    stored_page* page = (stored_page*)user_data;
+    if (created_at < page->since || page->full) return;
+    if (page->count == page->cap) {
+        int cap = page->cap ? page->cap * 2 : RECV_MIN_PAGE;
+        stored_message* grown = realloc(page->items, (size_t)cap * sizeof(*grown));
+        if (!grown) {
+            page->full = true;
+            return;
+        }
+        page->items = grown;
+        page->cap = cap;
+    }
+
+    stored_message* m = &page->items[page->count];
+    m->from = strdup(from_npub);
+    m->content = content ? strdup(content) : NULL;
+    if (!m->from || (content && !m->content)) {
+        free(m->from);
+        free(m->content);
+        return;
+    }
+    m->created_at = created_at;
+    page->count++;
+
+    /* Parts after the first of a --split message are not one more */
+    unsigned int group;
+    int index = 0, total;
+    if (!content || whisper_part_parse(content, strlen(content), &group, &index, &total) == 0 ||
+        index == 1) {
+        page->messages++;
+    }
+}
+
+static int compare_stored(const void* a, const void* b) {
+    int64_t x = ((const stored_message*)a)->created_at;
+    int64_t y = ((const stored_message*)b)->created_at;
+    return (x > y) - (x < y);
+}
+
+/*
+ * --store --limit: once the relays have caught up, everything new is in
+ * the store, so print its newest --limit messages oldest first. Later
+ * rumors print live as usual.
+ */
+static void print_stored_backlog(recv_context* ctx, const char* dir) {
+    if (!ctx->store_backlog) return;
+
+    bool locked = ctx->unwrap.started;
+    if (locked) {
+        whisper_unwrap_wait_idle(&ctx->unwrap);
+        whisper_mutex_lock(&ctx->unwrap.deliver_lock);
+    }
+    ctx->store_backlog = false;
+
+    int want = ctx->limit - g_message_count;
+    stored_page page = {0};
+    page.since = ctx->since;
+
+    /* Pages come newest wrap first; --since only ever trims the tail */
+    whisper_store_pager pager;
+    if (want > 0 && whisper_store_pager_open(&pager, dir, &ctx->pubkeys[0]) == 0) {
+        while (page.messages < want && !page.full &&
+               whisper_store_pager_next(&pager, want - page.messages, stored_page_cb,
+                                        &page) > 0) {
+            if (ctx->since > 0 && pager.next < pager.count &&
+                pager.entries[pager.next].wrap_at + WHISPER_NIP59_SKEW_S < ctx->since) {
+                break;
+            }
+        }
+        whisper_store_pager_close(&pager);
+    }
+
+    /* The newest want messages, a --split one with all of its parts */
+    if (page.count > 1) qsort(page.items, (size_t)page.count, sizeof(*page.items), compare_stored);
+    const char** contents = page.count > 0 ? malloc((size_t)page.count * sizeof(*contents)) : NULL;
+    bool* keep = page.count > 0 ? malloc((size_t)page.count * sizeof(*keep)) : NULL;
+    if (contents && keep) {
+        for (int i = 0; i < page.count; i++) contents[i] = page.items[i].content;
+        whisper_parts_keep_newest(contents, (size_t)page.count, (size_t)want, keep);
+    }
+    for (int i = 0; i < page.count; i++) {
+        stored_message* m = &page.items[i];
+        bool wanted = (contents && keep) ? keep[i] : i + want >= page.count;
+        if (wanted && print_message(ctx->json_output, m->from, NULL, m->content,
+                                    m->created_at)) {
+            g_message_count++;
+        }
+        if (m->content) secure_wipe(m->content, strlen(m->content));
+        free(m->from);
+        free(m->content);
+    }
+    free(contents);
+    free(keep);
+    free(page.items);
+
+    if (locked) whisper_mutex_unlock(&ctx->unwrap.deliver_lock);
+}
+
+/* Advance the store cursor of each relay that has delivered all stored
+ * events to the newest wrap it sent, once that has been decrypted and
+ * written. Called every tick and at exit; writes only cursors that moved,
+ * and leaves them for a later tick while the workers are still busy. */
+static void save_cursors(recv_context* ctx) {
+    if (!ctx->store.open || ctx->unwrap.ordered || ctx->history_partial) return;
+
+    int64_t since[WHISPER_MAX_RELAYS];
+    bool moved = false;
+    bool live = g_pool.open;     /* at exit the relays are closed already */
+    if (live) whisper_mutex_lock(&g_pool.event_lock);
+    for (int i = 0; i < ctx->relay_count; i++) {
+        const whisper_pool_relay* conn = &g_pool.relays[i];
+        since[i] = 0;
+        if (!conn->eose) continue;
+        /* Never past a wrap the rate cap dropped: the next run fetches it */
+        since[i] = conn->newest_created_at;
+        if (conn->rate_floor > 0 && since[i] >= conn->rate_floor) since[i] = conn->rate_floor - 1;
+        if (since[i] > ctx->cursor_saved[i]) moved = true;
+    }
+    if (live) whisper_mutex_unlock(&g_pool.event_lock);
+
+    /* Everything those bounds cover was queued before we read them */
+    if (!moved || !whisper_unwrap_idle(&ctx->unwrap)) return;
+    for (int i = 0; i < ctx->relay_count; i++) {
+        if (since[i] <= ctx->cursor_saved[i]) continue;
+        whisper_store_set_cursor(&ctx->store, g_pool.relays[i].url, since[i]);
+        ctx->cursor_saved[i] = since[i];
+    }
+}
+
+/* True once every subscribed relay has finished sending stored events */
+static bool backlog_done(void) {
+    for (int i = 0; i < g_pool.count; i++) {
+        const whisper_pool_relay* conn = &g_pool.relays[i];
+        if (conn->subscribed && conn->connected == 1 && !conn->eose) return false;
+    }
+    return true;
+}
+
+/* Messages printed or decrypted and waiting for --ordered release */
+static int messages_so_far(recv_context* ctx) {
+    whisper_unwrap_wait_idle(&ctx->unwrap);
+    whisper_mutex_lock(&ctx->unwrap.deliver_lock);
+    int n = g_message_count + ctx->backlog_count + (int)ctx->unwrap.held_count;
+    whisper_mutex_unlock(&ctx->unwrap.deliver_lock);
+    return n;
+}
+
+/* --ordered: print the held backlog, newest --limit of it if set */
+static void release_backlog(recv_context* ctx) {
+    size_t max_count = 0;
+    if (ctx->limit > g_message_count) max_count = (size_t)(ctx->limit - g_message_count);
+    whisper_unwrap_release(&ctx->unwrap, max_count);
+}
+
+static int page_size(int remaining) {
+    if (remaining < RECV_MIN_PAGE) return RECV_MIN_PAGE;
+    if (remaining > RECV_MAX_PAGE) return RECV_MAX_PAGE;
+    return remaining;
+}
+
+/*
+ * --limit: the first page came with the live subscription. Walk further
+ * back with one-shot until= queries until the limit is met or relays run
+ * out of history. Returns true if history was exhausted.
+ */
+static bool fetch_history(recv_context* ctx, int64_t since, int first_limit, int timeout_ms) {
+    int64_t until = 0;
+    bool exhausted = true;
+
+    /* Every relay sent fewer than asked for: there is no older page */
+    whisper_mutex_lock(&g_pool.event_lock);
+    for (int i = 0; i < g_pool.count; i++) {
+        const whisper_pool_relay* conn = &g_pool.relays[i];
+        if (conn->oldest_created_at > until) until = conn->oldest_created_at;
+        if (conn->events_received >= (unsigned long)first_limit) exhausted = false;
+    }
+    whisper_mutex_unlock(&g_pool.event_lock);
+    if (until == 0 || exhausted) return true;
+
+    for (int page = 1; g_running; page++) {
+        int remaining = ctx->limit - messages_so_far(ctx);
+        if (remaining <= 0) return false;
+
+        char sub_id[32];
+        snprintf(sub_id, sizeof(sub_id), "dm-page-%d", page);
+        if (whisper_pool_fetch_older(&g_pool, sub_id, since, &until, page_size(remaining),
+                                     timeout_ms, &exhausted) < 0) {
+            return false;
+        }
+        if (exhausted) return true;
+    }
+    return false;
+}
+
+/* Thin client: attach to a running daemon's live stream */
+static int recv_via_daemon(const whisper_recv_config* config) {
+    int fd = whisper_daemon_connect(config->socket_path);
+    if (fd < 0) return WHISPER_EXIT_RELAY_ERROR;
+
+    cJSON* req = cJSON_CreateObject();
+    if (!req) {
+        close(fd);
+        return WHISPER_EXIT_RELAY_ERROR;
+    }
+    cJSON_AddStringToObject(req, "op", "recv");
+    cJSON_AddNumberToObject(req, "since", (double)config->since);
+    int rc = whisper_daemon_request(fd, req);
+    cJSON_Delete(req);
+
+    FILE* in = rc == 0 ? fdopen(fd, "r") : NULL;
+    if (!in) {
+        close(fd);
+        fprintf(stderr, "Error: Failed to talk to whisper daemon\n");
+        return WHISPER_EXIT_RELAY_ERROR;
+    }
+
+    int ret = WHISPER_EXIT_OK;
+    cJSON* msg;
+    while (g_running && (msg = whisper_daemon_read(in)) != NULL) {
+        const cJSON* from = cJSON_GetObjectItemCaseSensitive(msg, "from");
+        const cJSON* to = cJSON_GetObjectItemCaseSensitive(msg, "to");
+        const cJSON* content = cJSON_GetObjectItemCaseSensitive(msg, "content");
+        const cJSON* created_at = cJSON_GetObjectItemCaseSensitive(msg, "created_at");
+        const cJSON* error = cJSON_GetObjectItemCaseSensitive(msg, "error");
+
+        if (cJSON_IsString(error)) {
+            fprintf(stderr, "Error: %s\n", error->valuestring);
+            ret = WHISPER_EXIT_RELAY_ERROR;
+            cJSON_Delete(msg);
+            break;
+        }
+        if (cJSON_IsString(from) &&
+            print_message(config->json_output, from->valuestring,
+                          cJSON_IsString(to) ? to->valuestring : NULL,
+                          cJSON_IsString(content) ? content->valuestring : NULL,
+                          cJSON_IsNumber(created_at) ? (int64_t)created_at->valuedouble : 0)) {
+            g_message_count++;
+        }
+        cJSON_Delete(msg);
+
+        if (config->limit > 0 && g_message_count >= config->limit) break;
+    }
+
+    fclose(in);
+    return ret;
+}
+
 int whisper_recv(const whisper_recv_config* config) {
     int ret = WHISPER_EXIT_OK;
     recv_context ctx = {0};
-    nostr_relay* relay = NULL;
 
     /* Set up signal handler for clean shutdown */
 #ifndef _WIN32
@@ -146,94 +516,180 @@ int whisper_recv(const whisper_recv_config* config) {
     signal(SIGTERM, signal_handler);
 #endif
 
+    output_init(config->flush_mode);
+
+    if (config->socket_path) {
+        ret = recv_via_daemon(config);
+        output_close();
+        return ret;
+    }
+
     /* Initialize libnostr */
     if (nostr_init() != NOSTR_OK) {
         fprintf(stderr, "Error: Failed to initialize libnostr\n");
+        output_close();
         return WHISPER_EXIT_CRYPTO_ERROR;
     }
 
-    /* Load private key */
-    if (whisper_load_privkey(config->nsec, config->nsec_file, &ctx.privkey, &ctx.pubkey) != 0) {
+    /* Load private keys, one per identity */
+    ctx.identity_count = whisper_load_identities(config->keys, config->key_count, config->nsec,
+                                                 config->nsec_file, ctx.privkeys, ctx.pubkeys);
+    if (ctx.identity_count <= 0) {
         fprintf(stderr, "Error: Failed to load private key\n");
+        ctx.identity_count = 0;
         ret = WHISPER_EXIT_KEY_ERROR;
         goto cleanup;
     }
+    if (ctx.identity_count > 1) {
+        for (int i = 0; i < ctx.identity_count; i++) {
+            nostr_key_to_bech32(&ctx.pubkeys[i], "npub", ctx.npubs[i], sizeof(ctx.npubs[i]));
+        }
+    }
 
     ctx.json_output = config->json_output;
     ctx.limit = config->limit;
+    ctx.since = config->since;
+
+    /* Serve what we already have from disk, then only ask relays for the rest */
+    int64_t since = config->since;
+    if (config->store_dir) {
+        /* The store and its cursors belong to one key */
+        if (ctx.identity_count > 1) {
+            fprintf(stderr, "Error: --store takes a single key\n");
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
+        /* --limit wants the newest, which may still be on the relays;
+         * they are printed from the store once those have caught up */
+        ctx.store_backlog = ctx.limit > 0;
+        if (whisper_store_open(&ctx.store, config->store_dir, &ctx.pubkeys[0],
+                               ctx.store_backlog ? NULL : stored_cb, &ctx) != 0) {
+            ctx.store_backlog = false;
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
 
-    /* Connect to relay */
-    if (nostr_relay_create(&relay, config->relay_url) != NOSTR_OK) {
-        fprintf(stderr, "Error: Failed to create relay\n");
-        ret = WHISPER_EXIT_RELAY_ERROR;
-        goto cleanup;
+        int64_t cursor = whisper_store_since(&ctx.store, config->relay_urls,
+                                             config->relay_count);
+        if (cursor > since) since = cursor;
     }
 
-    nostr_relay_set_message_callback(relay, message_cb, NULL);
+    if (config->archive_dir && whisper_archive_open(&ctx.archive, config->archive_dir) != 0) {
+        ret = WHISPER_EXIT_INVALID_ARGS;
+        goto cleanup;
+    }
 
-    if (nostr_relay_connect(relay, relay_state_cb, NULL) != NOSTR_OK) {
+    if (whisper_peer_cache_init(&ctx.peers, 0) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        ret = WHISPER_EXIT_CRYPTO_ERROR;
+        goto cleanup;
+    }
+    whisper_unwrap_start(&ctx.unwrap, ctx.privkeys, ctx.identity_count, config->jobs,
+                         config->ordered, rumor_cb, &ctx);
+
+    /* Connect to all relays in parallel */
+    g_pool.on_message = message_cb;
+    g_pool.on_event = event_cb;
+    g_pool.user_data = &ctx;
+    whisper_prefilter_init(&g_pool.filter, &ctx.pubkeys[0], since, config->rate_cap);
+    for (int i = 1; i < ctx.identity_count; i++) {
+        whisper_prefilter_add(&g_pool.filter, &ctx.pubkeys[i]);
+    }
+    if (whisper_pool_open(&g_pool, config->relay_urls, config->relay_count) <= 0) {
         fprintf(stderr, "Error: Failed to connect to relay\n");
         ret = WHISPER_EXIT_RELAY_ERROR;
         goto cleanup;
     }
+    ctx.relay_count = g_pool.count;
 
-    /* Wait for connection - use sleep() to let libwebsockets process events */
-    int wait_sec = 0;
-    int timeout_sec = (config->timeout_ms + 999) / 1000;
-    while (g_connected == 0 && wait_sec < timeout_sec) {
-        sleep(1);
-        wait_sec++;
-        if (g_connected == -1) {
+    /* Start streaming as soon as one relay is up; others join when ready */
+    if (whisper_pool_wait_connected(&g_pool, 1, config->timeout_ms) == 0) {
+        bool failed = false;
+        for (int i = 0; i < g_pool.count; i++) {
+            if (g_pool.relays[i].connected == -1) failed = true;
+        }
+        if (failed) {
             fprintf(stderr, "Error: Relay connection failed\n");
             ret = WHISPER_EXIT_RELAY_ERROR;
-            goto cleanup;
+        } else {
+            fprintf(stderr, "Error: Relay connection timeout (try increasing --timeout)\n");
+            ret = WHISPER_EXIT_TIMEOUT;
         }
-    }
-
-    if (g_connected != 1) {
-        fprintf(stderr, "Error: Relay connection timeout (try increasing --timeout)\n");
-        ret = WHISPER_EXIT_TIMEOUT;
         goto cleanup;
     }
 
-    /* Build subscription filter for gift wrap events addressed to us */
-    char pubkey_hex[65];
-    nostr_key_to_hex(&ctx.pubkey, pubkey_hex, sizeof(pubkey_hex));
-
-    char filter[512];
-    if (config->since > 0) {
-        snprintf(filter, sizeof(filter),
-            "{\"kinds\":[1059],\"#p\":[\"%s\"],\"since\":%lld}",
-            pubkey_hex, (long long)config->since);
-    } else {
-        snprintf(filter, sizeof(filter),
-            "{\"kinds\":[1059],\"#p\":[\"%s\"]}",
-            pubkey_hex);
+    /* With --limit the relays only send the newest page (see fetch_history) */
+    int first_limit = 0;
+    if (ctx.limit > 0) {
+        first_limit = page_size(ctx.limit - g_message_count);
     }
 
+    /* One subscription for gift wraps addressed to any of our keys */
+    char filter[WHISPER_DM_FILTER_SIZE];
+    whisper_dm_filter(filter, sizeof(filter), &g_pool.filter, since, 0, first_limit);
+
     /* Subscribe */
-    if (nostr_subscribe(relay, "dm-inbox", filter, event_cb, &ctx) != NOSTR_OK) {
+    if (whisper_pool_subscribe(&g_pool, "dm-inbox", filter) <= 0) {
         fprintf(stderr, "Error: Failed to subscribe\n");
         ret = WHISPER_EXIT_RELAY_ERROR;
         goto cleanup;
     }
 
-    /* Main loop - wait for messages */
-    while (g_running && relay->state == NOSTR_RELAY_CONNECTED) {
-        sleep(1);
-    }
+    /* Main loop - wait for messages, subscribing late relays as they connect
+     * and resuming dropped ones as they come back */
+    int64_t backlog_deadline = whisper_now_ms() + config->timeout_ms;
+    bool history_done = false;
+    int retry_ms = 0;
+    while (g_running && retry_ms >= 0) {
+        whisper_wakeup_wait(&g_pool.wakeup, retry_ms > 0 && retry_ms < RECV_IDLE_CHECK_MS
+                                                ? retry_ms : RECV_IDLE_CHECK_MS);
+        retry_ms = whisper_pool_maintain(&g_pool);
+        whisper_pool_subscribe(&g_pool, "dm-inbox", filter);
+
+        if (!history_done && (backlog_done() || whisper_now_ms() >= backlog_deadline)) {
+            history_done = true;
+
+            if (ctx.limit > 0 &&
+                !fetch_history(&ctx, since, first_limit, config->timeout_ms)) {
+                ctx.history_partial = true;
+            }
 
-cleanup:
-    /* Secure wipe private key */
-    secure_wipe(&ctx.privkey, sizeof(ctx.privkey));
+            /* --ordered: print the stored backlog sorted once relays are done */
+            if (ctx.unwrap.ordered) release_backlog(&ctx);
+            print_stored_backlog(&ctx, config->store_dir);
 
-    if (relay) {
-        if (relay->state == NOSTR_RELAY_CONNECTED) {
-            nostr_relay_unsubscribe(relay, "dm-inbox");
+            /* Limit met from stored events: EOSE ends the run */
+            if (ctx.limit > 0 && g_message_count >= ctx.limit) break;
         }
-        /* Let nostr_relay_destroy handle cleanup - it checks state internally */
-        nostr_relay_destroy(relay);
+        save_cursors(&ctx);
+
+        if (config->flush_mode == WHISPER_FLUSH_BATCH) output_flush();
+    }
+
+    /* Relays gone before EOSE: still print what was decrypted, in order */
+    if (g_running && ctx.unwrap.ordered) {
+        release_backlog(&ctx);
     }
+
+cleanup:
+    /* Close relays first so no callback can still see the key */
+    whisper_pool_close(&g_pool);
+    whisper_unwrap_stop(&ctx.unwrap);
+
+    /* Relays gone before they caught up: print what the store has */
+    if (g_running) print_stored_backlog(&ctx, config->store_dir);
+
+    /* Everything queued has now been written; a held --ordered backlog
+     * that was never printed was never stored either */
+    save_cursors(&ctx);
+    whisper_store_close(&ctx.store);
+    whisper_archive_close(&ctx.archive);
+    whisper_peer_cache_destroy(&ctx.peers);
+    output_close();
+
+    /* Secure wipe private keys */
+    secure_wipe(ctx.privkeys, sizeof(ctx.privkeys));
+
     nostr_cleanup();
 
     return ret;
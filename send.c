@@ -6,184 +6,533 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #ifndef _WIN32
 #include <unistd.h>
-#else
-#include <windows.h>
-#define sleep(x) Sleep((x) * 1000)
+#include <fcntl.h>
 #endif
 #include "whisper.h"
 
 #define MAX_MESSAGE_SIZE (64 * 1024)  /* 64KB max message */
 
-static volatile sig_atomic_t g_published = 0;
-static volatile sig_atomic_t g_connected = 0;
+/* --split part text; the rest of MAX_MESSAGE_SIZE is room for the header
+ * and the rumor's JSON escaping inside the seal */
+#define SEND_PART_SIZE (32 * 1024)
+#define SEND_STDIN_CHUNK 4096
+
+/* Relays for this send; --prewarm opens them before main resolves the key */
+static whisper_pool g_pool;
+static bool g_nostr_ready;
 
-static void relay_state_cb(nostr_relay* relay, nostr_relay_state state, void* user_data) {
-    (void)relay;
+static void message_cb(whisper_pool_relay* conn, const char* message_type,
+                       const char* data, void* user_data) {
     (void)user_data;
-    switch (state) {
-        case NOSTR_RELAY_CONNECTED: g_connected = 1; break;
-        case NOSTR_RELAY_ERROR:     g_connected = -1; break;
-        default: break;
+    if (strcmp(message_type, "NOTICE") == 0) {
+        fprintf(stderr, "Relay notice (%s): %s\n", conn->url, data);
     }
 }
 
-static void message_cb(const char* message_type, const char* data, void* user_data) {
-    (void)user_data;
-    if (strcmp(message_type, "OK") == 0) {
-        g_published = 1;
-    } else if (strcmp(message_type, "NOTICE") == 0) {
-        fprintf(stderr, "Relay notice: %s\n", data);
+/* Read stdin into b, which grows with the input. Fails rather than
+ * truncates: longer than one DM takes --split, and --split has a limit
+ * too. Returns an exit code. */
+static int read_stdin(whisper_buf* b, bool split) {
+    /* A part may end up to 3 bytes short to keep a UTF-8 sequence whole */
+    size_t max = split ? (size_t)WHISPER_PARTS_MAX * (SEND_PART_SIZE - 3) : MAX_MESSAGE_SIZE - 1;
+
+    b->len = 0;
+    for (;;) {
+        if (whisper_buf_reserve(b, SEND_STDIN_CHUNK + 1) != 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return WHISPER_EXIT_CRYPTO_ERROR;
+        }
+        size_t n = fread(b->data + b->len, 1, b->cap - b->len - 1, stdin);
+        if (n == 0) break;
+        b->len += n;
+        if (b->len > max + 2) break;  /* room for a trailing CRLF */
+    }
+
+    /* Trim trailing newline */
+    while (b->len > 0 && (b->data[b->len-1] == '\n' || b->data[b->len-1] == '\r')) b->len--;
+    b->data[b->len] = '\0';
+
+    if (b->len > max) {
+        if (split) {
+            fprintf(stderr, "Error: Message too large (max %zu bytes with --split)\n", max);
+        } else {
+            fprintf(stderr, "Error: Message too large (max %zu bytes; --split sends it as "
+                    "several DMs)\n", max);
+        }
+        return WHISPER_EXIT_INVALID_ARGS;
+    }
+    if (b->len == 0) {
+        fprintf(stderr, "Error: No message content (pipe message via stdin)\n");
+        return WHISPER_EXIT_INVALID_ARGS;
     }
+    return WHISPER_EXIT_OK;
 }
 
-/* Read all stdin into buffer */
-static char* read_stdin(size_t* out_len) {
-    char* buf = malloc(MAX_MESSAGE_SIZE);
-    if (!buf) return NULL;
+/* Number of DMs content goes out as: 1 if it fits, else --split parts cut
+ * at UTF-8 boundaries, their ends in ends[]. -1 if it takes more than
+ * WHISPER_PARTS_MAX parts. */
+static int plan_parts(const char* content, size_t len, size_t ends[WHISPER_PARTS_MAX]) {
+    if (len < MAX_MESSAGE_SIZE) {
+        ends[0] = len;
+        return 1;
+    }
+    int count = 0;
+    size_t pos = 0;
+    while (pos < len && count < WHISPER_PARTS_MAX) {
+        pos += whisper_utf8_cut(content + pos, len - pos, SEND_PART_SIZE);
+        ends[count++] = pos;
+    }
+    if (pos < len) {
+        fprintf(stderr, "Error: Message too large (more than %d parts with --split)\n",
+                WHISPER_PARTS_MAX);
+        return -1;
+    }
+    return count;
+}
 
-    size_t total = 0;
-    size_t n;
-    while ((n = fread(buf + total, 1, MAX_MESSAGE_SIZE - total - 1, stdin)) > 0) {
-        total += n;
-        if (total >= MAX_MESSAGE_SIZE - 1) break;
+/* Tag shared by the parts of one message; only needs to differ between
+ * multipart messages from the same sender */
+static unsigned int part_group(void) {
+    unsigned int group = 0;
+#ifndef _WIN32
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (read(fd, &group, sizeof(group)) != (ssize_t)sizeof(group)) group = 0;
+        close(fd);
     }
-    buf[total] = '\0';
+    if (group == 0) group = (unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16);
+#else
+    group = (unsigned int)time(NULL) ^ (unsigned int)GetTickCount();
+#endif
+    return group;
+}
 
-    /* Trim trailing newline */
-    while (total > 0 && (buf[total-1] == '\n' || buf[total-1] == '\r')) {
-        buf[--total] = '\0';
+/* Content of DM i of count: the whole message, or a headed part */
+static int part_content(whisper_buf* out, const char* content, const size_t ends[],
+                        int i, int count, unsigned int group) {
+    size_t start = i > 0 ? ends[i - 1] : 0;
+    out->len = 0;
+    if (count > 1) {
+        char header[WHISPER_PART_HEADER_MAX];
+        int n = whisper_part_header(header, sizeof(header), group, i + 1, count);
+        if (whisper_buf_append(out, header, (size_t)n) != 0) return -1;
+    }
+    if (whisper_buf_append(out, content + start, ends[i] - start) != 0 ||
+        whisper_buf_append(out, "", 1) != 0) {
+        return -1;
+    }
+    out->len--;
+    return 0;
+}
+
+/* Open the relays unless --prewarm already did, then wait for one */
+static int connect_relays(whisper_pool* pool, const whisper_send_config* config) {
+    if (!pool->open) {
+        pool->on_message = message_cb;
+        if (whisper_pool_open(pool, config->relay_urls, config->relay_count) <= 0) {
+            fprintf(stderr, "Error: Failed to connect to relay\n");
+            return WHISPER_EXIT_RELAY_ERROR;
+        }
+    }
+
+    /* Publishing starts as soon as the first relay is up; the rest join in */
+    if (whisper_pool_wait_connected(pool, 1, config->timeout_ms) > 0) {
+        return WHISPER_EXIT_OK;
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->relays[i].connected == -1) {
+            fprintf(stderr, "Error: Relay connection failed\n");
+            return WHISPER_EXIT_RELAY_ERROR;
+        }
     }
+    fprintf(stderr, "Error: Relay connection timeout (try increasing --timeout)\n");
+    return WHISPER_EXIT_TIMEOUT;
+}
 
-    *out_len = total;
-    return buf;
+/* Copy an optional string field out of a batch record */
+static const char* batch_field(const cJSON* record, const char* name, const char* fallback) {
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(record, name);
+    if (cJSON_IsString(item) && item->valuestring) return item->valuestring;
+    return fallback;
 }
 
-int whisper_send(const whisper_send_config* config) {
-    int ret = WHISPER_EXIT_OK;
-    nostr_privkey privkey;
-    nostr_key sender_pubkey;
-    nostr_key recipient_pubkey;
-    nostr_event* dm = NULL;
-    nostr_relay* relay = NULL;
-    char* content = NULL;
+/* Batch records flow stdin -> wrap workers -> publisher -> stdout, in order */
+typedef struct {
+    whisper_wrapper wrap;
+    whisper_publisher publisher;
+    int ret;
+} batch_pipeline;
+
+/* Wrap worker: pass the record on, failures included, to keep its place */
+static void batch_wrapped(const whisper_wrapped* result, void* user_data) {
+    batch_pipeline* b = (batch_pipeline*)user_data;
+    if (result->event) {
+        whisper_publisher_submit(&b->publisher, result->event, NULL);
+    } else {
+        whisper_publisher_fail(&b->publisher, result->code, result->error, NULL);
+    }
+}
+
+/* Publisher thread: report one batch record, in input order */
+static void batch_done(const whisper_publish_result* result, void* user_data) {
+    batch_pipeline* b = (batch_pipeline*)user_data;
+    if (result->code == WHISPER_EXIT_OK) {
+        printf("%s\n", result->id);
+    } else {
+        printf("error: %s\n", result->error);
+        b->ret = result->code;
+    }
+    fflush(stdout);
+}
+
+/*
+ * Batch mode: one NDJSON record per stdin line, published over the
+ * already-open connection. Prints an event id or "error: ..." per line.
+ * Later lines are wrapped on config->jobs workers while up to
+ * config->window events await their OKs.
+ */
+static int send_batch(whisper_pool* pool, const whisper_send_config* config,
+                      const nostr_privkey* privkey) {
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    batch_pipeline b;
 
-    /* Initialize libnostr */
-    if (nostr_init() != NOSTR_OK) {
-        fprintf(stderr, "Error: Failed to initialize libnostr\n");
+    /* Batches usually address a handful of peers over and over */
+    whisper_peer_cache peers;
+    if (whisper_peer_cache_init(&peers, 0) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
         return WHISPER_EXIT_CRYPTO_ERROR;
     }
+    b.ret = WHISPER_EXIT_OK;
+    if (whisper_publisher_start(&b.publisher, pool, config->window, config->quorum,
+                                config->timeout_ms, batch_done, &b) != 0) {
+        fprintf(stderr, "Error: Failed to start publisher\n");
+        whisper_peer_cache_destroy(&peers);
+        return WHISPER_EXIT_RELAY_ERROR;
+    }
+    whisper_wrap_start(&b.wrap, privkey, config->jobs, batch_wrapped, &b);
 
-    /* Load sender private key */
-    if (whisper_load_privkey(config->nsec, config->nsec_file, &privkey, &sender_pubkey) != 0) {
-        fprintf(stderr, "Error: Failed to load private key\n");
-        ret = WHISPER_EXIT_KEY_ERROR;
-        goto cleanup;
+    while ((line_len = getline(&line, &line_cap, stdin)) != -1) {
+        while (line_len > 0 && (line[line_len-1] == '\n' || line[line_len-1] == '\r')) {
+            line[--line_len] = '\0';
+        }
+        if (line_len == 0) continue;
+
+        const char* error = NULL;
+        int rc = WHISPER_EXIT_INVALID_ARGS;
+        nostr_key recipient;
+
+        cJSON* record = cJSON_Parse(line);
+        const char* to = record ? batch_field(record, "to", config->recipient) : NULL;
+        const char* content = record ? batch_field(record, "content", NULL) : NULL;
+
+        if (!cJSON_IsObject(record)) {
+            error = "Invalid JSON record";
+        } else if (!to) {
+            error = "Missing \"to\"";
+        } else if (!content || !content[0]) {
+            error = "Missing \"content\"";
+        } else if (strlen(content) >= MAX_MESSAGE_SIZE) {
+            error = "Message too large";
+        } else if (whisper_peer_parse(&peers, to, &recipient) != 0) {
+            rc = WHISPER_EXIT_KEY_ERROR;
+            error = "Invalid recipient pubkey";
+        }
+
+        if (error) {
+            whisper_wrap_fail(&b.wrap, rc, error, NULL);
+        } else {
+            whisper_wrap_submit(&b.wrap, &recipient, content,
+                                batch_field(record, "subject", config->subject), NULL);
+        }
+        cJSON_Delete(record);
     }
 
-    /* Parse recipient pubkey */
-    if (whisper_parse_pubkey(config->recipient, &recipient_pubkey) != 0) {
-        fprintf(stderr, "Error: Invalid recipient pubkey\n");
-        ret = WHISPER_EXIT_KEY_ERROR;
-        goto cleanup;
+    whisper_wrap_stop(&b.wrap);
+    whisper_publisher_stop(&b.publisher);
+    if (line) {
+        secure_wipe(line, line_cap);
+        free(line);
     }
+    whisper_peer_cache_destroy(&peers);
+    return b.ret;
+}
 
-    /* Read message from stdin */
-    size_t content_len;
-    content = read_stdin(&content_len);
-    if (!content || content_len == 0) {
-        fprintf(stderr, "Error: No message content (pipe message via stdin)\n");
-        ret = WHISPER_EXIT_INVALID_ARGS;
-        goto cleanup;
+/* Submit one record to the daemon. Returns an exit code. */
+static int daemon_send_record(int fd, cJSON* record) {
+    cJSON_AddStringToObject(record, "op", "send");
+    if (whisper_daemon_request(fd, record) != 0) {
+        fprintf(stderr, "Error: Failed to talk to whisper daemon\n");
+        return WHISPER_EXIT_RELAY_ERROR;
     }
+    return WHISPER_EXIT_OK;
+}
 
-    /* Create NIP-17 DM (gift-wrapped) */
-    nostr_error_t err = nostr_nip17_send_dm(
-        &dm,
-        content,
-        &privkey,
-        &recipient_pubkey,
-        config->subject,
-        NULL,  /* reply_to - TODO: parse event ID */
-        0      /* created_at = now */
-    );
-
-    if (err != NOSTR_OK) {
-        fprintf(stderr, "Error: Failed to create DM: %s\n", nostr_error_string(err));
-        ret = WHISPER_EXIT_CRYPTO_ERROR;
-        goto cleanup;
+/* Read and print the reply to the oldest outstanding record */
+static int daemon_read_reply(FILE* in, bool batch) {
+    cJSON* reply = whisper_daemon_read(in);
+    if (!reply) {
+        fprintf(stderr, "Error: whisper daemon closed the connection\n");
+        return WHISPER_EXIT_RELAY_ERROR;
     }
 
-    /* Connect to relay */
-    if (nostr_relay_create(&relay, config->relay_url) != NOSTR_OK) {
-        fprintf(stderr, "Error: Failed to create relay\n");
-        ret = WHISPER_EXIT_RELAY_ERROR;
-        goto cleanup;
+    int ret = WHISPER_EXIT_OK;
+    const cJSON* id = cJSON_GetObjectItemCaseSensitive(reply, "id");
+    const cJSON* error = cJSON_GetObjectItemCaseSensitive(reply, "error");
+    const cJSON* code = cJSON_GetObjectItemCaseSensitive(reply, "code");
+
+    if (cJSON_IsString(id)) {
+        if (!batch && cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(reply, "unconfirmed"))) {
+            fprintf(stderr, "Warning: No confirmation received (message may still be delivered)\n");
+        }
+        printf("%s\n", id->valuestring);
+    } else {
+        const char* reason = cJSON_IsString(error) ? error->valuestring : "Unknown daemon error";
+        ret = cJSON_IsNumber(code) ? code->valueint : WHISPER_EXIT_RELAY_ERROR;
+        if (batch) {
+            printf("error: %s\n", reason);
+        } else {
+            fprintf(stderr, "Error: %s\n", reason);
+        }
     }
+    fflush(stdout);
+    cJSON_Delete(reply);
+    return ret;
+}
 
-    nostr_relay_set_message_callback(relay, message_cb, NULL);
+/* Thin client: hand content to a running daemon, which holds key and relays */
+static int send_via_daemon(const whisper_send_config* config) {
+    int fd = whisper_daemon_connect(config->socket_path);
+    if (fd < 0) return WHISPER_EXIT_RELAY_ERROR;
 
-    if (nostr_relay_connect(relay, relay_state_cb, NULL) != NOSTR_OK) {
-        fprintf(stderr, "Error: Failed to connect to relay\n");
-        ret = WHISPER_EXIT_RELAY_ERROR;
-        goto cleanup;
+    FILE* in = fdopen(dup(fd), "r");
+    if (!in) {
+        close(fd);
+        return WHISPER_EXIT_RELAY_ERROR;
     }
 
-    /* Wait for connection - use sleep() to let libwebsockets process events */
-    int wait_sec = 0;
-    int timeout_sec = (config->timeout_ms + 999) / 1000;  /* Round up to seconds */
-    while (g_connected == 0 && wait_sec < timeout_sec) {
-        sleep(1);
-        wait_sec++;
-        if (g_connected == -1) {
-            fprintf(stderr, "Error: Relay connection failed\n");
-            ret = WHISPER_EXIT_RELAY_ERROR;
-            goto cleanup;
+    int ret = WHISPER_EXIT_OK;
+
+    if (!config->batch) {
+        whisper_buf content = {0};
+        whisper_buf part = {0};
+        size_t ends[WHISPER_PARTS_MAX];
+        unsigned int group = part_group();
+        ret = read_stdin(&content, config->split);
+        int count = ret == WHISPER_EXIT_OK ? plan_parts(content.data, content.len, ends) : 0;
+        if (count < 0) ret = WHISPER_EXIT_INVALID_ARGS;
+        for (int i = 0; i < count && ret == WHISPER_EXIT_OK; i++) {
+            cJSON* record = cJSON_CreateObject();
+            if (!record || part_content(&part, content.data, ends, i, count, group) != 0) {
+                fprintf(stderr, "Error: Out of memory\n");
+                ret = WHISPER_EXIT_CRYPTO_ERROR;
+                cJSON_Delete(record);
+                break;
+            }
+            cJSON_AddStringToObject(record, "to", config->recipient);
+            cJSON_AddStringToObject(record, "content", part.data);
+            if (config->subject) cJSON_AddStringToObject(record, "subject", config->subject);
+            ret = daemon_send_record(fd, record);
+            if (ret == WHISPER_EXIT_OK) ret = daemon_read_reply(in, false);
+            cJSON_Delete(record);
+        }
+        whisper_buf_free(&part);
+        whisper_buf_free(&content);
+    } else {
+        /* Keep up to a window of records at the daemon before reading replies */
+        int window = config->window > 0 ? config->window : WHISPER_DEFAULT_WINDOW;
+        int outstanding = 0;
+        char* line = NULL;
+        size_t line_cap = 0;
+        while (getline(&line, &line_cap, stdin) != -1) {
+            if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0') continue;
+
+            /* Fill in --to/--subject defaults before forwarding */
+            cJSON* record = cJSON_Parse(line);
+            if (!cJSON_IsObject(record)) {
+                for (; outstanding > 0; outstanding--) {
+                    int rc = daemon_read_reply(in, true);
+                    if (rc != WHISPER_EXIT_OK) ret = rc;
+                }
+                printf("error: Invalid JSON record\n");
+                fflush(stdout);
+                ret = WHISPER_EXIT_INVALID_ARGS;
+                cJSON_Delete(record);
+                continue;
+            }
+            if (!cJSON_GetObjectItemCaseSensitive(record, "to") && config->recipient) {
+                cJSON_AddStringToObject(record, "to", config->recipient);
+            }
+            if (!cJSON_GetObjectItemCaseSensitive(record, "subject") && config->subject) {
+                cJSON_AddStringToObject(record, "subject", config->subject);
+            }
+            int rc = daemon_send_record(fd, record);
+            cJSON_Delete(record);
+            if (rc != WHISPER_EXIT_OK) {
+                ret = rc;
+                break;
+            }
+            if (++outstanding == window) {
+                rc = daemon_read_reply(in, true);
+                if (rc != WHISPER_EXIT_OK) ret = rc;
+                outstanding--;
+            }
+        }
+        for (; outstanding > 0; outstanding--) {
+            int rc = daemon_read_reply(in, true);
+            if (rc != WHISPER_EXIT_OK) ret = rc;
+        }
+        if (line) {
+            secure_wipe(line, line_cap);
+            free(line);
         }
     }
 
-    if (g_connected != 1) {
-        fprintf(stderr, "Error: Relay connection timeout (try increasing --timeout)\n");
-        ret = WHISPER_EXIT_TIMEOUT;
-        goto cleanup;
+    fclose(in);
+    close(fd);
+    return ret;
+}
+
+int whisper_send_prewarm(const char* const* urls, int count) {
+    if (!g_nostr_ready) {
+        if (nostr_init() != NOSTR_OK) return -1;
+        g_nostr_ready = true;
     }
+    if (g_pool.open) return 0;
+
+    /* Failures are reported by connect_relays once there is a DM to send */
+    g_pool.on_message = message_cb;
+    return whisper_pool_open(&g_pool, urls, count) > 0 ? 0 : -1;
+}
 
-    /* Publish the gift-wrapped DM */
-    if (nostr_publish_event(relay, dm) != NOSTR_OK) {
-        fprintf(stderr, "Error: Failed to publish event\n");
-        ret = WHISPER_EXIT_RELAY_ERROR;
+void whisper_send_prewarm_close(void) {
+    whisper_pool_close(&g_pool);
+    if (g_nostr_ready) nostr_cleanup();
+    g_nostr_ready = false;
+}
+
+int whisper_send(const whisper_send_config* config) {
+    int ret = WHISPER_EXIT_OK;
+    nostr_privkey privkey;
+    nostr_key sender_pubkey;
+    nostr_key recipient_pubkey;
+    whisper_buf content = {0};
+    whisper_buf part = {0};
+    size_t ends[WHISPER_PARTS_MAX];
+    int part_count = 0;
+    unsigned int group = 0;
+    nostr_event* first = NULL;
+    char err_buf[192];
+
+    if (config->socket_path) {
+        return send_via_daemon(config);
+    }
+
+    /* Initialize libnostr (done already if main prewarmed) */
+    if (!g_nostr_ready) {
+        if (nostr_init() != NOSTR_OK) {
+            fprintf(stderr, "Error: Failed to initialize libnostr\n");
+            return WHISPER_EXIT_CRYPTO_ERROR;
+        }
+        g_nostr_ready = true;
+    }
+
+    /* --prewarm: handshakes run on the relay threads while the key is
+     * loaded, stdin read and the first DM wrapped */
+    if (config->prewarm) whisper_send_prewarm(config->relay_urls, config->relay_count);
+
+    /* Load sender private key */
+    if (whisper_load_privkey(config->nsec, config->nsec_file, &privkey, &sender_pubkey) != 0) {
+        fprintf(stderr, "Error: Failed to load private key\n");
+        ret = WHISPER_EXIT_KEY_ERROR;
         goto cleanup;
     }
 
-    /* Wait for OK response */
-    wait_sec = 0;
-    while (g_published == 0 && wait_sec < timeout_sec) {
-        sleep(1);
-        wait_sec++;
+    if (!config->batch) {
+        /* Parse recipient pubkey */
+        if (whisper_parse_pubkey(config->recipient, &recipient_pubkey) != 0) {
+            fprintf(stderr, "Error: Invalid recipient pubkey\n");
+            ret = WHISPER_EXIT_KEY_ERROR;
+            goto cleanup;
+        }
+
+        /* Read message from stdin */
+        ret = read_stdin(&content, config->split);
+        if (ret != WHISPER_EXIT_OK) goto cleanup;
+        part_count = plan_parts(content.data, content.len, ends);
+        if (part_count < 0) {
+            ret = WHISPER_EXIT_INVALID_ARGS;
+            goto cleanup;
+        }
+        group = part_count > 1 ? part_group() : 0;
+
+        /* The first DM is ready before the handshake is waited on; any
+         * further --split parts are wrapped as they go out */
+        if (config->prewarm) {
+            if (part_content(&part, content.data, ends, 0, part_count, group) != 0) {
+                fprintf(stderr, "Error: Out of memory\n");
+                ret = WHISPER_EXIT_CRYPTO_ERROR;
+                goto cleanup;
+            }
+            ret = whisper_wrap_dm(&privkey, &recipient_pubkey, part.data, config->subject,
+                                  &first, err_buf, sizeof(err_buf));
+            if (ret != WHISPER_EXIT_OK) {
+                fprintf(stderr, "Error: %s\n", err_buf);
+                goto cleanup;
+            }
+        }
     }
 
-    if (!g_published) {
-        fprintf(stderr, "Warning: No confirmation received (message may still be delivered)\n");
+    /* Connect to relays */
+    ret = connect_relays(&g_pool, config);
+    if (ret != WHISPER_EXIT_OK) goto cleanup;
+
+    if (config->batch) {
+        ret = send_batch(&g_pool, config, &privkey);
+        goto cleanup;
     }
 
-    char id_hex[65];
-    for (int i = 0; i < 32; i++) {
-        snprintf(&id_hex[i * 2], 3, "%02x", dm->id[i]);
+    /* Publish the gift-wrapped DM, one per part with --split */
+    for (int i = 0; i < part_count; i++) {
+        char id_hex[65];
+        if (i == 0 && first) {
+            ret = whisper_pool_send_wrapped(&g_pool, first, config->quorum, config->timeout_ms,
+                                            id_hex, err_buf, sizeof(err_buf));
+        } else if (part_content(&part, content.data, ends, i, part_count, group) != 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            ret = WHISPER_EXIT_CRYPTO_ERROR;
+            goto cleanup;
+        } else {
+            ret = whisper_pool_send_dm(&g_pool, &privkey, &recipient_pubkey, part.data,
+                                       config->subject, config->quorum, config->timeout_ms,
+                                       id_hex, err_buf, sizeof(err_buf));
+        }
+
+        if (ret == WHISPER_EXIT_TIMEOUT && config->quorum <= 1) {
+            /* Unconfirmed is not fatal - the relay may simply not send OK */
+            fprintf(stderr, "Warning: No confirmation received (message may still be delivered)\n");
+            ret = WHISPER_EXIT_OK;
+        } else if (ret != WHISPER_EXIT_OK) {
+            fprintf(stderr, "Error: %s\n", err_buf);
+            goto cleanup;
+        }
+
+        printf("%s\n", id_hex);
     }
-    printf("%s\n", id_hex);
 
 cleanup:
     /* Secure wipe private key */
     secure_wipe(&privkey, sizeof(privkey));
 
-    if (content) free(content);
-    if (dm) nostr_event_destroy(dm);
-    if (relay) {
-        /* Let nostr_relay_destroy handle cleanup - it checks state internally */
-        nostr_relay_destroy(relay);
-    }
-    nostr_cleanup();
+    if (first) nostr_event_destroy(first);
+    whisper_buf_free(&part);
+    whisper_buf_free(&content);
+    whisper_send_prewarm_close();
 
     return ret;
 }
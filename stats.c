@@ -0,0 +1,223 @@
+/*
+ * whisper stats - Process-wide counters and latency histograms
+ *
+ * The hot paths (relay callbacks, wrap/unwrap workers, the publisher) record
+ * into one table behind a short lock. `--stats` prints it as JSON on exit;
+ * the daemon also serves it in the Prometheus text format.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "whisper.h"
+
+/* Bucket upper bounds in microseconds; the last bucket is +Inf */
+static const int64_t bucket_us[WHISPER_STAT_BUCKETS - 1] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static const char* const counter_names[WHISPER_STAT_COUNTERS] = {
+    "events_received",
+    "duplicates",
+    "unwrapped",
+    "decrypt_failed",
+    "published",
+    "ok_accepted",
+    "ok_rejected",
+    "ok_timeout",
+    "dropped_kind",
+    "dropped_recipient",
+    "dropped_size",
+    "dropped_age",
+    "dropped_rate",
+    "reconnects",
+};
+
+static const char* const counter_help[WHISPER_STAT_COUNTERS] = {
+    "Gift wraps received from relays, duplicates included",
+    "Gift wraps already received from another relay",
+    "Gift wraps decrypted",
+    "Gift wraps that failed to decrypt",
+    "Events written to a relay",
+    "Relay OKs accepting an event",
+    "Relay OKs refusing an event",
+    "Events with no OK before the timeout",
+    "Gift wraps dropped before decryption: wrong kind",
+    "Gift wraps dropped before decryption: not addressed to us",
+    "Gift wraps dropped before decryption: content size out of bounds",
+    "Gift wraps dropped before decryption: created_at out of window",
+    "Gift wraps dropped before decryption: relay over --rate-cap",
+    "Relays redialed after dropping",
+};
+
+static const char* const latency_names[WHISPER_LATENCIES] = {
+    "connect", "eose", "wrap", "unwrap", "publish", "ok"
+};
+
+typedef struct {
+    unsigned long count;
+    int64_t sum_us;
+    int64_t max_us;
+    unsigned long buckets[WHISPER_STAT_BUCKETS];
+} stats_histogram;
+
+static struct {
+    unsigned long counters[WHISPER_STAT_COUNTERS];
+    stats_histogram latency[WHISPER_LATENCIES];
+} g_stats;
+
+/* Statically initialized so relay threads may record before main is done */
+#ifndef _WIN32
+static pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#define STATS_LOCK()   pthread_mutex_lock(&g_stats_lock)
+#define STATS_UNLOCK() pthread_mutex_unlock(&g_stats_lock)
+#else
+static SRWLOCK g_stats_lock = SRWLOCK_INIT;
+#define STATS_LOCK()   AcquireSRWLockExclusive(&g_stats_lock)
+#define STATS_UNLOCK() ReleaseSRWLockExclusive(&g_stats_lock)
+#endif
+
+int64_t whisper_now_us(void) {
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return (int64_t)GetTickCount64() * 1000;
+#endif
+}
+
+void whisper_stats_count(int counter, unsigned long n) {
+    if (counter < 0 || counter >= WHISPER_STAT_COUNTERS) return;
+    STATS_LOCK();
+    g_stats.counters[counter] += n;
+    STATS_UNLOCK();
+}
+
+void whisper_stats_observe(int latency, int64_t us) {
+    if (latency < 0 || latency >= WHISPER_LATENCIES) return;
+    if (us < 0) us = 0;
+
+    int b = 0;
+    while (b < WHISPER_STAT_BUCKETS - 1 && us > bucket_us[b]) b++;
+
+    STATS_LOCK();
+    stats_histogram* h = &g_stats.latency[latency];
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+    h->buckets[b]++;
+    STATS_UNLOCK();
+}
+
+/* Quantile estimate in ms, interpolating within the bucket it falls in */
+static double quantile_ms(const stats_histogram* h, double q) {
+    if (h->count == 0) return 0;
+    double rank = q * (double)h->count;
+    unsigned long seen = 0;
+    for (int b = 0; b < WHISPER_STAT_BUCKETS; b++) {
+        if (h->buckets[b] == 0 || (double)(seen + h->buckets[b]) < rank) {
+            seen += h->buckets[b];
+            continue;
+        }
+        double lo = b == 0 ? 0 : (double)bucket_us[b - 1];
+        double hi = b < WHISPER_STAT_BUCKETS - 1 ? (double)bucket_us[b] : (double)h->max_us;
+        if (hi > (double)h->max_us) hi = (double)h->max_us;
+        if (hi < lo) hi = lo;
+        double at = lo + (hi - lo) * (rank - (double)seen) / (double)h->buckets[b];
+        return at / 1000.0;
+    }
+    return (double)h->max_us / 1000.0;
+}
+
+int whisper_stats_json(whisper_buf* out) {
+    STATS_LOCK();
+    unsigned long counters[WHISPER_STAT_COUNTERS];
+    stats_histogram latency[WHISPER_LATENCIES];
+    memcpy(counters, g_stats.counters, sizeof(counters));
+    memcpy(latency, g_stats.latency, sizeof(latency));
+    STATS_UNLOCK();
+
+    int rc = whisper_buf_puts(out, "{\"counters\":{");
+    for (int i = 0; i < WHISPER_STAT_COUNTERS && rc == 0; i++) {
+        rc = whisper_buf_printf(out, "%s\"%s\":%lu", i ? "," : "", counter_names[i], counters[i]);
+    }
+    if (rc == 0) rc = whisper_buf_puts(out, "},\"latency_ms\":{");
+
+    bool first = true;
+    for (int i = 0; i < WHISPER_LATENCIES && rc == 0; i++) {
+        const stats_histogram* h = &latency[i];
+        if (h->count == 0) continue;
+        rc = whisper_buf_printf(out,
+                                "%s\"%s\":{\"count\":%lu,\"mean\":%.3f,\"p50\":%.3f,"
+                                "\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                                first ? "" : ",", latency_names[i], h->count,
+                                (double)h->sum_us / (double)h->count / 1000.0,
+                                quantile_ms(h, 0.50), quantile_ms(h, 0.90),
+                                quantile_ms(h, 0.99), (double)h->max_us / 1000.0);
+        first = false;
+    }
+    if (rc == 0) rc = whisper_buf_puts(out, "}}");
+    return rc;
+}
+
+int whisper_stats_prometheus(whisper_buf* out) {
+    STATS_LOCK();
+    unsigned long counters[WHISPER_STAT_COUNTERS];
+    stats_histogram latency[WHISPER_LATENCIES];
+    memcpy(counters, g_stats.counters, sizeof(counters));
+    memcpy(latency, g_stats.latency, sizeof(latency));
+    STATS_UNLOCK();
+
+    int rc = 0;
+    for (int i = 0; i < WHISPER_STAT_COUNTERS && rc == 0; i++) {
+        rc = whisper_buf_printf(out,
+                                "# HELP whisper_%s_total %s\n"
+                                "# TYPE whisper_%s_total counter\n"
+                                "whisper_%s_total %lu\n",
+                                counter_names[i], counter_help[i], counter_names[i],
+                                counter_names[i], counters[i]);
+    }
+
+    if (rc == 0) {
+        rc = whisper_buf_puts(out,
+                              "# HELP whisper_latency_seconds Time spent per stage: connect "
+                              "(TCP, TLS and upgrade), eose (REQ to EOSE), wrap, unwrap, "
+                              "publish (write) and ok (write to OK)\n"
+                              "# TYPE whisper_latency_seconds histogram\n");
+    }
+    for (int i = 0; i < WHISPER_LATENCIES && rc == 0; i++) {
+        const stats_histogram* h = &latency[i];
+        unsigned long cumulative = 0;
+        for (int b = 0; b < WHISPER_STAT_BUCKETS && rc == 0; b++) {
+            cumulative += h->buckets[b];
+            if (b < WHISPER_STAT_BUCKETS - 1) {
+                rc = whisper_buf_printf(out,
+                                        "whisper_latency_seconds_bucket{stage=\"%s\",le=\"%g\"} %lu\n",
+                                        latency_names[i], (double)bucket_us[b] / 1e6, cumulative);
+            } else {
+                rc = whisper_buf_printf(out,
+                                        "whisper_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n",
+                                        latency_names[i], cumulative);
+            }
+        }
+        if (rc == 0) {
+            rc = whisper_buf_printf(out,
+                                    "whisper_latency_seconds_sum{stage=\"%s\"} %.6f\n"
+                                    "whisper_latency_seconds_count{stage=\"%s\"} %lu\n",
+                                    latency_names[i], (double)h->sum_us / 1e6,
+                                    latency_names[i], h->count);
+        }
+    }
+    return rc;
+}
+
+void whisper_stats_print(FILE* out) {
+    whisper_buf json = {0};
+    if (whisper_stats_json(&json) == 0 && json.data) {
+        fprintf(out, "%.*s\n", (int)json.len, json.data);
+        fflush(out);
+    }
+    whisper_buf_free(&json);
+}
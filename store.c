@@ -0,0 +1,391 @@
+/*
+ * whisper store - Append-only local inbox with per-relay resume cursors
+ *
+ * One JSON object per line in <dir>/inbox-<pubkey hex>.jsonl:
+ *   {"wrap":"<id>","wrap_at":N,"from":"npub1...","content":"...","created_at":N}
+ *   {"relay":"wss://...","since":N}
+ * A later cursor line for the same relay supersedes earlier ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+#include "whisper.h"
+
+/* Room for ids learned this session on top of the ones loaded from disk */
+#define STORE_SEEN_HEADROOM 65536
+
+const char* whisper_store_default_dir(char* buf, size_t size) {
+    const char* data = getenv("XDG_DATA_HOME");
+    if (data && data[0]) {
+        snprintf(buf, size, "%s/whisper", data);
+        return buf;
+    }
+#ifdef _WIN32
+    const char* home = getenv("APPDATA");
+    if (!home || !home[0]) return NULL;
+    snprintf(buf, size, "%s/whisper", home);
+#else
+    const char* home = getenv("HOME");
+    if (!home || !home[0]) return NULL;
+    snprintf(buf, size, "%s/.local/share/whisper", home);
+#endif
+    return buf;
+}
+
+/* mkdir -p, private to the user: the inbox holds decrypted messages */
+int whisper_make_dirs(const char* dir) {
+    char path[512];
+    if (snprintf(path, sizeof(path), "%s", dir) >= (int)sizeof(path)) return -1;
+
+    for (char* p = path + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            char saved = *p;
+            *p = '\0';
+#ifndef _WIN32
+            int rc = mkdir(path, 0700);
+#else
+            int rc = _mkdir(path);
+#endif
+            if (rc != 0 && errno != EEXIST) return -1;
+            *p = saved;
+            if (saved == '\0') break;
+        }
+    }
+    return 0;
+}
+
+static bool parse_hex_id(const char* hex, uint8_t id[32]) {
+    if (!hex || strlen(hex) != 64) return false;
+    for (int i = 0; i < 32; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) return false;
+        id[i] = (uint8_t)byte;
+    }
+    return true;
+}
+
+static whisper_store_cursor* find_cursor(whisper_store* st, const char* url) {
+    for (int i = 0; i < st->cursor_count; i++) {
+        if (strcmp(st->cursors[i].url, url) == 0) return &st->cursors[i];
+    }
+    return NULL;
+}
+
+static void load_cursor(whisper_store* st, const char* url, int64_t since) {
+    whisper_store_cursor* c = find_cursor(st, url);
+    if (!c) {
+        if (st->cursor_count >= WHISPER_STORE_MAX_CURSORS) return;
+        char* copy = strdup(url);
+        if (!copy) return;
+        c = &st->cursors[st->cursor_count++];
+        c->url = copy;
+    }
+    c->since = since;
+}
+
+/* Replay the file: hand messages to replay, remember ids and cursors */
+static int load_store(whisper_store* st, FILE* f, whisper_store_cb replay, void* user_data,
+                      uint8_t (**ids)[32], size_t* id_count) {
+    size_t id_cap = 0;
+    char* line = NULL;
+    size_t line_cap = 0;
+
+    while (getline(&line, &line_cap, f) != -1) {
+        cJSON* rec = cJSON_Parse(line);
+        if (!cJSON_IsObject(rec)) {
+            /* Torn final write from an interrupted run */
+            cJSON_Delete(rec);
+            continue;
+        }
+
+        const cJSON* wrap = cJSON_GetObjectItemCaseSensitive(rec, "wrap");
+        const cJSON* relay = cJSON_GetObjectItemCaseSensitive(rec, "relay");
+        const cJSON* since = cJSON_GetObjectItemCaseSensitive(rec, "since");
+
+        if (cJSON_IsString(relay) && cJSON_IsNumber(since)) {
+            load_cursor(st, relay->valuestring, (int64_t)since->valuedouble);
+        } else if (cJSON_IsString(wrap)) {
+            const cJSON* from = cJSON_GetObjectItemCaseSensitive(rec, "from");
+            const cJSON* content = cJSON_GetObjectItemCaseSensitive(rec, "content");
+            const cJSON* created_at = cJSON_GetObjectItemCaseSensitive(rec, "created_at");
+
+            if (*id_count == id_cap) {
+                size_t cap = id_cap ? id_cap * 2 : 1024;
+                uint8_t (*grown)[32] = realloc(*ids, cap * sizeof(**ids));
+                if (!grown) {
+                    cJSON_Delete(rec);
+                    break;
+                }
+                *ids = grown;
+                id_cap = cap;
+            }
+            if (parse_hex_id(wrap->valuestring, (*ids)[*id_count])) (*id_count)++;
+
+            if (replay && cJSON_IsString(from)) {
+                replay(from->valuestring,
+                       cJSON_IsString(content) ? content->valuestring : NULL,
+                       cJSON_IsNumber(created_at) ? (int64_t)created_at->valuedouble : 0,
+                       user_data);
+            }
+            st->message_count++;
+        }
+        cJSON_Delete(rec);
+    }
+
+    if (line) {
+        secure_wipe(line, line_cap);
+        free(line);
+    }
+    return 0;
+}
+
+static int inbox_path(char* path, size_t size, const char* dir, const nostr_key* pubkey) {
+    char pubkey_hex[65];
+    nostr_key_to_hex(pubkey, pubkey_hex, sizeof(pubkey_hex));
+    return snprintf(path, size, "%s/inbox-%s.jsonl", dir, pubkey_hex) < (int)size ? 0 : -1;
+}
+
+int whisper_store_open(whisper_store* st, const char* dir, const nostr_key* pubkey,
+                       whisper_store_cb replay, void* user_data) {
+    memset(st, 0, sizeof(*st));
+
+    char path[600];
+    if (whisper_make_dirs(dir) != 0 || inbox_path(path, sizeof(path), dir, pubkey) != 0) {
+        fprintf(stderr, "Error: Cannot create store directory: %s\n", dir);
+        return -1;
+    }
+
+    uint8_t (*ids)[32] = NULL;
+    size_t id_count = 0;
+    FILE* existing = fopen(path, "r");
+    if (existing) {
+        load_store(st, existing, replay, user_data, &ids, &id_count);
+        fclose(existing);
+    }
+
+    if (whisper_idset_init(&st->ids, id_count + STORE_SEEN_HEADROOM) != 0) {
+        free(ids);
+        return -1;
+    }
+    for (size_t i = 0; i < id_count; i++) {
+        whisper_idset_insert(&st->ids, ids[i]);
+    }
+    free(ids);
+
+#ifndef _WIN32
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    st->fp = fd >= 0 ? fdopen(fd, "a") : NULL;
+    if (!st->fp && fd >= 0) close(fd);
+#else
+    st->fp = fopen(path, "ab");
+#endif
+    if (!st->fp) {
+        fprintf(stderr, "Error: Cannot open store: %s\n", path);
+        whisper_idset_destroy(&st->ids);
+        return -1;
+    }
+
+    whisper_mutex_init(&st->lock);
+    st->open = true;
+    return 0;
+}
+
+bool whisper_store_claim(whisper_store* st, const uint8_t id[32]) {
+    whisper_mutex_lock(&st->lock);
+    bool fresh = whisper_idset_insert(&st->ids, id);
+    whisper_mutex_unlock(&st->lock);
+    return fresh;
+}
+
+/* Write one record as a single line; callers hold st->lock */
+static int write_record(whisper_store* st, cJSON* rec) {
+    char* json = cJSON_PrintUnformatted(rec);
+    if (!json) return -1;
+    size_t len = strlen(json);
+    int rc = (fwrite(json, 1, len, st->fp) == len && fputc('\n', st->fp) != EOF &&
+              fflush(st->fp) == 0) ? 0 : -1;
+    secure_wipe(json, len);
+    cJSON_free(json);
+    return rc;
+}
+
+int whisper_store_append(whisper_store* st, const whisper_unwrapped* msg,
+                         const char* sender_npub) {
+    char wrap_hex[65];
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 32; i++) {
+        wrap_hex[i * 2] = hex[msg->wrap_id[i] >> 4];
+        wrap_hex[i * 2 + 1] = hex[msg->wrap_id[i] & 0x0f];
+    }
+    wrap_hex[64] = '\0';
+
+    cJSON* rec = cJSON_CreateObject();
+    if (!rec) return -1;
+    cJSON_AddStringToObject(rec, "wrap", wrap_hex);
+    cJSON_AddNumberToObject(rec, "wrap_at", (double)msg->wrap_created_at);
+    cJSON_AddStringToObject(rec, "from", sender_npub);
+    cJSON_AddStringToObject(rec, "content", msg->rumor->content ? msg->rumor->content : "");
+    cJSON_AddNumberToObject(rec, "created_at", (double)msg->rumor->created_at);
+
+    whisper_mutex_lock(&st->lock);
+    int rc = write_record(st, rec);
+    if (rc == 0) st->message_count++;
+    whisper_mutex_unlock(&st->lock);
+
+    cJSON_Delete(rec);
+    if (rc != 0) fprintf(stderr, "Warning: Failed to write message to store\n");
+    return rc;
+}
+
+int64_t whisper_store_since(whisper_store* st, const char* const* urls, int count) {
+    int64_t since = 0;
+    whisper_mutex_lock(&st->lock);
+    for (int i = 0; i < count; i++) {
+        const whisper_store_cursor* c = find_cursor(st, urls[i]);
+        /* A relay we never finished reading needs its whole history */
+        if (!c || c->since <= 0) {
+            since = 0;
+            break;
+        }
+        if (i == 0 || c->since < since) since = c->since;
+    }
+    whisper_mutex_unlock(&st->lock);
+
+    if (since <= 0) return 0;
+    since -= WHISPER_NIP59_SKEW_S;
+    return since > 0 ? since : 0;
+}
+
+void whisper_store_set_cursor(whisper_store* st, const char* url, int64_t since) {
+    if (since <= 0) return;
+
+    whisper_mutex_lock(&st->lock);
+    whisper_store_cursor* c = find_cursor(st, url);
+    if (!c || since > c->since) {
+        cJSON* rec = cJSON_CreateObject();
+        if (rec) {
+            cJSON_AddStringToObject(rec, "relay", url);
+            cJSON_AddNumberToObject(rec, "since", (double)since);
+            if (write_record(st, rec) == 0) load_cursor(st, url, since);
+            cJSON_Delete(rec);
+        }
+    }
+    whisper_mutex_unlock(&st->lock);
+}
+
+static int compare_store_entries(const void* a, const void* b) {
+    const whisper_store_entry* x = (const whisper_store_entry*)a;
+    const whisper_store_entry* y = (const whisper_store_entry*)b;
+    if (x->wrap_at != y->wrap_at) return x->wrap_at > y->wrap_at ? -1 : 1;
+    return x->offset > y->offset ? -1 : (x->offset < y->offset);
+}
+
+int whisper_store_pager_open(whisper_store_pager* pg, const char* dir, const nostr_key* pubkey) {
+    memset(pg, 0, sizeof(*pg));
+    char path[600];
+    if (inbox_path(path, sizeof(path), dir, pubkey) != 0) return -1;
+    pg->fp = fopen(path, "r");
+    if (!pg->fp) return -1;
+
+    /* One pass keeps only offsets; pages then read just their own lines */
+    size_t cap = 0;
+    char* line = NULL;
+    size_t line_cap = 0;
+    long offset = ftell(pg->fp);
+    ssize_t n;
+    while ((n = getline(&line, &line_cap, pg->fp)) != -1) {
+        cJSON* rec = cJSON_Parse(line);
+        const cJSON* wrap_at = cJSON_GetObjectItemCaseSensitive(rec, "wrap_at");
+        if (cJSON_IsString(cJSON_GetObjectItemCaseSensitive(rec, "wrap")) &&
+            cJSON_IsNumber(wrap_at)) {
+            if (pg->count == cap) {
+                size_t grown_cap = cap ? cap * 2 : 1024;
+                whisper_store_entry* grown = realloc(pg->entries, grown_cap * sizeof(*grown));
+                if (!grown) {
+                    cJSON_Delete(rec);
+                    break;
+                }
+                pg->entries = grown;
+                cap = grown_cap;
+            }
+            pg->entries[pg->count].wrap_at = (int64_t)wrap_at->valuedouble;
+            pg->entries[pg->count].offset = offset;
+            pg->count++;
+        }
+        cJSON_Delete(rec);
+        offset += (long)n;
+    }
+    if (line) {
+        secure_wipe(line, line_cap);
+        free(line);
+    }
+
+    if (pg->count > 1) qsort(pg->entries, pg->count, sizeof(*pg->entries), compare_store_entries);
+    return 0;
+}
+
+int whisper_store_pager_next(whisper_store_pager* pg, int limit, whisper_store_page_cb page,
+                             void* user_data) {
+    if (!pg->fp || pg->next >= pg->count || limit <= 0) return 0;
+
+    /* Messages sharing the last wrap_at all go in this page */
+    size_t end = pg->count - pg->next > (size_t)limit ? pg->next + (size_t)limit : pg->count;
+    while (end < pg->count && pg->entries[end].wrap_at == pg->entries[end - 1].wrap_at) end++;
+
+    char* line = NULL;
+    size_t line_cap = 0;
+    int delivered = 0;
+    for (; pg->next < end; pg->next++) {
+        if (fseek(pg->fp, pg->entries[pg->next].offset, SEEK_SET) != 0 ||
+            getline(&line, &line_cap, pg->fp) == -1) {
+            continue;
+        }
+        cJSON* rec = cJSON_Parse(line);
+        const cJSON* wrap = cJSON_GetObjectItemCaseSensitive(rec, "wrap");
+        const cJSON* from = cJSON_GetObjectItemCaseSensitive(rec, "from");
+        const cJSON* content = cJSON_GetObjectItemCaseSensitive(rec, "content");
+        const cJSON* created_at = cJSON_GetObjectItemCaseSensitive(rec, "created_at");
+        uint8_t id[32];
+        if (cJSON_IsString(wrap) && cJSON_IsString(from) && parse_hex_id(wrap->valuestring, id)) {
+            page(id, from->valuestring, cJSON_IsString(content) ? content->valuestring : NULL,
+                 cJSON_IsNumber(created_at) ? (int64_t)created_at->valuedouble : 0, user_data);
+            delivered++;
+        }
+        cJSON_Delete(rec);
+    }
+
+    if (line) {
+        secure_wipe(line, line_cap);
+        free(line);
+    }
+    return delivered;
+}
+
+void whisper_store_pager_close(whisper_store_pager* pg) {
+    if (pg->fp) fclose(pg->fp);
+    free(pg->entries);
+    memset(pg, 0, sizeof(*pg));
+}
+
+void whisper_store_close(whisper_store* st) {
+    if (!st->open) return;
+    fclose(st->fp);
+    st->fp = NULL;
+    for (int i = 0; i < st->cursor_count; i++) {
+        free(st->cursors[i].url);
+    }
+    st->cursor_count = 0;
+    whisper_idset_destroy(&st->ids);
+    whisper_mutex_destroy(&st->lock);
+    st->open = false;
+}
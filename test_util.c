@@ -5,8 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-char* whisper_strip_control_chars(const char* input);
+#include "text.h"
 
 static int tests_run = 0;
 static int tests_passed = 0;
@@ -34,23 +33,6 @@ static int tests_passed = 0;
     } \
 } while(0)
 
-char* whisper_strip_control_chars(const char* input) {
-    if (!input) return NULL;
-    size_t len = strlen(input);
-    char* output = malloc(len + 1);
-    if (!output) return NULL;
-
-    size_t j = 0;
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = (unsigned char)input[i];
-        if (c == '\t' || c == '\n' || c >= 0x80 || (c >= 0x20 && c < 0x7F)) {
-            output[j++] = (char)c;
-        }
-    }
-    output[j] = '\0';
-    return output;
-}
-
 TEST(strip_null_input) {
     char* result = whisper_strip_control_chars(NULL);
     ASSERT(result == NULL);
@@ -126,6 +108,205 @@ TEST(strip_mixed_utf8_and_control) {
     free(result);
 }
 
+TEST(strip_into_long_clean_run) {
+    char in[200], out[201];
+    memset(in, 'a', sizeof(in));
+    in[150] = '\033';
+    size_t n = whisper_strip_control_chars_into(in, sizeof(in), out);
+    ASSERT(n == sizeof(in) - 1);
+    ASSERT(out[n] == '\0');
+    ASSERT(out[149] == 'a' && out[150] == 'a');
+}
+
+TEST(strip_into_in_place) {
+    char buf[] = "0123456789abcdef\x1b[31mred\x1b[0m and 0123456789abcdef tail\x7f!";
+    size_t n = whisper_strip_control_chars_into(buf, strlen(buf), buf);
+    ASSERT(n == strlen(buf));
+    ASSERT_STR_EQ(buf, "0123456789abcdef[31mred[0m and 0123456789abcdef tail!");
+}
+
+/* Every block/tail boundary, with bytes drawn mostly from the edge cases */
+TEST(strip_into_matches_scalar) {
+    static const unsigned char edge[] = {
+        0x00, 0x08, '\t', '\n', 0x0b, 0x1b, 0x1f, 0x20, 'a', 0x7e, 0x7f, 0x80, 0xc3, 0xff
+    };
+    char in[130], fast[131], slow[131], inplace[131];
+    unsigned int seed = 12345;
+
+    for (int round = 0; round < 2000; round++) {
+        size_t len = (size_t)(round % (int)sizeof(in));
+        for (size_t i = 0; i < len; i++) {
+            seed = seed * 1103515245u + 12345u;
+            unsigned int r = seed >> 16;
+            /* Mostly clean text so the SIMD skip path gets exercised too */
+            in[i] = (r % 8 == 0) ? (char)edge[(r / 8) % sizeof(edge)] : (char)('a' + r % 26);
+        }
+
+        size_t n_fast = whisper_strip_control_chars_into(in, len, fast);
+        size_t n_slow = whisper_strip_control_chars_scalar(in, len, slow);
+        ASSERT(n_fast == n_slow);
+        ASSERT(memcmp(fast, slow, n_slow + 1) == 0);
+
+        memcpy(inplace, in, len);
+        size_t n_inplace = whisper_strip_control_chars_into(inplace, len, inplace);
+        ASSERT(n_inplace == n_slow);
+        ASSERT(memcmp(inplace, slow, n_slow + 1) == 0);
+    }
+}
+
+TEST(json_escapes_specials) {
+    whisper_buf b = {0};
+    const char* in = "say \"hi\" \\ now\n\r\t";
+    const char* want_in = "say \\\"hi\\\" \\\\ now\\n\\r\\t";
+    ASSERT(whisper_buf_append_json(&b, in, strlen(in)) == 0);
+    ASSERT(b.len == strlen(want_in) && memcmp(b.data, want_in, b.len) == 0);
+
+    /* Every other control byte becomes \u00XX, NUL included */
+    for (int c = 0; c < 0x20; c++) {
+        if (c == '\n' || c == '\r' || c == '\t') continue;
+        char byte = (char)c;
+        char want[7];
+        snprintf(want, sizeof(want), "\\u%04x", c);
+        b.len = 0;
+        ASSERT(whisper_buf_append_json(&b, &byte, 1) == 0);
+        ASSERT(b.len == 6 && memcmp(b.data, want, 6) == 0);
+    }
+
+    /* DEL and UTF-8 are valid in JSON strings as they are */
+    const char* pass = "\x7f\xc3\xa9\xe4\xb8\xad\xf0\x9f\x94\x91";
+    b.len = 0;
+    ASSERT(whisper_buf_append_json(&b, pass, strlen(pass)) == 0);
+    ASSERT(b.len == strlen(pass) && memcmp(b.data, pass, b.len) == 0);
+    whisper_buf_free(&b);
+}
+
+/* Byte-at-a-time escaper the block scan must agree with */
+static size_t json_escape_scalar(const unsigned char* in, size_t len, char* out) {
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = in[i];
+        if (c == '"' || c == '\\') {
+            out[j++] = '\\';
+            out[j++] = (char)c;
+        } else if (c == '\n' || c == '\r' || c == '\t') {
+            out[j++] = '\\';
+            out[j++] = c == '\n' ? 'n' : c == '\r' ? 'r' : 't';
+        } else if (c < 0x20) {
+            j += (size_t)sprintf(out + j, "\\u%04x", c);
+        } else {
+            out[j++] = (char)c;
+        }
+    }
+    return j;
+}
+
+/* One special byte at every offset across the 16- and 32-byte blocks and
+ * the tail, then random mixes of lengths up to three blocks */
+TEST(json_matches_scalar) {
+    static const unsigned char edge[] = {
+        0x00, 0x01, '\t', '\n', '\r', 0x1f, '"', '\\', 0x20, 0x7f, 0x80, 0xc3, 0xff
+    };
+    unsigned char in[100];
+    char slow[600];
+    whisper_buf b = {0};
+
+    for (size_t len = 1; len <= 70; len++) {
+        for (size_t at = 0; at < len; at++) {
+            for (size_t e = 0; e < sizeof(edge); e++) {
+                memset(in, 'a', len);
+                in[at] = edge[e];
+                int special = edge[e] < 0x20 || edge[e] == '"' || edge[e] == '\\';
+                ASSERT(whisper_json_safe_run((const char*)in, len) == (special ? at : len));
+            }
+        }
+    }
+
+    unsigned int seed = 12345;
+    for (int round = 0; round < 2000; round++) {
+        size_t len = (size_t)(round % (int)sizeof(in));
+        for (size_t i = 0; i < len; i++) {
+            seed = seed * 1103515245u + 12345u;
+            unsigned int r = seed >> 16;
+            in[i] = (r % 8 == 0) ? edge[(r / 8) % sizeof(edge)] : (unsigned char)('a' + r % 26);
+        }
+
+        b.len = 0;
+        ASSERT(whisper_buf_append_json(&b, (const char*)in, len) == 0);
+        size_t n_slow = json_escape_scalar(in, len, slow);
+        ASSERT(b.len == n_slow);
+        ASSERT(n_slow == 0 || memcmp(b.data, slow, n_slow) == 0);
+    }
+    whisper_buf_free(&b);
+}
+
+TEST(utf8_cut_keeps_sequences_whole) {
+    const char* s = "ab\xc3\xa9\xe4\xb8\xad";   /* "ab" + e-acute + CJK */
+    ASSERT(whisper_utf8_cut(s, 7, 10) == 7);
+    ASSERT(whisper_utf8_cut(s, 7, 3) == 2);
+    ASSERT(whisper_utf8_cut(s, 7, 4) == 4);
+    ASSERT(whisper_utf8_cut(s, 7, 6) == 4);
+
+    /* Not UTF-8: backs off at most 3 bytes, then cuts where asked */
+    const char* bad = "a\x80\x80\x80\x80\x80\x80\x80";
+    ASSERT(whisper_utf8_cut(bad, 8, 6) == 6);
+}
+
+TEST(part_header_round_trip) {
+    char header[WHISPER_PART_HEADER_MAX];
+    int n = whisper_part_header(header, sizeof(header), 0xdeadbeef, 3, 12);
+    ASSERT_STR_EQ(header, "[part 3/12 #deadbeef]\n");
+
+    unsigned int group;
+    int index, total;
+    ASSERT(whisper_part_parse(header, (size_t)n, &group, &index, &total) == (size_t)n);
+    ASSERT(group == 0xdeadbeef && index == 3 && total == 12);
+    ASSERT(whisper_part_parse("[part 4/3 #deadbeef]\n", 21, &group, &index, &total) == 0);
+    ASSERT(whisper_part_parse("[part 1/2 #DEADBEEF]\n", 21, &group, &index, &total) == 0);
+    ASSERT(whisper_part_parse("[part 1/2]", 10, &group, &index, &total) == 0);
+}
+
+TEST(parts_reassemble_out_of_order) {
+    whisper_parts parts;
+    memset(&parts, 0, sizeof(parts));
+    whisper_buf out = {0};
+    int64_t created_at = 0;
+
+    const char* p2 = "[part 2/3 #0000002a]\nlo, ";
+    const char* other = "[part 1/1 #0000002a]\nsolo";
+    const char* p1 = "[part 1/3 #0000002a]\nhel";
+    const char* p3 = "[part 3/3 #0000002a]\nworld";
+
+    ASSERT(whisper_parts_add(&parts, "alice", "plain", 5, 1, &out, &created_at) == -1);
+    ASSERT(whisper_parts_add(&parts, "alice", p2, strlen(p2), 20, &out, &created_at) == 0);
+    ASSERT(whisper_parts_add(&parts, "alice", p2, strlen(p2), 20, &out, &created_at) == 0);
+    ASSERT(whisper_parts_add(&parts, "bob", other, strlen(other), 5, &out, &created_at) == 1);
+    ASSERT_STR_EQ(out.data, "solo");
+    ASSERT(whisper_parts_add(&parts, "alice", p1, strlen(p1), 10, &out, &created_at) == 0);
+    ASSERT(whisper_parts_add(&parts, "alice", p3, strlen(p3), 30, &out, &created_at) == 1);
+    ASSERT_STR_EQ(out.data, "hello, world");
+    ASSERT(created_at == 10);
+
+    whisper_parts_free(&parts);
+    whisper_buf_free(&out);
+}
+
+TEST(parts_keep_newest_counts_a_message_once) {
+    const char* contents[] = {
+        "a", "[part 1/2 #0000002a]\nx", "b", "[part 2/2 #0000002a]\ny", "c", NULL
+    };
+    bool keep[6];
+
+    /* The split message started before the newest three: all of it goes */
+    whisper_parts_keep_newest(contents, 6, 3, keep);
+    ASSERT(!keep[0] && !keep[1] && keep[2] && !keep[3] && keep[4] && keep[5]);
+
+    whisper_parts_keep_newest(contents, 6, 4, keep);
+    ASSERT(!keep[0] && keep[1] && keep[2] && keep[3] && keep[4] && keep[5]);
+
+    whisper_parts_keep_newest(contents, 6, 0, keep);
+    for (int i = 0; i < 6; i++) ASSERT(keep[i]);
+}
+
 int main(void) {
     printf("Running util tests:\n");
 
@@ -140,6 +321,15 @@ int main(void) {
     RUN(strip_preserves_utf8_chinese);
     RUN(strip_preserves_utf8_japanese);
     RUN(strip_mixed_utf8_and_control);
+    RUN(strip_into_long_clean_run);
+    RUN(strip_into_in_place);
+    RUN(strip_into_matches_scalar);
+    RUN(json_escapes_specials);
+    RUN(json_matches_scalar);
+    RUN(utf8_cut_keeps_sequences_whole);
+    RUN(part_header_round_trip);
+    RUN(parts_reassemble_out_of_order);
+    RUN(parts_keep_newest_counts_a_message_once);
 
     printf("\n%d/%d tests passed\n", tests_passed, tests_run);
     return 0;
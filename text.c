@@ -0,0 +1,433 @@
+/*
+ * whisper text - Output buffering and escaping
+ *
+ * Kept free of libnostr so the test suite can link it directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "text.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static void wipe(void* p, size_t len) {
+    volatile unsigned char* v = (volatile unsigned char*)p;
+    while (len--) *v++ = 0;
+}
+
+int whisper_buf_reserve(whisper_buf* b, size_t extra) {
+    if (b->cap - b->len >= extra) return 0;
+
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap - b->len < extra) {
+        if (cap > ((size_t)-1) / 2) return -1;
+        cap *= 2;
+    }
+
+    /* Move by hand so the old copy of message text can be wiped */
+    char* data = malloc(cap);
+    if (!data) return -1;
+    if (b->data) {
+        memcpy(data, b->data, b->len);
+        wipe(b->data, b->cap);
+        free(b->data);
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+int whisper_buf_append(whisper_buf* b, const char* data, size_t len) {
+    if (whisper_buf_reserve(b, len) != 0) return -1;
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+int whisper_buf_puts(whisper_buf* b, const char* s) {
+    return whisper_buf_append(b, s, strlen(s));
+}
+
+int whisper_buf_printf(whisper_buf* b, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->data ? b->data + b->len : NULL, b->data ? b->cap - b->len : 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+
+    if ((size_t)n >= b->cap - b->len) {
+        if (whisper_buf_reserve(b, (size_t)n + 1) != 0) return -1;
+        va_start(ap, fmt);
+        vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+    }
+    b->len += (size_t)n;
+    return 0;
+}
+
+void whisper_buf_free(whisper_buf* b) {
+    if (b->data) {
+        wipe(b->data, b->cap);
+        free(b->data);
+    }
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+static int needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+size_t whisper_json_safe_run(const char* s, size_t len) {
+    const unsigned char* p = (const unsigned char*)s;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctl_max = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        /* min(v, 0x1f) == v exactly when v <= 0x1f (unsigned) */
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(v, ctl_max), v));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t ctl_max = vdupq_n_u8(0x1f);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                                  vcleq_u8(v, ctl_max));
+        if (vmaxvq_u8(hit)) break;  /* locate it below */
+    }
+#endif
+
+    while (i < len && !needs_escape(p[i])) i++;
+    return i;
+}
+
+int whisper_buf_append_json(whisper_buf* b, const char* s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+
+    while (len > 0) {
+        size_t run = whisper_json_safe_run(s, len);
+        if (run > 0) {
+            if (whisper_buf_append(b, s, run) != 0) return -1;
+            s += run;
+            len -= run;
+            if (len == 0) break;
+        }
+
+        unsigned char c = (unsigned char)*s++;
+        len--;
+        char esc[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t esc_len = 2;
+        switch (c) {
+            case '"':  esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 0x0f];
+                esc_len = 6;
+        }
+        if (whisper_buf_append(b, esc, esc_len) != 0) return -1;
+    }
+    return 0;
+}
+
+static int is_display_byte(unsigned char c) {
+    return c == '\t' || c == '\n' || c >= 0x80 || (c >= 0x20 && c < 0x7F);
+}
+
+size_t whisper_strip_control_chars_scalar(const char* in, size_t len, char* out) {
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)in[i];
+        if (is_display_byte(c)) out[j++] = (char)c;
+    }
+    out[j] = '\0';
+    return j;
+}
+
+/* Copy n clean bytes; in place with nothing dropped yet there is no copy */
+static void keep_block(char* out, size_t j, const char* in, size_t i, size_t n) {
+    if (out + j != in + i) memmove(out + j, in + i, n);
+}
+
+size_t whisper_strip_control_chars_into(const char* in, size_t len, char* out) {
+    const unsigned char* p = (const unsigned char*)in;
+    size_t i = 0, j = 0;
+
+#if defined(__AVX2__)
+    const __m256i tab32 = _mm256_set1_epi8('\t');
+    const __m256i nl32 = _mm256_set1_epi8('\n');
+    const __m256i del32 = _mm256_set1_epi8(0x7f);
+    const __m256i ctl32 = _mm256_set1_epi8(0x1f);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl32), v);
+        __m256i ok = _mm256_or_si256(_mm256_cmpeq_epi8(v, tab32), _mm256_cmpeq_epi8(v, nl32));
+        __m256i bad = _mm256_or_si256(_mm256_andnot_si256(ok, ctl), _mm256_cmpeq_epi8(v, del32));
+        if (_mm256_movemask_epi8(bad) == 0) {
+            keep_block(out, j, in, i, 32);
+            j += 32;
+            continue;
+        }
+        for (size_t k = i; k < i + 32; k++) {
+            if (is_display_byte(p[k])) out[j++] = (char)p[k];
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i ctl_max = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, ctl_max), v);
+        __m128i ok = _mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, nl));
+        __m128i bad = _mm_or_si128(_mm_andnot_si128(ok, ctl), _mm_cmpeq_epi8(v, del));
+        if (_mm_movemask_epi8(bad) == 0) {
+            keep_block(out, j, in, i, 16);
+            j += 16;
+            continue;
+        }
+        for (size_t k = i; k < i + 16; k++) {
+            if (is_display_byte(p[k])) out[j++] = (char)p[k];
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t nl = vdupq_n_u8('\n');
+    const uint8x16_t del = vdupq_n_u8(0x7f);
+    const uint8x16_t ctl_max = vdupq_n_u8(0x1f);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t ok = vorrq_u8(vceqq_u8(v, tab), vceqq_u8(v, nl));
+        uint8x16_t bad = vorrq_u8(vbicq_u8(vcleq_u8(v, ctl_max), ok), vceqq_u8(v, del));
+        if (vmaxvq_u8(bad) == 0) {
+            keep_block(out, j, in, i, 16);
+            j += 16;
+            continue;
+        }
+        for (size_t k = i; k < i + 16; k++) {
+            if (is_display_byte(p[k])) out[j++] = (char)p[k];
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (is_display_byte(p[i])) out[j++] = (char)p[i];
+    }
+    out[j] = '\0';
+    return j;
+}
+
+char* whisper_strip_control_chars(const char* input) {
+    if (!input) return NULL;
+    size_t len = strlen(input);
+    char* output = malloc(len + 1);
+    if (!output) return NULL;
+    whisper_strip_control_chars_into(input, len, output);
+    return output;
+}
+
+size_t whisper_utf8_cut(const char* s, size_t len, size_t max) {
+    if (len <= max) return len;
+    /* Back off to the lead byte of a sequence that would straddle max; a
+     * sequence is at most 4 bytes, so anything further is not UTF-8 and
+     * is cut as is */
+    size_t n = max;
+    while (n > 0 && max - n < 3 && ((unsigned char)s[n] & 0xC0) == 0x80) n--;
+    return n > 0 && ((unsigned char)s[n] & 0xC0) != 0x80 ? n : max;
+}
+
+int whisper_part_header(char* out, size_t size, unsigned int group, int index, int total) {
+    return snprintf(out, size, "[part %d/%d #%08x]\n", index, total, group & 0xffffffffu);
+}
+
+static size_t parse_number(const char* s, size_t len, int* value) {
+    size_t n = 0;
+    int v = 0;
+    while (n < len && n < 4 && s[n] >= '0' && s[n] <= '9') v = v * 10 + (s[n++] - '0');
+    *value = v;
+    return n;
+}
+
+size_t whisper_part_parse(const char* content, size_t len, unsigned int* group,
+                          int* index, int* total) {
+    static const char prefix[] = "[part ";
+    size_t pos = sizeof(prefix) - 1;
+    if (len < pos || memcmp(content, prefix, pos) != 0) return 0;
+
+    size_t n = parse_number(content + pos, len - pos, index);
+    if (n == 0) return 0;
+    pos += n;
+    if (pos >= len || content[pos++] != '/') return 0;
+    n = parse_number(content + pos, len - pos, total);
+    if (n == 0) return 0;
+    pos += n;
+    if (pos + 2 + 8 + 2 > len || content[pos] != ' ' || content[pos + 1] != '#') return 0;
+    pos += 2;
+
+    unsigned int g = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = content[pos++];
+        unsigned int d;
+        if (c >= '0' && c <= '9') {
+            d = (unsigned int)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            d = (unsigned int)(c - 'a' + 10);
+        } else {
+            return 0;
+        }
+        g = (g << 4) | d;
+    }
+    if (content[pos] != ']' || content[pos + 1] != '\n') return 0;
+    if (*index < 1 || *total < 1 || *index > *total || *total > WHISPER_PARTS_MAX) return 0;
+
+    *group = g;
+    return pos + 2;
+}
+
+static void part_set_clear(whisper_part_set* set) {
+    for (int i = 0; i < set->total; i++) {
+        if (!set->chunks[i]) continue;
+        wipe(set->chunks[i], set->lens[i]);
+        free(set->chunks[i]);
+    }
+    free(set->sender);
+    memset(set, 0, sizeof(*set));
+}
+
+int whisper_parts_add(whisper_parts* p, const char* sender, const char* content, size_t len,
+                      int64_t created_at, whisper_buf* out, int64_t* out_created_at) {
+    unsigned int group;
+    int index;
+    int total;
+    size_t header = whisper_part_parse(content, len, &group, &index, &total);
+    if (header == 0) return -1;
+
+    /* Find the set this part belongs to, or the slot to start it in */
+    whisper_part_set* set = NULL;
+    whisper_part_set* slot = NULL;
+    for (int i = 0; i < WHISPER_PARTS_PENDING; i++) {
+        whisper_part_set* s = &p->sets[i];
+        if (s->total == 0) {
+            if (!slot || slot->total != 0) slot = s;
+        } else if (s->group == group && s->total == total && strcmp(s->sender, sender) == 0) {
+            set = s;
+            break;
+        } else if (!slot || (slot->total != 0 && s->age < slot->age)) {
+            slot = s;
+        }
+    }
+    if (!set) {
+        /* Nothing free: the oldest incomplete message is given up on */
+        set = slot;
+        if (set->total != 0) part_set_clear(set);
+        size_t sender_len = strlen(sender);
+        set->sender = malloc(sender_len + 1);
+        if (!set->sender) return -1;
+        memcpy(set->sender, sender, sender_len + 1);
+        set->group = group;
+        set->total = total;
+        set->age = p->next_age++;
+    }
+
+    int i = index - 1;
+    if (set->chunks[i]) return 0;  /* the same part twice */
+    size_t chunk_len = len - header;
+    set->chunks[i] = malloc(chunk_len ? chunk_len : 1);
+    if (!set->chunks[i]) return 0;
+    memcpy(set->chunks[i], content + header, chunk_len);
+    set->lens[i] = chunk_len;
+    if (index == 1) set->created_at = created_at;
+    if (++set->have < set->total) return 0;
+
+    out->len = 0;
+    int rc = 1;
+    for (int k = 0; k < set->total && rc == 1; k++) {
+        if (whisper_buf_append(out, set->chunks[k], set->lens[k]) != 0) rc = -1;
+    }
+    if (rc == 1 && whisper_buf_append(out, "", 1) == 0) {
+        out->len--;
+    } else {
+        rc = -1;
+    }
+    *out_created_at = set->created_at;
+    part_set_clear(set);
+    return rc;
+}
+
+/* Part index of content (0 if it is not a part), and its group */
+static int part_index(const char* content, unsigned int* group) {
+    int index = 0;
+    int total;
+    if (!content || whisper_part_parse(content, strlen(content), group, &index, &total) == 0) {
+        return 0;
+    }
+    return index;
+}
+
+void whisper_parts_keep_newest(const char* const* contents, size_t count, size_t max_count,
+                               bool* keep) {
+    /* Walk back from the newest until max_count messages have started */
+    size_t first = 0;
+    if (max_count > 0) {
+        size_t messages = 0;
+        first = count;
+        while (first > 0) {
+            unsigned int group;
+            bool starts = part_index(contents[first - 1], &group) <= 1;
+            if (starts && messages == max_count) break;
+            if (starts) messages++;
+            first--;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        unsigned int group;
+        int index = part_index(contents[i], &group);
+        keep[i] = i >= first;
+        if (index <= 1 || first == 0) continue;
+
+        /* A later part goes wherever its part 1 went */
+        for (size_t j = 0; j < count; j++) {
+            unsigned int g;
+            if (part_index(contents[j], &g) == 1 && g == group) {
+                keep[i] = j >= first;
+                break;
+            }
+        }
+    }
+}
+
+void whisper_parts_free(whisper_parts* p) {
+    for (int i = 0; i < WHISPER_PARTS_PENDING; i++) {
+        if (p->sets[i].total != 0) part_set_clear(&p->sets[i]);
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * whisper text - Output buffering and escaping (no libnostr dependency)
+ */
+
+#ifndef WHISPER_TEXT_H
+#define WHISPER_TEXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Growable byte buffer, reused across messages */
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} whisper_buf;
+
+/* Buffer: make room for `extra` more bytes. Returns 0 or -1. */
+int whisper_buf_reserve(whisper_buf* b, size_t extra);
+
+/* Buffer: append raw bytes / a C string / formatted text. Return 0 or -1. */
+int whisper_buf_append(whisper_buf* b, const char* data, size_t len);
+int whisper_buf_puts(whisper_buf* b, const char* s);
+int whisper_buf_printf(whisper_buf* b, const char* fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/* Buffer: append the JSON string escaping of s[0..len) (without quotes) */
+int whisper_buf_append_json(whisper_buf* b, const char* s, size_t len);
+
+/* Buffer: wipe and free */
+void whisper_buf_free(whisper_buf* b);
+
+/* Strip terminal control characters (C0 except tab/newline, and DEL) from
+ * in[0..len) into out, which may equal in. out needs len + 1 bytes; the
+ * result is NUL-terminated. Returns the new length. */
+size_t whisper_strip_control_chars_into(const char* in, size_t len, char* out);
+
+/* Byte-at-a-time reference for the above (kept for tests) */
+size_t whisper_strip_control_chars_scalar(const char* in, size_t len, char* out);
+
+/* Strip control characters into a malloc'd copy (NULL on NULL/ENOMEM) */
+char* whisper_strip_control_chars(const char* input);
+
+/* Length of the leading run of s[0..len) that needs no JSON escaping */
+size_t whisper_json_safe_run(const char* s, size_t len);
+
+/* Longest prefix of s[0..len) of at most max bytes that does not cut a
+ * UTF-8 sequence in two */
+size_t whisper_utf8_cut(const char* s, size_t len, size_t max);
+
+/*
+ * Multipart messages: text too long for one DM goes out as up to
+ * WHISPER_PARTS_MAX DMs whose content starts with "[part <i>/<n> #<group>]\n"
+ * (i counts from 1, group is 8 hex digits shared by the parts). The header
+ * is plain text so other clients still show something readable.
+ */
+#define WHISPER_PARTS_MAX        64
+#define WHISPER_PARTS_PENDING    16      /* incomplete messages held at once */
+#define WHISPER_PART_HEADER_MAX  32
+
+/* Multipart: write the header for part index of total. Returns its length. */
+int whisper_part_header(char* out, size_t size, unsigned int group, int index, int total);
+
+/* Multipart: length of the header content starts with, or 0 if it is not a part */
+size_t whisper_part_parse(const char* content, size_t len, unsigned int* group,
+                          int* index, int* total);
+
+typedef struct {
+    char* sender;
+    unsigned int group;
+    int total;                   /* 0 = free slot */
+    int have;
+    int64_t created_at;          /* of part 1 */
+    unsigned long age;
+    char* chunks[WHISPER_PARTS_MAX];
+    size_t lens[WHISPER_PARTS_MAX];
+} whisper_part_set;
+
+/* Multipart: reassembly state, zero-initialized */
+typedef struct {
+    whisper_part_set sets[WHISPER_PARTS_PENDING];
+    unsigned long next_age;
+} whisper_parts;
+
+/* Multipart: feed one received message. Returns -1 if it is not a part (use
+ * it as is), 0 while parts are missing, or 1 with the whole text in out
+ * (NUL-terminated) and part 1's created_at in *out_created_at. */
+int whisper_parts_add(whisper_parts* p, const char* sender, const char* content, size_t len,
+                      int64_t created_at, whisper_buf* out, int64_t* out_created_at);
+
+/* Multipart: of contents[0..count), oldest first, set keep[i] for what the
+ * newest max_count messages are made of (all of it if max_count is 0). A
+ * --split message counts once, at part 1, and keeps all of its parts;
+ * parts are matched by group. */
+void whisper_parts_keep_newest(const char* const* contents, size_t count, size_t max_count,
+                               bool* keep);
+
+/* Multipart: wipe and free incomplete messages */
+void whisper_parts_free(whisper_parts* p);
+
+#endif /* WHISPER_TEXT_H */
@@ -14,9 +14,9 @@
 #ifndef _WIN32
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
 #else
 #include <windows.h>
-#define usleep(x) Sleep((x) / 1000)
 #endif
 
 #include "tui.h"
@@ -40,37 +40,168 @@ int whisper_tui(const whisper_tui_config* config) {
 #include <libwebsockets.h>
 
 #define MAX_MESSAGE_SIZE (64 * 1024)
-#define MAX_MESSAGES 1000
+#define MAX_MESSAGES 100000
+#define INITIAL_MESSAGES 256
+#define MAX_CONVERSATIONS 1024
+#define LIST_COLS 24
+#define LIST_MIN_TERM_COLS 60
+#define HISTORY_PAGE 200
+#define HISTORY_TIMEOUT_MS 5000
+#define SEEN_WRAPS 65536
+#define SEND_QUEUE 64
+#define SEND_ATTEMPTS 3
+#define SEND_RETRY_MS 1000
+
+/* Delivery state of our own messages */
+enum {
+    SEND_NONE = 0,               /* received, not ours */
+    SEND_PENDING,
+    SEND_DELIVERED,
+    SEND_FAILED
+};
 #define INPUT_ROWS 2
 
 #define MAX_ALPHA 1.0
 
+#define TIME_CHANNELS NCCHANNELS_INITIALIZER(100, 100, 100, 0, 0, 0)
+#define OUT_SENDER_CHANNELS NCCHANNELS_INITIALIZER(130, 170, 210, 0, 0, 0)
+#define IN_SENDER_CHANNELS NCCHANNELS_INITIALIZER(180, 160, 120, 0, 0, 0)
+#define OUT_CONTENT_CHANNELS NCCHANNELS_INITIALIZER(180, 200, 220, 0, 0, 0)
+#define IN_CONTENT_CHANNELS NCCHANNELS_INITIALIZER(200, 200, 200, 0, 0, 0)
+#define FAILED_CHANNELS NCCHANNELS_INITIALIZER(210, 110, 100, 0, 0, 0)
+#define ROW_CONTENT_MAX 512
+
+/* Content slab: size classes 32 B .. 4 KiB carved from 64 KiB chunks */
+#define SLAB_CLASSES 8
+#define SLAB_MIN_SIZE 32
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
 typedef struct tui_message {
+    uint64_t id;
     char sender_npub[20];
+    char time_str[6];
     char* content;
+    size_t content_size;         /* bytes reserved for content, for the slab */
+    uint8_t wrap_id[32];         /* zero for our own sends */
     time_t timestamp;
     bool is_outgoing;
+    uint8_t send_state;
     int fade_in_counter;
-    struct tui_message* next;
-    struct tui_message* prev;
 } tui_message;
 
+/* Content blocks are recycled through per-class free lists and the chunks
+ * are only returned at exit, so a full ring reuses what it evicts. Larger
+ * messages go straight to malloc. */
+typedef struct slab_block {
+    struct slab_block* next;
+} slab_block;
+
+typedef struct slab_chunk {
+    struct slab_chunk* next;
+} slab_chunk;
+
+typedef struct {
+    slab_block* free_lists[SLAB_CLASSES];
+    char* carve[SLAB_CLASSES];
+    size_t carve_left[SLAB_CLASSES];
+    slab_chunk* chunks;
+} content_slab;
+
+/* What a message-plane row currently shows; id 0 is a blank row */
+typedef struct {
+    uint64_t id;
+    bool changed;
+    char sender_npub[20];
+    char time_str[6];
+    bool is_outgoing;
+    uint8_t send_state;
+    size_t content_off;
+} tui_row;
+
+/* A DM waiting for the send worker to wrap and publish it */
+typedef struct {
+    nostr_key recipient;
+    char* content;
+    uint64_t message_id;
+} send_job;
+
+/* One peer's messages: a ring ordered by timestamp, index 0 the oldest */
+typedef struct {
+    nostr_key peer;
+    char label[20];
+    tui_message* messages;
+    int message_cap;
+    int message_head;
+    int message_count;
+    int scroll_offset;
+    int unread;
+    time_t cleared_at;           /* /clear: nothing this old comes back */
+} tui_conversation;
+
 typedef struct {
     struct notcurses* nc;
     struct ncplane* status_plane;
+    struct ncplane* list_plane;
     struct ncplane* message_plane;
     struct ncreader* input_reader;
 
-    nostr_relay* relay;
+    whisper_pool pool;
+    whisper_unwrapper unwrap;
+    whisper_peer_cache peers;
     nostr_privkey privkey;
     nostr_key pubkey;
     nostr_key recipient;
     bool has_recipient;
 
-    tui_message* messages_head;
-    tui_message* messages_tail;
-    int message_count;
-    int scroll_offset;
+    /* Every decrypted DM is kept under its peer; `active` is the one shown */
+    tui_conversation* conversations;
+    int conversation_count;
+    int conversation_cap;
+    int active;
+    uint64_t next_message_id;
+    content_slab slab;
+    unsigned list_version;
+    unsigned list_drawn;
+    whisper_idset seen_wraps;    /* parts of --split messages already taken */
+    whisper_parts parts;         /* --split messages still missing parts */
+    whisper_buf joined;
+    time_t started_at;           /* older messages don't count as unread */
+
+    /* Older pages, loaded off the UI thread when PgUp reaches the top */
+#ifndef _WIN32
+    pthread_t history_thread;
+    pthread_mutex_t history_lock;
+    pthread_cond_t history_cond;
+    bool history_started;
+    bool history_wanted;
+#endif
+    volatile sig_atomic_t history_stop;
+
+    /* Wrapping and publishing happen on a send worker, one DM at a time */
+#ifndef _WIN32
+    pthread_t send_thread;
+    pthread_mutex_t send_lock;
+    pthread_cond_t send_cond;
+    bool send_started;
+#endif
+    bool send_stop;
+    send_job send_queue[SEND_QUEUE];
+    int send_head;
+    int send_count;
+    volatile sig_atomic_t history_loading;
+    bool store_done;
+    bool relay_done;
+    whisper_store_pager store_pager;   /* opened by the first PgUp */
+    bool store_indexed;
+    int64_t relay_until;
+    char store_dir[512];
+
+    /* Row cache for the message plane, so redraws only touch changed rows */
+    tui_row* rows;
+    int row_count;
+    whisper_buf row_text;
+    char status_drawn[512];
+    int status_alpha;
 #ifndef _WIN32
     pthread_mutex_t messages_mutex;
 #else
@@ -80,20 +211,37 @@ typedef struct {
     volatile sig_atomic_t running;
     volatile sig_atomic_t connected;
     volatile sig_atomic_t needs_redraw;
+    whisper_wakeup wakeup;       /* lets relay and unwrap threads end the loop's wait */
 
     int idle_ticks;
     double fade_alpha;
 
     int timeout_ms;
-    const char* relay_url;
+    int jobs;
+    int rate_cap;
+    const char* const* relay_urls;
+    int relay_count;
     char status_text[256];
+#ifdef WHISPER_BENCH
+    whisper_tui_ingest_cb bench_ingest;
+    void* bench_data;
+#endif
 } tui_context;
 
 static volatile sig_atomic_t g_signal_received = 0;
+static whisper_wakeup* g_wakeup = NULL;
 
 static void signal_handler(int sig) {
     (void)sig;
     g_signal_received = 1;
+    /* The signal may land on a relay thread, so wake the loop explicitly */
+    if (g_wakeup) whisper_wakeup_signal(g_wakeup);
+}
+
+/* Safe from any thread: mark the screen stale and wake the event loop */
+static void request_redraw(tui_context* ctx) {
+    ctx->needs_redraw = true;
+    whisper_wakeup_signal(&ctx->wakeup);
 }
 
 static void messages_lock(tui_context* ctx) {
@@ -128,37 +276,47 @@ static void messages_mutex_destroy(tui_context* ctx) {
 #endif
 }
 
-static void format_short_npub(const nostr_key* key, char* out, size_t out_size) {
+static void format_short_npub(tui_context* ctx, const nostr_key* key,
+                              char* out, size_t out_size) {
     char full_npub[100];
-    nostr_key_to_bech32(key, "npub", full_npub, sizeof(full_npub));
+    whisper_peer_npub(&ctx->peers, key, full_npub, sizeof(full_npub));
     snprintf(out, out_size, "%.12s...", full_npub);
 }
 
 static void update_status_bar(tui_context* ctx) {
     if (!ctx->status_plane) return;
 
-    ncplane_erase(ctx->status_plane);
-
     unsigned cols;
     ncplane_dim_yx(ctx->status_plane, NULL, &cols);
 
     int alpha = (int)(ctx->fade_alpha * 180);
     if (alpha < 40) alpha = 40;
-    uint64_t chan = NCCHANNELS_INITIALIZER(alpha, alpha, alpha, 17, 17, 17);
-    ncplane_set_channels(ctx->status_plane, chan);
 
     char my_npub[20];
-    format_short_npub(&ctx->pubkey, my_npub, sizeof(my_npub));
+    format_short_npub(ctx, &ctx->pubkey, my_npub, sizeof(my_npub));
 
     char recipient_str[32] = "no recipient";
     if (ctx->has_recipient) {
-        format_short_npub(&ctx->recipient, recipient_str, sizeof(recipient_str));
+        format_short_npub(ctx, &ctx->recipient, recipient_str, sizeof(recipient_str));
     }
 
     const char* status = ctx->connected ? "connected" : "connecting...";
 
-    ncplane_printf_yx(ctx->status_plane, 0, 1, "whisper  %s  to: %s  %s",
-                      my_npub, recipient_str, status);
+    char line[sizeof(ctx->status_drawn)];
+    snprintf(line, sizeof(line), "whisper  %s  to: %s  %s", my_npub, recipient_str, status);
+
+    /* Unchanged text and fade level: leave the plane alone */
+    char drawn[sizeof(ctx->status_drawn)];
+    snprintf(drawn, sizeof(drawn), "%s|%u|%s", line, cols, ctx->status_text);
+    if (alpha == ctx->status_alpha && strcmp(drawn, ctx->status_drawn) == 0) return;
+    memcpy(ctx->status_drawn, drawn, sizeof(drawn));
+    ctx->status_alpha = alpha;
+
+    ncplane_erase(ctx->status_plane);
+    uint64_t chan = NCCHANNELS_INITIALIZER(alpha, alpha, alpha, 17, 17, 17);
+    ncplane_set_channels(ctx->status_plane, chan);
+
+    ncplane_printf_yx(ctx->status_plane, 0, 1, "%s", line);
 
     if (ctx->status_text[0]) {
         int pos = (int)cols - (int)strlen(ctx->status_text) - 2;
@@ -168,208 +326,462 @@ static void update_status_bar(tui_context* ctx) {
     }
 }
 
-static tui_message* create_message(const char* content, const nostr_key* sender,
-                                   time_t timestamp, bool is_outgoing) {
-    tui_message* msg = calloc(1, sizeof(tui_message));
-    if (!msg) return NULL;
+/* Smallest class holding size bytes, or -1 when it needs malloc */
+static int slab_class(size_t size) {
+    size_t block = SLAB_MIN_SIZE;
+    for (int cls = 0; cls < SLAB_CLASSES; cls++, block <<= 1) {
+        if (size <= block) return cls;
+    }
+    return -1;
+}
 
-    msg->content = whisper_strip_control_chars(content ? content : "");
-    if (!msg->content) {
-        free(msg);
-        return NULL;
+/* Caller holds the messages lock; size is rounded up to its class */
+static char* slab_alloc(content_slab* slab, size_t* size) {
+    int cls = slab_class(*size);
+    if (cls < 0) return malloc(*size);
+
+    size_t block = (size_t)SLAB_MIN_SIZE << cls;
+    *size = block;
+    if (slab->free_lists[cls]) {
+        slab_block* b = slab->free_lists[cls];
+        slab->free_lists[cls] = b->next;
+        return (char*)b;
+    }
+
+    if (slab->carve_left[cls] < block) {
+        slab_chunk* chunk = malloc(SLAB_CHUNK_SIZE);
+        if (!chunk) return NULL;
+        chunk->next = slab->chunks;
+        slab->chunks = chunk;
+        /* Keep blocks aligned: skip a whole minimum block for the header */
+        slab->carve[cls] = (char*)chunk + SLAB_MIN_SIZE;
+        slab->carve_left[cls] = SLAB_CHUNK_SIZE - SLAB_MIN_SIZE;
+    }
+    char* p = slab->carve[cls];
+    slab->carve[cls] += block;
+    slab->carve_left[cls] -= block;
+    return p;
+}
+
+/* Wipes the plaintext and returns the block to its free list */
+static void slab_free(content_slab* slab, char* p, size_t size) {
+    if (!p) return;
+    secure_wipe(p, size);
+    int cls = slab_class(size);
+    if (cls < 0) {
+        free(p);
+        return;
     }
+    slab_block* b = (slab_block*)p;
+    b->next = slab->free_lists[cls];
+    slab->free_lists[cls] = b;
+}
+
+static void slab_destroy(content_slab* slab) {
+    while (slab->chunks) {
+        slab_chunk* next = slab->chunks->next;
+        secure_wipe(slab->chunks, SLAB_CHUNK_SIZE);
+        free(slab->chunks);
+        slab->chunks = next;
+    }
+    memset(slab, 0, sizeof(*slab));
+}
+
+/* Fills in everything but the content, which add_message_sorted copies in */
+static void create_message(tui_context* ctx, const nostr_key* sender, time_t timestamp,
+                           bool is_outgoing, tui_message* msg) {
+    memset(msg, 0, sizeof(*msg));
+
     msg->timestamp = timestamp ? timestamp : time(NULL);
     msg->is_outgoing = is_outgoing;
+    msg->send_state = is_outgoing ? SEND_PENDING : SEND_NONE;
     msg->fade_in_counter = 0;
 
+    /* Formatted once here rather than on every redraw */
+    struct tm tm_buf;
+    if (localtime_r(&msg->timestamp, &tm_buf)) {
+        strftime(msg->time_str, sizeof(msg->time_str), "%H:%M", &tm_buf);
+    } else {
+        snprintf(msg->time_str, sizeof(msg->time_str), "??:??");
+    }
+
     if (sender && !is_outgoing) {
-        format_short_npub(sender, msg->sender_npub, sizeof(msg->sender_npub));
+        format_short_npub(ctx, sender, msg->sender_npub, sizeof(msg->sender_npub));
     }
+}
 
-    return msg;
+/* i-th message in timestamp order; caller holds the lock */
+static tui_message* message_at(tui_conversation* conv, int i) {
+    return &conv->messages[(conv->message_head + i) % conv->message_cap];
 }
 
-static void evict_oldest_message_locked(tui_context* ctx) {
-    if (!ctx->messages_head) return;
+/* Double the ring up to MAX_MESSAGES, unrolling it so the oldest is at 0 */
+static int grow_messages_locked(tui_conversation* conv) {
+    int cap = conv->message_cap ? conv->message_cap * 2 : INITIAL_MESSAGES;
+    if (cap > MAX_MESSAGES) cap = MAX_MESSAGES;
+    if (cap <= conv->message_cap) return -1;
 
-    tui_message* oldest = ctx->messages_head;
-    ctx->messages_head = oldest->next;
-    if (ctx->messages_head) {
-        ctx->messages_head->prev = NULL;
-    } else {
-        ctx->messages_tail = NULL;
+    tui_message* grown = malloc((size_t)cap * sizeof(*grown));
+    if (!grown) return -1;
+    for (int i = 0; i < conv->message_count; i++) {
+        grown[i] = *message_at(conv, i);
+    }
+    free(conv->messages);
+    conv->messages = grown;
+    conv->message_cap = cap;
+    conv->message_head = 0;
+    return 0;
+}
+
+/* First index whose timestamp is later than ts */
+static int upper_bound_locked(tui_conversation* conv, time_t ts) {
+    int lo = 0, hi = conv->message_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (message_at(conv, mid)->timestamp <= ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void evict_oldest_message_locked(tui_context* ctx, tui_conversation* conv) {
+    if (conv->message_count == 0) return;
+
+    tui_message* oldest = message_at(conv, 0);
+    slab_free(&ctx->slab, oldest->content, oldest->content_size);
+    conv->message_head = (conv->message_head + 1) % conv->message_cap;
+    conv->message_count--;
+}
+
+/* Paging older history into a full ring gives up the newest instead */
+static void evict_newest_message_locked(tui_context* ctx, tui_conversation* conv) {
+    if (conv->message_count == 0) return;
+
+    tui_message* newest = message_at(conv, conv->message_count - 1);
+    slab_free(&ctx->slab, newest->content, newest->content_size);
+    conv->message_count--;
+    if (conv->scroll_offset > 0) conv->scroll_offset--;
+}
+
+/* True if the ring already holds this gift wrap; copies share a timestamp */
+static bool holds_wrap_locked(tui_conversation* conv, time_t ts, const uint8_t* wrap_id) {
+    for (int i = upper_bound_locked(conv, ts) - 1; i >= 0; i--) {
+        const tui_message* m = message_at(conv, i);
+        if (m->timestamp != ts) break;
+        if (memcmp(m->wrap_id, wrap_id, 32) == 0) return true;
     }
-    ctx->message_count--;
-    free(oldest->content);
-    free(oldest);
+    return false;
 }
 
-static void add_message_sorted(tui_context* ctx, tui_message* msg) {
+/* Conversation with peer, created on first use; caller holds the lock */
+static tui_conversation* conversation_for(tui_context* ctx, const nostr_key* peer) {
+    for (int i = 0; i < ctx->conversation_count; i++) {
+        if (memcmp(&ctx->conversations[i].peer, peer, sizeof(*peer)) == 0) {
+            return &ctx->conversations[i];
+        }
+    }
+    if (ctx->conversation_count == ctx->conversation_cap) {
+        int cap = ctx->conversation_cap ? ctx->conversation_cap * 2 : 16;
+        if (cap > MAX_CONVERSATIONS) cap = MAX_CONVERSATIONS;
+        if (cap <= ctx->conversation_cap) return NULL;
+        tui_conversation* grown = realloc(ctx->conversations, (size_t)cap * sizeof(*grown));
+        if (!grown) return NULL;
+        ctx->conversations = grown;
+        ctx->conversation_cap = cap;
+    }
+
+    tui_conversation* conv = &ctx->conversations[ctx->conversation_count++];
+    memset(conv, 0, sizeof(*conv));
+    conv->peer = *peer;
+    format_short_npub(ctx, peer, conv->label, sizeof(conv->label));
+    ctx->list_version++;
+    return conv;
+}
+
+static tui_conversation* active_conversation(tui_context* ctx) {
+    return ctx->active >= 0 ? &ctx->conversations[ctx->active] : NULL;
+}
+
+/* Copies content, stripped of control characters, into peer's buffer.
+ * wrap_id (NULL for our own sends) drops a DM the ring already holds;
+ * parts of a --split message are held back and added once, joined. */
+static bool add_message_sorted(tui_context* ctx, const nostr_key* peer, tui_message* msg,
+                               const char* content, const uint8_t* wrap_id) {
+    if (!content) content = "";
+    size_t len = strlen(content);
+
+    int joined = -1;           /* not a part */
+
     messages_lock(ctx);
 
-    tui_message* insert_after = NULL;
-    for (tui_message* m = ctx->messages_tail; m; m = m->prev) {
-        if (m->timestamp <= msg->timestamp) {
-            insert_after = m;
-            break;
+    /* Parts already taken; whole messages are checked against the ring */
+    if (wrap_id && whisper_idset_contains(&ctx->seen_wraps, wrap_id)) {
+        messages_unlock(ctx);
+        return false;
+    }
+
+    if (wrap_id) {
+        char peer_hex[65];
+        int64_t first_at = 0;
+        nostr_key_to_hex(peer, peer_hex, sizeof(peer_hex));
+        joined = whisper_parts_add(&ctx->parts, peer_hex, content, len,
+                                   (int64_t)msg->timestamp, &ctx->joined, &first_at);
+        if (joined == 0) {
+            whisper_idset_insert(&ctx->seen_wraps, wrap_id);
+            messages_unlock(ctx);
+            return false;
+        }
+        if (joined == 1) {
+            content = ctx->joined.data;
+            len = ctx->joined.len;
+            if ((time_t)first_at != msg->timestamp) {
+                create_message(ctx, peer, (time_t)first_at, false, msg);
+            }
         }
     }
 
-    if (!insert_after) {
-        msg->prev = NULL;
-        msg->next = ctx->messages_head;
-        if (ctx->messages_head) {
-            ctx->messages_head->prev = msg;
+    tui_conversation* conv = conversation_for(ctx, peer);
+    if (!conv || (wrap_id && (msg->timestamp <= conv->cleared_at ||
+                              holds_wrap_locked(conv, msg->timestamp, wrap_id)))) {
+        messages_unlock(ctx);
+        return false;
+    }
+
+    if (conv->message_count == conv->message_cap && grow_messages_locked(conv) != 0 &&
+        conv->message_count == 0) {
+        messages_unlock(ctx);
+        return false;
+    }
+
+    int pos = upper_bound_locked(conv, msg->timestamp);
+    if (conv->message_count == conv->message_cap) {
+        /* Evict first so the new content can reuse the freed block */
+        if (pos > 0) {
+            evict_oldest_message_locked(ctx, conv);
+            pos--;
+        } else if (ctx->history_loading) {
+            evict_newest_message_locked(ctx, conv);
+        } else {
+            /* Full, and older than everything we keep */
+            messages_unlock(ctx);
+            return false;
         }
-        ctx->messages_head = msg;
-        if (!ctx->messages_tail) {
-            ctx->messages_tail = msg;
+    }
+
+    msg->content_size = len + 1;
+    msg->content = slab_alloc(&ctx->slab, &msg->content_size);
+    if (!msg->content) {
+        messages_unlock(ctx);
+        return false;
+    }
+    whisper_strip_control_chars_into(content, len, msg->content);
+    if (wrap_id) {
+        memcpy(msg->wrap_id, wrap_id, 32);
+        /* A late copy of the last part must not start a new set */
+        if (joined == 1) whisper_idset_insert(&ctx->seen_wraps, wrap_id);
+    }
+
+    /* Open a gap at pos by moving whichever side is shorter */
+    if (pos < conv->message_count / 2) {
+        conv->message_head = (conv->message_head + conv->message_cap - 1) % conv->message_cap;
+        for (int i = 0; i < pos; i++) {
+            *message_at(conv, i) = *message_at(conv, i + 1);
         }
     } else {
-        msg->prev = insert_after;
-        msg->next = insert_after->next;
-        if (insert_after->next) {
-            insert_after->next->prev = msg;
-        }
-        insert_after->next = msg;
-        if (ctx->messages_tail == insert_after) {
-            ctx->messages_tail = msg;
+        for (int i = conv->message_count; i > pos; i--) {
+            *message_at(conv, i) = *message_at(conv, i - 1);
         }
     }
+    bool newest = pos == conv->message_count;
+    msg->id = ++ctx->next_message_id;
+    *message_at(conv, pos) = *msg;
+    conv->message_count++;
+
+    /* Scroll offsets count from the newest message, so older pages slot in
+     * above the view without moving it; only a new arrival jumps down */
+    bool shown = conv == active_conversation(ctx);
+    if (shown) {
+        if (newest) conv->scroll_offset = 0;
+    } else if (!msg->is_outgoing && msg->timestamp >= ctx->started_at) {
+        conv->unread++;
+        ctx->list_version++;
+    }
 
-    ctx->message_count++;
+    messages_unlock(ctx);
 
-    while (ctx->message_count > MAX_MESSAGES) {
-        evict_oldest_message_locked(ctx);
+    if (shown) {
+        ctx->idle_ticks = 0;
+        ctx->fade_alpha = MAX_ALPHA;
     }
+    request_redraw(ctx);
+    return true;
+}
 
-    ctx->scroll_offset = 0;
+static void free_conversation_messages(tui_context* ctx, tui_conversation* conv) {
+    for (int i = 0; i < conv->message_count; i++) {
+        tui_message* msg = message_at(conv, i);
+        slab_free(&ctx->slab, msg->content, msg->content_size);
+    }
+    conv->message_head = 0;
+    conv->message_count = 0;
+    conv->scroll_offset = 0;
+}
 
+/* /clear: drop what the open conversation shows */
+static void clear_active_conversation(tui_context* ctx) {
+    messages_lock(ctx);
+    tui_conversation* conv = active_conversation(ctx);
+    if (conv && conv->message_count > 0) {
+        conv->cleared_at = message_at(conv, conv->message_count - 1)->timestamp;
+    }
+    if (conv) free_conversation_messages(ctx, conv);
     messages_unlock(ctx);
+}
 
-    ctx->idle_ticks = 0;
-    ctx->fade_alpha = MAX_ALPHA;
-    ctx->needs_redraw = true;
+/* Make peer the open conversation: a view switch, nothing is refetched */
+static int switch_conversation(tui_context* ctx, const nostr_key* peer) {
+    messages_lock(ctx);
+    tui_conversation* conv = conversation_for(ctx, peer);
+    if (conv) {
+        ctx->active = (int)(conv - ctx->conversations);
+        conv->unread = 0;
+        ctx->list_version++;
+        ctx->recipient = *peer;
+        ctx->has_recipient = true;
+    }
+    messages_unlock(ctx);
+    return conv ? 0 : -1;
 }
 
-static void free_message(tui_message* msg) {
-    if (!msg) return;
-    free(msg->content);
-    free(msg);
+/* Ctrl-N / Ctrl-P: step through the conversation list */
+static void cycle_conversation(tui_context* ctx, int step) {
+    messages_lock(ctx);
+    int count = ctx->conversation_count;
+    nostr_key peer;
+    bool found = count > 0;
+    if (found) {
+        int next = ctx->active < 0 ? 0 : ((ctx->active + step) % count + count) % count;
+        peer = ctx->conversations[next].peer;
+    }
+    messages_unlock(ctx);
+    if (found) switch_conversation(ctx, &peer);
 }
 
-static void free_all_messages(tui_context* ctx) {
+static void free_all_conversations(tui_context* ctx) {
     messages_lock(ctx);
-    tui_message* msg = ctx->messages_head;
-    while (msg) {
-        tui_message* next = msg->next;
-        free_message(msg);
-        msg = next;
-    }
-    ctx->messages_head = NULL;
-    ctx->messages_tail = NULL;
-    ctx->message_count = 0;
-    ctx->scroll_offset = 0;
+    for (int i = 0; i < ctx->conversation_count; i++) {
+        free_conversation_messages(ctx, &ctx->conversations[i]);
+        free(ctx->conversations[i].messages);
+    }
+    free(ctx->conversations);
+    ctx->conversations = NULL;
+    ctx->conversation_count = 0;
+    ctx->conversation_cap = 0;
+    ctx->active = -1;
+    whisper_parts_free(&ctx->parts);
+    whisper_buf_free(&ctx->joined);
     messages_unlock(ctx);
 }
 
-static void relay_state_cb(nostr_relay* relay, nostr_relay_state state, void* user_data) {
-    (void)relay;
+static void relay_state_cb(whisper_pool_relay* conn, nostr_relay_state state, void* user_data) {
     tui_context* ctx = (tui_context*)user_data;
+    int up = whisper_pool_connected_count(&ctx->pool);
 
+    ctx->connected = up > 0;
     switch (state) {
         case NOSTR_RELAY_CONNECTED:
-            ctx->connected = true;
-            snprintf(ctx->status_text, sizeof(ctx->status_text), "Connected");
+            if (ctx->pool.count > 1) {
+                snprintf(ctx->status_text, sizeof(ctx->status_text),
+                         "Connected %d/%d", up, ctx->pool.count);
+            } else {
+                snprintf(ctx->status_text, sizeof(ctx->status_text), "Connected");
+            }
             break;
         case NOSTR_RELAY_ERROR:
-            ctx->connected = false;
-            snprintf(ctx->status_text, sizeof(ctx->status_text), "Connection error");
+            snprintf(ctx->status_text, sizeof(ctx->status_text), "Connection error%s%.40s",
+                     ctx->pool.count > 1 ? ": " : "", ctx->pool.count > 1 ? conn->url : "");
             break;
         case NOSTR_RELAY_DISCONNECTED:
-            ctx->connected = false;
-            ctx->running = false;
-            snprintf(ctx->status_text, sizeof(ctx->status_text), "Disconnected");
+            /* The event loop redials; it gives up only when nothing can come back */
+            if (!ctx->connected) {
+                snprintf(ctx->status_text, sizeof(ctx->status_text), "Reconnecting...");
+            }
             break;
         default:
             break;
     }
-    ctx->needs_redraw = true;
+    request_redraw(ctx);
 }
 
-static void message_cb(const char* message_type, const char* data, void* user_data) {
+static void message_cb(whisper_pool_relay* conn, const char* message_type,
+                       const char* data, void* user_data) {
+    (void)conn;
     tui_context* ctx = (tui_context*)user_data;
 
-    if (strcmp(message_type, "OK") == 0) {
-        snprintf(ctx->status_text, sizeof(ctx->status_text), "Sent");
-    } else if (strcmp(message_type, "NOTICE") == 0) {
+    /* OKs are matched to our event by the pool; the send worker reports them */
+    if (strcmp(message_type, "NOTICE") == 0) {
         snprintf(ctx->status_text, sizeof(ctx->status_text), "Notice: %.50s", data);
     } else if (strcmp(message_type, "EOSE") == 0) {
         snprintf(ctx->status_text, sizeof(ctx->status_text), "Ready");
     }
-    ctx->needs_redraw = true;
+    request_redraw(ctx);
 }
 
-static void event_cb(const nostr_event* event, void* user_data) {
+/* Relay thread: hand the gift wrap to the unwrap workers */
+static void event_cb(whisper_pool_relay* conn, const nostr_event* event, void* user_data) {
+    (void)conn;
     tui_context* ctx = (tui_context*)user_data;
+    whisper_unwrap_submit(&ctx->unwrap, event, 0);
+}
 
-    if (event->kind != 1059) return;
-
-    nostr_event* rumor = NULL;
-    nostr_key sender_pubkey;
-    nostr_error_t err = nostr_nip17_unwrap_dm(event, &ctx->privkey, &rumor, &sender_pubkey);
-
-    if (err != NOSTR_OK) return;
-
-    if (ctx->has_recipient && memcmp(&sender_pubkey, &ctx->recipient, sizeof(nostr_key)) != 0) {
-        nostr_event_destroy(rumor);
-        return;
-    }
-
-    tui_message* msg = create_message(rumor->content, &sender_pubkey,
-                                      rumor->created_at, false);
-    if (msg) {
-        add_message_sorted(ctx, msg);
-    }
+/* Unwrap worker: file every DM under its sender, shown or not */
+static void rumor_cb(const whisper_unwrapped* dm, void* user_data) {
+    const nostr_event* rumor = dm->rumor;
+    const nostr_key* sender = &dm->sender;
+    tui_context* ctx = (tui_context*)user_data;
 
-    nostr_event_destroy(rumor);
-    ctx->needs_redraw = true;
+    tui_message msg;
+    create_message(ctx, sender, rumor->created_at, false, &msg);
+    add_message_sorted(ctx, sender, &msg, rumor->content, dm->wrap_id);
+#ifdef WHISPER_BENCH
+    if (ctx->bench_ingest) ctx->bench_ingest(rumor->content, ctx->bench_data);
+#endif
 }
 
 static int connect_relay(tui_context* ctx) {
-    if (ctx->relay_url && strncmp(ctx->relay_url, "wss://", 6) != 0) {
-        snprintf(ctx->status_text, sizeof(ctx->status_text),
-                 "Warning: insecure relay (not wss://)");
+    for (int i = 0; i < ctx->relay_count; i++) {
+        if (strncmp(ctx->relay_urls[i], "wss://", 6) != 0) {
+            snprintf(ctx->status_text, sizeof(ctx->status_text),
+                     "Warning: insecure relay (not wss://)");
+        }
     }
 
-    if (nostr_relay_create(&ctx->relay, ctx->relay_url) != NOSTR_OK) {
-        return -1;
-    }
+    whisper_unwrap_start(&ctx->unwrap, &ctx->privkey, 1, ctx->jobs, false, rumor_cb, ctx);
 
-    nostr_relay_set_message_callback(ctx->relay, message_cb, ctx);
+    ctx->pool.on_state = relay_state_cb;
+    ctx->pool.on_message = message_cb;
+    ctx->pool.on_event = event_cb;
+    ctx->pool.user_data = ctx;
+    whisper_prefilter_init(&ctx->pool.filter, &ctx->pubkey, 0, ctx->rate_cap);
 
-    if (nostr_relay_connect(ctx->relay, relay_state_cb, ctx) != NOSTR_OK) {
-        nostr_relay_destroy(ctx->relay);
-        ctx->relay = NULL;
+    if (whisper_pool_open(&ctx->pool, ctx->relay_urls, ctx->relay_count) <= 0) {
         return -1;
     }
 
     int timeout_ms = (ctx->timeout_ms > 0) ? ctx->timeout_ms : WHISPER_DEFAULT_TIMEOUT_MS;
-    int elapsed_ms = 0;
-    while (!ctx->connected && ctx->running && elapsed_ms < timeout_ms) {
-        usleep(100000);
-        elapsed_ms += 100;
-    }
-
-    if (!ctx->connected) {
+    if (whisper_pool_wait_connected(&ctx->pool, 1, timeout_ms) == 0) {
         return -1;
     }
 
     return 0;
 }
 
+/* Subscribes every connected relay that isn't yet; cheap to call repeatedly */
 static int subscribe_dms(tui_context* ctx) {
-    if (!ctx->relay || !ctx->connected) return -1;
+    if (!ctx->connected) return -1;
 
     char pubkey_hex[65];
     nostr_key_to_hex(&ctx->pubkey, pubkey_hex, sizeof(pubkey_hex));
@@ -378,13 +790,318 @@ static int subscribe_dms(tui_context* ctx) {
     snprintf(filter, sizeof(filter),
              "{\"kinds\":[1059],\"#p\":[\"%s\"]}", pubkey_hex);
 
-    if (nostr_subscribe(ctx->relay, "dm-inbox", filter, event_cb, ctx) != NOSTR_OK) {
+    if (whisper_pool_subscribe(&ctx->pool, "dm-inbox", filter) <= 0) {
         return -1;
     }
 
     return 0;
 }
 
+typedef struct {
+    tui_context* ctx;
+    int fresh;
+} history_page;
+
+static void store_page_cb(const uint8_t wrap_id[32], const char* from_npub,
+                          const char* content, int64_t created_at, void* user_data) {
+    history_page* hp = (history_page*)user_data;
+    nostr_key sender;
+    if (whisper_peer_parse(&hp->ctx->peers, from_npub, &sender) != 0) return;
+
+    tui_message msg;
+    create_message(hp->ctx, &sender, (time_t)created_at, false, &msg);
+    if (add_message_sorted(hp->ctx, &sender, &msg, content, wrap_id)) hp->fresh++;
+}
+
+/* Older messages from the local inbox (the recv --store file), if any.
+ * The inbox is indexed once; pages that only repeat what is on screen are
+ * skipped. */
+static int load_store_page(tui_context* ctx) {
+    if (!ctx->store_done && !ctx->store_indexed) {
+        ctx->store_indexed = true;
+        if (whisper_store_pager_open(&ctx->store_pager, ctx->store_dir, &ctx->pubkey) != 0) {
+            ctx->store_done = true;
+        }
+    }
+
+    history_page hp = { ctx, 0 };
+    while (!ctx->store_done && hp.fresh == 0 && !ctx->history_stop) {
+        whisper_store_pager_next(&ctx->store_pager, HISTORY_PAGE, store_page_cb, &hp);
+        if (ctx->store_pager.next >= ctx->store_pager.count) ctx->store_done = true;
+    }
+    return hp.fresh;
+}
+
+/* Older gift wraps from the relays, a page at a time through the same
+ * whisper_pool_fetch_older walk recv --limit uses. Events go through
+ * event_cb as usual. */
+static int load_relay_page(tui_context* ctx) {
+    if (!ctx->connected) return 0;
+
+    int64_t until = ctx->relay_until;
+    if (until == 0) {
+        whisper_mutex_lock(&ctx->pool.event_lock);
+        for (int i = 0; i < ctx->pool.count; i++) {
+            if (ctx->pool.relays[i].oldest_created_at > until) {
+                until = ctx->pool.relays[i].oldest_created_at;
+            }
+        }
+        whisper_mutex_unlock(&ctx->pool.event_lock);
+        if (until == 0) {
+            ctx->relay_done = true;
+            return 0;
+        }
+    }
+
+    int fresh = 0;
+    while (!ctx->relay_done && fresh == 0 && !ctx->history_stop) {
+        bool exhausted;
+        int n = whisper_pool_fetch_older(&ctx->pool, "dm-history", 0, &until, HISTORY_PAGE,
+                                         HISTORY_TIMEOUT_MS, &exhausted);
+        if (n < 0) break;
+        fresh = n;
+        if (exhausted) ctx->relay_done = true;
+    }
+    ctx->relay_until = until;
+
+    /* Let the page decrypt so "Loaded" means it is on screen */
+    whisper_unwrap_wait_idle(&ctx->unwrap);
+    return fresh;
+}
+
+#ifndef _WIN32
+
+static void* history_main(void* arg) {
+    tui_context* ctx = (tui_context*)arg;
+
+    pthread_mutex_lock(&ctx->history_lock);
+    for (;;) {
+        while (!ctx->history_wanted && !ctx->history_stop) {
+            pthread_cond_wait(&ctx->history_cond, &ctx->history_lock);
+        }
+        if (ctx->history_stop) break;
+        ctx->history_wanted = false;
+        pthread_mutex_unlock(&ctx->history_lock);
+
+        ctx->history_loading = 1;
+        snprintf(ctx->status_text, sizeof(ctx->status_text), "Loading older messages...");
+        request_redraw(ctx);
+
+        int fresh = load_store_page(ctx);
+        if (fresh == 0) fresh = load_relay_page(ctx);
+
+        if (fresh > 0) {
+            snprintf(ctx->status_text, sizeof(ctx->status_text), "Loaded %d older", fresh);
+        } else if (ctx->store_done && ctx->relay_done) {
+            snprintf(ctx->status_text, sizeof(ctx->status_text), "No older messages");
+        } else {
+            snprintf(ctx->status_text, sizeof(ctx->status_text), "History unavailable");
+        }
+        ctx->history_loading = 0;
+        request_redraw(ctx);
+
+        pthread_mutex_lock(&ctx->history_lock);
+    }
+    pthread_mutex_unlock(&ctx->history_lock);
+    return NULL;
+}
+
+#endif
+
+/* store_dir is the recv --store inbox to page from (NULL = the default) */
+static void start_history(tui_context* ctx, const char* store_dir) {
+    if (store_dir) {
+        snprintf(ctx->store_dir, sizeof(ctx->store_dir), "%s", store_dir);
+    } else if (!whisper_store_default_dir(ctx->store_dir, sizeof(ctx->store_dir))) {
+        ctx->store_done = true;
+    }
+#ifndef _WIN32
+    pthread_mutex_init(&ctx->history_lock, NULL);
+    pthread_cond_init(&ctx->history_cond, NULL);
+    ctx->history_started = pthread_create(&ctx->history_thread, NULL, history_main, ctx) == 0;
+    if (!ctx->history_started) {
+        pthread_cond_destroy(&ctx->history_cond);
+        pthread_mutex_destroy(&ctx->history_lock);
+    }
+#endif
+}
+
+/* PgUp at the top of the buffer */
+static void request_history(tui_context* ctx) {
+    if (ctx->history_loading) return;
+    if (ctx->store_done && ctx->relay_done) {
+        snprintf(ctx->status_text, sizeof(ctx->status_text), "No older messages");
+        return;
+    }
+#ifndef _WIN32
+    if (ctx->history_started) {
+        pthread_mutex_lock(&ctx->history_lock);
+        ctx->history_wanted = true;
+        pthread_cond_signal(&ctx->history_cond);
+        pthread_mutex_unlock(&ctx->history_lock);
+        return;
+    }
+#endif
+    snprintf(ctx->status_text, sizeof(ctx->status_text), "History paging unavailable");
+}
+
+/* Before the pool closes: a page in flight ends within HISTORY_TIMEOUT_MS */
+static void stop_history(tui_context* ctx) {
+    ctx->history_stop = 1;
+#ifndef _WIN32
+    if (ctx->history_started) {
+        pthread_mutex_lock(&ctx->history_lock);
+        pthread_cond_signal(&ctx->history_cond);
+        pthread_mutex_unlock(&ctx->history_lock);
+        pthread_join(ctx->history_thread, NULL);
+        pthread_cond_destroy(&ctx->history_cond);
+        pthread_mutex_destroy(&ctx->history_lock);
+        ctx->history_started = false;
+    }
+#endif
+    whisper_store_pager_close(&ctx->store_pager);
+}
+
+/* Mark our message id in peer's conversation; it may be gone after /clear */
+static void set_send_state(tui_context* ctx, const nostr_key* peer, uint64_t id, uint8_t state) {
+    messages_lock(ctx);
+    for (int c = 0; c < ctx->conversation_count; c++) {
+        tui_conversation* conv = &ctx->conversations[c];
+        if (memcmp(&conv->peer, peer, sizeof(*peer)) != 0) continue;
+        /* Sends are recent, so search from the newest end */
+        for (int i = conv->message_count - 1; i >= 0; i--) {
+            tui_message* msg = message_at(conv, i);
+            if (msg->id == id) {
+                msg->send_state = state;
+                break;
+            }
+        }
+        break;
+    }
+    messages_unlock(ctx);
+    request_redraw(ctx);
+}
+
+static void free_send_job(send_job* job) {
+    if (job->content) {
+        secure_wipe(job->content, strlen(job->content));
+        free(job->content);
+    }
+    memset(job, 0, sizeof(*job));
+}
+
+/* Wrap once, then publish until a relay's OK for this event id arrives */
+static void run_send_job(tui_context* ctx, send_job* job) {
+    nostr_event* dm = NULL;
+    int64_t start = whisper_now_us();
+    nostr_error_t err = nostr_nip17_send_dm(&dm, job->content, &ctx->privkey, &job->recipient,
+                                            NULL, NULL, 0);
+    whisper_stats_observe(WHISPER_LAT_WRAP, whisper_now_us() - start);
+    if (err != NOSTR_OK) {
+        set_send_state(ctx, &job->recipient, job->message_id, SEND_FAILED);
+        snprintf(ctx->status_text, sizeof(ctx->status_text), "Failed to create DM");
+        request_redraw(ctx);
+        return;
+    }
+
+    int timeout_ms = (ctx->timeout_ms > 0) ? ctx->timeout_ms : WHISPER_DEFAULT_TIMEOUT_MS;
+    int accepted = 0;
+    for (int attempt = 1; attempt <= SEND_ATTEMPTS && !ctx->send_stop; attempt++) {
+        /* Relays drop a repeat of an event they hold, so resending is safe */
+        accepted = whisper_pool_publish(&ctx->pool, dm, 1, timeout_ms);
+        if (accepted > 0 || attempt == SEND_ATTEMPTS) break;
+
+        snprintf(ctx->status_text, sizeof(ctx->status_text), "Retrying send (%d/%d)...",
+                 attempt + 1, SEND_ATTEMPTS);
+        request_redraw(ctx);
+#ifndef _WIN32
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        int64_t ns = until.tv_nsec + (int64_t)SEND_RETRY_MS * attempt * 1000000;
+        until.tv_sec += (time_t)(ns / 1000000000);
+        until.tv_nsec = (long)(ns % 1000000000);
+        pthread_mutex_lock(&ctx->send_lock);
+        while (!ctx->send_stop &&
+               pthread_cond_timedwait(&ctx->send_cond, &ctx->send_lock, &until) == 0) {
+        }
+        pthread_mutex_unlock(&ctx->send_lock);
+#else
+        Sleep(SEND_RETRY_MS * attempt);
+#endif
+    }
+    nostr_event_destroy(dm);
+
+    set_send_state(ctx, &job->recipient, job->message_id,
+                   accepted > 0 ? SEND_DELIVERED : SEND_FAILED);
+    snprintf(ctx->status_text, sizeof(ctx->status_text), accepted > 0 ? "Sent" : "Send failed");
+    request_redraw(ctx);
+}
+
+#ifndef _WIN32
+
+static void* send_main(void* arg) {
+    tui_context* ctx = (tui_context*)arg;
+
+    pthread_mutex_lock(&ctx->send_lock);
+    for (;;) {
+        while (ctx->send_count == 0 && !ctx->send_stop) {
+            pthread_cond_wait(&ctx->send_cond, &ctx->send_lock);
+        }
+        if (ctx->send_stop) break;
+
+        send_job job = ctx->send_queue[ctx->send_head];
+        memset(&ctx->send_queue[ctx->send_head], 0, sizeof(job));
+        ctx->send_head = (ctx->send_head + 1) % SEND_QUEUE;
+        ctx->send_count--;
+        pthread_mutex_unlock(&ctx->send_lock);
+
+        run_send_job(ctx, &job);
+        free_send_job(&job);
+
+        pthread_mutex_lock(&ctx->send_lock);
+    }
+    pthread_mutex_unlock(&ctx->send_lock);
+    return NULL;
+}
+
+#endif
+
+static void start_sender(tui_context* ctx) {
+#ifndef _WIN32
+    pthread_mutex_init(&ctx->send_lock, NULL);
+    pthread_cond_init(&ctx->send_cond, NULL);
+    ctx->send_started = pthread_create(&ctx->send_thread, NULL, send_main, ctx) == 0;
+    if (!ctx->send_started) {
+        pthread_cond_destroy(&ctx->send_cond);
+        pthread_mutex_destroy(&ctx->send_lock);
+    }
+#else
+    (void)ctx;
+#endif
+}
+
+/* Before the pool closes; unsent DMs are dropped (and wiped) */
+static void stop_sender(tui_context* ctx) {
+#ifndef _WIN32
+    if (ctx->send_started) {
+        pthread_mutex_lock(&ctx->send_lock);
+        ctx->send_stop = true;
+        pthread_cond_broadcast(&ctx->send_cond);
+        pthread_mutex_unlock(&ctx->send_lock);
+        pthread_join(ctx->send_thread, NULL);
+        pthread_cond_destroy(&ctx->send_cond);
+        pthread_mutex_destroy(&ctx->send_lock);
+        ctx->send_started = false;
+    }
+#endif
+    ctx->send_stop = true;
+    for (int i = 0; i < ctx->send_count; i++) {
+        free_send_job(&ctx->send_queue[(ctx->send_head + i) % SEND_QUEUE]);
+    }
+    ctx->send_count = 0;
+}
+
+/* Input thread: show the message as pending now, hand the crypto to the worker */
 static void send_dm(tui_context* ctx, const char* content) {
     if (!ctx->has_recipient) {
         snprintf(ctx->status_text, sizeof(ctx->status_text),
@@ -393,51 +1110,76 @@ static void send_dm(tui_context* ctx, const char* content) {
         return;
     }
 
-    if (!ctx->relay || !ctx->connected) {
+    if (!ctx->connected) {
         snprintf(ctx->status_text, sizeof(ctx->status_text), "Not connected");
         ctx->needs_redraw = true;
         return;
     }
 
-    nostr_event* dm = NULL;
-    nostr_error_t err = nostr_nip17_send_dm(
-        &dm, content, &ctx->privkey, &ctx->recipient,
-        NULL, NULL, 0);
-
-    if (err != NOSTR_OK) {
-        snprintf(ctx->status_text, sizeof(ctx->status_text),
-                 "Failed to create DM");
+    send_job job = { .recipient = ctx->recipient };
+    job.content = strdup(content);
+    if (!job.content) {
+        snprintf(ctx->status_text, sizeof(ctx->status_text), "Send failed");
         ctx->needs_redraw = true;
         return;
     }
 
-    if (nostr_publish_event(ctx->relay, dm) == NOSTR_OK) {
-        tui_message* msg = create_message(content, NULL, 0, true);
-        if (msg) {
-            add_message_sorted(ctx, msg);
+#ifndef _WIN32
+    if (ctx->send_started) {
+        pthread_mutex_lock(&ctx->send_lock);
+        bool full = ctx->send_count == SEND_QUEUE;
+        pthread_mutex_unlock(&ctx->send_lock);
+        if (full) {
+            free_send_job(&job);
+            snprintf(ctx->status_text, sizeof(ctx->status_text), "Send queue full");
+            ctx->needs_redraw = true;
+            return;
         }
-        snprintf(ctx->status_text, sizeof(ctx->status_text), "Sending...");
-    } else {
-        snprintf(ctx->status_text, sizeof(ctx->status_text), "Send failed");
     }
+#endif
 
-    nostr_event_destroy(dm);
+    tui_message msg;
+    create_message(ctx, NULL, 0, true, &msg);
+    if (!add_message_sorted(ctx, &ctx->recipient, &msg, content, NULL)) {
+        free_send_job(&job);
+        snprintf(ctx->status_text, sizeof(ctx->status_text), "Send failed");
+        ctx->needs_redraw = true;
+        return;
+    }
+    job.message_id = msg.id;
+    snprintf(ctx->status_text, sizeof(ctx->status_text), "Sending...");
     ctx->needs_redraw = true;
+
+#ifndef _WIN32
+    if (ctx->send_started) {
+        /* Only this thread adds jobs, so the slot checked above is still free */
+        pthread_mutex_lock(&ctx->send_lock);
+        ctx->send_queue[(ctx->send_head + ctx->send_count) % SEND_QUEUE] = job;
+        ctx->send_count++;
+        pthread_cond_signal(&ctx->send_cond);
+        pthread_mutex_unlock(&ctx->send_lock);
+        return;
+    }
+#endif
+
+    /* No worker: wrap and publish inline as before */
+    run_send_job(ctx, &job);
+    free_send_job(&job);
 }
 
 static void handle_command(tui_context* ctx, const char* cmd) {
     if (strcmp(cmd, "/quit") == 0 || strcmp(cmd, "/q") == 0) {
         ctx->running = false;
     } else if (strcmp(cmd, "/clear") == 0) {
-        free_all_messages(ctx);
+        clear_active_conversation(ctx);
         ctx->needs_redraw = true;
     } else if (strncmp(cmd, "/to ", 4) == 0) {
         const char* npub = cmd + 4;
         while (*npub && isspace((unsigned char)*npub)) npub++;
 
-        if (whisper_parse_pubkey(npub, &ctx->recipient) == 0) {
-            ctx->has_recipient = true;
-            free_all_messages(ctx);
+        nostr_key peer;
+        if (whisper_peer_parse(&ctx->peers, npub, &peer) == 0 &&
+            switch_conversation(ctx, &peer) == 0) {
             snprintf(ctx->status_text, sizeof(ctx->status_text), "Recipient set");
         } else {
             snprintf(ctx->status_text, sizeof(ctx->status_text), "Invalid npub");
@@ -445,7 +1187,7 @@ static void handle_command(tui_context* ctx, const char* cmd) {
         ctx->needs_redraw = true;
     } else if (strcmp(cmd, "/help") == 0) {
         snprintf(ctx->status_text, sizeof(ctx->status_text),
-                 "/to <npub> /clear /quit");
+                 "/to <npub> ^N/^P switch /clear /quit");
         ctx->needs_redraw = true;
     } else {
         snprintf(ctx->status_text, sizeof(ctx->status_text),
@@ -485,9 +1227,23 @@ static int setup_ui(tui_context* ctx) {
         return -1;
     }
 
+    /* Conversation list on the left when the terminal is wide enough */
+    int list_cols = 0;
+    if (scols >= LIST_MIN_TERM_COLS) {
+        struct ncplane_options list_opts = {
+            .y = 1, .x = 0,
+            .rows = (unsigned)message_rows, .cols = LIST_COLS,
+        };
+        ctx->list_plane = ncplane_create(std, &list_opts);
+        if (ctx->list_plane) {
+            ncplane_set_bg_rgb8(ctx->list_plane, 0, 0, 0);
+            list_cols = LIST_COLS;
+        }
+    }
+
     struct ncplane_options msg_opts = {
-        .y = 1, .x = 0,
-        .rows = (unsigned)message_rows, .cols = (unsigned)scols,
+        .y = 1, .x = list_cols,
+        .rows = (unsigned)message_rows, .cols = (unsigned)(scols - list_cols),
     };
     ctx->message_plane = ncplane_create(std, &msg_opts);
     if (!ctx->message_plane) {
@@ -527,101 +1283,186 @@ static int setup_ui(tui_context* ctx) {
     return 0;
 }
 
-typedef struct {
-    char sender_npub[20];
-    char content[512];
-    time_t timestamp;
-    bool is_outgoing;
-} render_msg_copy;
-
-static void render_message_copy(struct ncplane* plane, const render_msg_copy* msg, int row) {
-    struct tm tm_buf;
-    struct tm* tm_info = localtime_r(&msg->timestamp, &tm_buf);
-    char time_str[6];
-    if (tm_info) {
-        strftime(time_str, sizeof(time_str), "%H:%M", tm_info);
-    } else {
-        snprintf(time_str, sizeof(time_str), "??:??");
-    }
-
-    uint64_t time_chan = NCCHANNELS_INITIALIZER(100, 100, 100, 0, 0, 0);
-    ncplane_set_channels(plane, time_chan);
-    ncplane_printf_yx(plane, row, 1, "%s", time_str);
-
-    const char* sender = msg->is_outgoing ? "you" : msg->sender_npub;
-    uint64_t sender_chan;
-    if (msg->is_outgoing) {
-        sender_chan = NCCHANNELS_INITIALIZER(130, 170, 210, 0, 0, 0);
-    } else {
-        sender_chan = NCCHANNELS_INITIALIZER(180, 160, 120, 0, 0, 0);
+static void render_row(struct ncplane* plane, const tui_row* r, const char* content,
+                       int row, unsigned cols) {
+    ncplane_erase_region(plane, row, 0, 1, (int)cols);
+    if (r->id == 0) return;
+
+    ncplane_set_channels(plane, TIME_CHANNELS);
+    ncplane_printf_yx(plane, row, 1, "%s", r->time_str);
+
+    const char* sender = r->sender_npub;
+    uint64_t sender_chan = IN_SENDER_CHANNELS;
+    if (r->is_outgoing) {
+        sender_chan = OUT_SENDER_CHANNELS;
+        switch (r->send_state) {
+            case SEND_PENDING: sender = "you ..."; sender_chan = TIME_CHANNELS; break;
+            case SEND_FAILED:  sender = "you (failed)"; sender_chan = FAILED_CHANNELS; break;
+            default:           sender = "you"; break;
+        }
     }
     ncplane_set_channels(plane, sender_chan);
     ncplane_printf_yx(plane, row, 7, "%-12s", sender);
 
-    uint64_t content_chan;
-    if (msg->is_outgoing) {
-        content_chan = NCCHANNELS_INITIALIZER(180, 200, 220, 0, 0, 0);
-    } else {
-        content_chan = NCCHANNELS_INITIALIZER(200, 200, 200, 0, 0, 0);
-    }
-    ncplane_set_channels(plane, content_chan);
-    ncplane_printf_yx(plane, row, 20, "%s", msg->content);
+    ncplane_set_channels(plane, r->is_outgoing ? OUT_CONTENT_CHANNELS : IN_CONTENT_CHANNELS);
+    ncplane_printf_yx(plane, row, 20, "%s", content);
 }
 
-static void render_messages(tui_context* ctx) {
-    if (!ctx->message_plane) return;
+/* Resize the row cache; a new size starts from a blank plane */
+static int ensure_rows(tui_context* ctx, int rows) {
+    if (rows == ctx->row_count) return 0;
 
+    tui_row* grown = calloc((size_t)rows, sizeof(*grown));
+    if (!grown) return -1;
+    free(ctx->rows);
+    ctx->rows = grown;
+    ctx->row_count = rows;
     ncplane_erase(ctx->message_plane);
+    return 0;
+}
 
-    unsigned rows;
-    ncplane_dim_yx(ctx->message_plane, &rows, NULL);
+static void render_messages(tui_context* ctx) {
+    if (!ctx->message_plane) return;
+
+    unsigned rows, cols;
+    ncplane_dim_yx(ctx->message_plane, &rows, &cols);
+    if (rows == 0 || ensure_rows(ctx, (int)rows) != 0) return;
 
     messages_lock(ctx);
 
     int visible_rows = (int)rows;
-    int total_messages = ctx->message_count;
-    int start_idx = total_messages - visible_rows - ctx->scroll_offset;
+    tui_conversation* conv = active_conversation(ctx);
+    int total_messages = conv ? conv->message_count : 0;
+    int start_idx = conv ? total_messages - visible_rows - conv->scroll_offset : 0;
     if (start_idx < 0) start_idx = 0;
 
-    tui_message* msg = ctx->messages_head;
-    int idx = 0;
-    while (msg && idx < start_idx) {
-        msg = msg->next;
-        idx++;
-    }
-
-    int row = visible_rows - 1;
-    int displayed = 0;
-    render_msg_copy display_msgs[256];
-    int display_count = 0;
-
-    while (msg && displayed < visible_rows) {
-        if (display_count < 256) {
-            render_msg_copy* copy = &display_msgs[display_count++];
-            memcpy(copy->sender_npub, msg->sender_npub, sizeof(copy->sender_npub));
-            snprintf(copy->content, sizeof(copy->content), "%s", msg->content ? msg->content : "");
-            copy->timestamp = msg->timestamp;
-            copy->is_outgoing = msg->is_outgoing;
+    int display_count = total_messages - start_idx;
+    if (display_count > visible_rows) display_count = visible_rows;
+    int first_row = visible_rows - display_count;
+
+    /* Copy out only the rows whose message changed, then draw unlocked */
+    ctx->row_text.len = 0;
+    int changed = 0;
+    for (int row = 0; row < visible_rows; row++) {
+        tui_row* r = &ctx->rows[row];
+        const tui_message* msg = NULL;
+        if (row >= first_row) msg = message_at(conv, start_idx + row - first_row);
+        uint64_t id = msg ? msg->id : 0;
+        uint8_t send_state = msg ? msg->send_state : SEND_NONE;
+
+        r->changed = r->id != id || r->send_state != send_state;
+        if (!r->changed) continue;
+        changed++;
+        r->id = id;
+        r->send_state = send_state;
+        if (!msg) continue;
+
+        memcpy(r->sender_npub, msg->sender_npub, sizeof(r->sender_npub));
+        memcpy(r->time_str, msg->time_str, sizeof(r->time_str));
+        r->is_outgoing = msg->is_outgoing;
+        r->content_off = ctx->row_text.len;
+
+        const char* content = msg->content ? msg->content : "";
+        size_t len = strlen(content);
+        if (len > ROW_CONTENT_MAX - 1) len = ROW_CONTENT_MAX - 1;
+        if (whisper_buf_append(&ctx->row_text, content, len) != 0 ||
+            whisper_buf_append(&ctx->row_text, "", 1) != 0) {
+            /* Retry the row next frame */
+            r->id = (uint64_t)-1;
+            r->content_off = (size_t)-1;
         }
-        msg = msg->next;
-        displayed++;
     }
 
     messages_unlock(ctx);
 
-    for (int i = display_count - 1; i >= 0 && row >= 0; i--) {
-        render_message_copy(ctx->message_plane, &display_msgs[i], row);
-        row--;
+    if (changed == 0) return;
+    for (int row = 0; row < visible_rows; row++) {
+        const tui_row* r = &ctx->rows[row];
+        if (!r->changed) continue;
+        const char* content = "";
+        if (r->id != 0 && r->content_off != (size_t)-1) content = ctx->row_text.data + r->content_off;
+        render_row(ctx->message_plane, r, content, row, cols);
+    }
+}
+
+typedef struct {
+    char label[20];
+    int unread;
+    bool active;
+} list_entry_copy;
+
+/* Conversation list with unread counts; redrawn only when it changes */
+static void render_conversations(tui_context* ctx) {
+    if (!ctx->list_plane) return;
+
+    unsigned rows;
+    ncplane_dim_yx(ctx->list_plane, &rows, NULL);
+
+    list_entry_copy entries[64];
+    int count = 0;
+
+    messages_lock(ctx);
+    if (ctx->list_version == ctx->list_drawn) {
+        messages_unlock(ctx);
+        return;
+    }
+    ctx->list_drawn = ctx->list_version;
+    for (int i = 0; i < ctx->conversation_count && count < (int)rows && count < 64; i++) {
+        list_entry_copy* e = &entries[count++];
+        memcpy(e->label, ctx->conversations[i].label, sizeof(e->label));
+        e->unread = ctx->conversations[i].unread;
+        e->active = i == ctx->active;
+    }
+    messages_unlock(ctx);
+
+    ncplane_erase(ctx->list_plane);
+    for (int i = 0; i < count; i++) {
+        const list_entry_copy* e = &entries[i];
+        if (e->active) {
+            ncplane_set_channels(ctx->list_plane, OUT_SENDER_CHANNELS);
+        } else if (e->unread > 0) {
+            ncplane_set_channels(ctx->list_plane, IN_SENDER_CHANNELS);
+        } else {
+            ncplane_set_channels(ctx->list_plane, TIME_CHANNELS);
+        }
+        ncplane_printf_yx(ctx->list_plane, i, 0, "%c%-15s", e->active ? '>' : ' ', e->label);
+        if (e->unread > 0) {
+            ncplane_printf_yx(ctx->list_plane, i, 17, "%5d", e->unread > 99999 ? 99999 : e->unread);
+        }
     }
 }
 
 static void render(tui_context* ctx) {
     update_status_bar(ctx);
+    render_conversations(ctx);
     render_messages(ctx);
     notcurses_render(ctx->nc);
     ctx->needs_redraw = false;
 }
 
+static void scroll_active(tui_context* ctx, int delta) {
+    if (!ctx->message_plane) return;
+
+    unsigned rows;
+    ncplane_dim_yx(ctx->message_plane, &rows, NULL);
+
+    bool at_top = false;
+    messages_lock(ctx);
+    tui_conversation* conv = active_conversation(ctx);
+    if (conv) {
+        int max_scroll = conv->message_count - (int)rows;
+        if (max_scroll < 0) max_scroll = 0;
+        at_top = delta > 0 && conv->scroll_offset >= max_scroll;
+        conv->scroll_offset += delta;
+        if (conv->scroll_offset > max_scroll) conv->scroll_offset = max_scroll;
+        if (conv->scroll_offset < 0) conv->scroll_offset = 0;
+    }
+    messages_unlock(ctx);
+
+    if (at_top) request_history(ctx);
+    ctx->needs_redraw = true;
+}
+
 static void handle_input(tui_context* ctx, uint32_t key, ncinput* ni) {
     ctx->idle_ticks = 0;
     ctx->fade_alpha = MAX_ALPHA;
@@ -654,24 +1495,18 @@ static void handle_input(tui_context* ctx, uint32_t key, ncinput* ni) {
     }
 
     if (key == NCKEY_PGUP || (key == 'k' && ncinput_ctrl_p(ni))) {
-        if (ctx->message_plane) {
-            unsigned rows;
-            ncplane_dim_yx(ctx->message_plane, &rows, NULL);
-            int max_scroll = ctx->message_count - (int)rows;
-            if (max_scroll < 0) max_scroll = 0;
-            ctx->scroll_offset++;
-            if (ctx->scroll_offset > max_scroll) ctx->scroll_offset = max_scroll;
-            ctx->needs_redraw = true;
-        }
+        scroll_active(ctx, 1);
         return;
     }
 
     if (key == NCKEY_PGDOWN || (key == 'j' && ncinput_ctrl_p(ni))) {
-        if (ctx->message_plane) {
-            ctx->scroll_offset--;
-            if (ctx->scroll_offset < 0) ctx->scroll_offset = 0;
-            ctx->needs_redraw = true;
-        }
+        scroll_active(ctx, -1);
+        return;
+    }
+
+    if ((key == 'n' || key == 'p') && ncinput_ctrl_p(ni)) {
+        cycle_conversation(ctx, key == 'n' ? 1 : -1);
+        ctx->needs_redraw = true;
         return;
     }
 
@@ -681,55 +1516,82 @@ static void handle_input(tui_context* ctx, uint32_t key, ncinput* ni) {
     }
 }
 
-static void run_event_loop(tui_context* ctx) {
+/* Sleep until there is input, another thread asks for a redraw, or a
+ * dropped relay is due for a redial in retry_ms */
+static void wait_for_work(tui_context* ctx, int retry_ms) {
+#ifndef _WIN32
+    struct pollfd pfds[2] = {
+        { .fd = notcurses_inputready_fd(ctx->nc), .events = POLLIN },
+        { .fd = ctx->wakeup.fds[0], .events = POLLIN },
+    };
+    /* Without a wakeup channel, fall back to polling for remote events */
+    int timeout_ms = ctx->wakeup.fds[0] >= 0 ? -1 : 50;
+    if (retry_ms > 0 && (timeout_ms < 0 || retry_ms < timeout_ms)) timeout_ms = retry_ms;
+    /* EINTR is fine: the caller re-checks g_signal_received */
+    if (poll(pfds, 2, timeout_ms) > 0 && (pfds[1].revents & POLLIN)) {
+        whisper_wakeup_wait(&ctx->wakeup, 0);
+    }
+#else
+    /* No pollable input fd here; keep the old 50 ms cadence */
     struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000000 };
     ncinput ni;
-    bool subscribed = false;
+    uint32_t key = notcurses_get(ctx->nc, &ts, &ni);
+    if (key != 0 && key != (uint32_t)-1) handle_input(ctx, key, &ni);
+    (void)retry_ms;
+#endif
+}
+
+static void run_event_loop(tui_context* ctx) {
+    ncinput ni;
 
     ctx->running = true;
     ctx->fade_alpha = MAX_ALPHA;
 
     while (ctx->running && !g_signal_received) {
-        if (ctx->connected && !subscribed) {
-            if (subscribe_dms(ctx) == 0) {
-                subscribed = true;
-            }
+        int retry_ms = whisper_pool_maintain(&ctx->pool);
+        if (retry_ms < 0) {
+            ctx->running = false;
+            snprintf(ctx->status_text, sizeof(ctx->status_text), "Disconnected");
+            break;
         }
-
-        uint32_t key = notcurses_get(ctx->nc, &ts, &ni);
-
-        if (key == (uint32_t)-1) {
-            continue;
+        if (ctx->connected) {
+            subscribe_dms(ctx);
         }
 
-        if (key == 0) {
-            ctx->idle_ticks++;
-            if (ctx->needs_redraw) {
-                render(ctx);
-            }
-            continue;
+        /* Everything already queued, then one render for the lot */
+        uint32_t key;
+        while (ctx->running && (key = notcurses_get_nblock(ctx->nc, &ni)) != 0) {
+            if (key == (uint32_t)-1) break;
+            handle_input(ctx, key, &ni);
         }
 
-        handle_input(ctx, key, &ni);
-
         if (ctx->needs_redraw) {
             render(ctx);
         }
+
+        if (!ctx->running || g_signal_received) break;
+        wait_for_work(ctx, retry_ms);
     }
 }
 
 static void cleanup(tui_context* ctx) {
+    /* Stop relay callbacks before tearing down what they touch */
+    stop_history(ctx);
+    stop_sender(ctx);
+    whisper_pool_close(&ctx->pool);
+    whisper_unwrap_stop(&ctx->unwrap);
+
     secure_wipe(&ctx->privkey, sizeof(ctx->privkey));
 
-    free_all_messages(ctx);
+    free_all_conversations(ctx);
+    slab_destroy(&ctx->slab);
+    whisper_idset_destroy(&ctx->seen_wraps);
+    free(ctx->rows);
+    whisper_buf_free(&ctx->row_text);
     messages_mutex_destroy(ctx);
-
-    if (ctx->relay) {
-        if (ctx->relay->state == NOSTR_RELAY_CONNECTED) {
-            nostr_relay_unsubscribe(ctx->relay, "dm-inbox");
-        }
-        nostr_relay_destroy(ctx->relay);
-    }
+    whisper_peer_cache_destroy(&ctx->peers);
+    g_wakeup = NULL;
+    whisper_wakeup_destroy(&ctx->wakeup);
 
     if (ctx->input_reader) {
         ncreader_destroy(ctx->input_reader, NULL);
@@ -769,17 +1631,27 @@ int whisper_tui(const whisper_tui_config* config) {
         return WHISPER_EXIT_KEY_ERROR;
     }
 
+    ctx.active = -1;
+    ctx.started_at = time(NULL);
+    ctx.relay_urls = config->relay_urls;
+    ctx.relay_count = config->relay_count;
+    ctx.timeout_ms = config->timeout_ms;
+    ctx.jobs = config->jobs;
+    ctx.rate_cap = config->rate_cap;
+    messages_mutex_init(&ctx);
+    whisper_peer_cache_init(&ctx.peers, 0);
+    whisper_idset_init(&ctx.seen_wraps, SEEN_WRAPS);
+
     if (config->recipient) {
-        if (whisper_parse_pubkey(config->recipient, &ctx.recipient) == 0) {
-            ctx.has_recipient = true;
-        } else {
+        nostr_key recipient;
+        if (whisper_parse_pubkey(config->recipient, &recipient) != 0 ||
+            switch_conversation(&ctx, &recipient) != 0) {
             fprintf(stderr, "Warning: Invalid recipient, use /to to set\n");
         }
     }
-
-    ctx.relay_url = config->relay_url;
-    ctx.timeout_ms = config->timeout_ms;
-    messages_mutex_init(&ctx);
+    if (whisper_wakeup_init(&ctx.wakeup) == 0) {
+        g_wakeup = &ctx.wakeup;
+    }
     snprintf(ctx.status_text, sizeof(ctx.status_text), "Starting...");
 
     struct notcurses_options nc_opts = {
@@ -788,7 +1660,12 @@ int whisper_tui(const whisper_tui_config* config) {
     ctx.nc = notcurses_core_init(&nc_opts, NULL);
     if (!ctx.nc) {
         fprintf(stderr, "Error: Failed to initialize notcurses\n");
+        free_all_conversations(&ctx);
+        whisper_idset_destroy(&ctx.seen_wraps);
         messages_mutex_destroy(&ctx);
+        whisper_peer_cache_destroy(&ctx.peers);
+        g_wakeup = NULL;
+        whisper_wakeup_destroy(&ctx.wakeup);
         secure_wipe(&ctx.privkey, sizeof(ctx.privkey));
         nostr_cleanup();
         return WHISPER_EXIT_CRYPTO_ERROR;
@@ -797,7 +1674,12 @@ int whisper_tui(const whisper_tui_config* config) {
     if (setup_ui(&ctx) != 0) {
         fprintf(stderr, "Error: Failed to setup UI (terminal too small?)\n");
         notcurses_stop(ctx.nc);
+        free_all_conversations(&ctx);
+        whisper_idset_destroy(&ctx.seen_wraps);
         messages_mutex_destroy(&ctx);
+        whisper_peer_cache_destroy(&ctx.peers);
+        g_wakeup = NULL;
+        whisper_wakeup_destroy(&ctx.wakeup);
         secure_wipe(&ctx.privkey, sizeof(ctx.privkey));
         nostr_cleanup();
         return WHISPER_EXIT_CRYPTO_ERROR;
@@ -811,6 +1693,8 @@ int whisper_tui(const whisper_tui_config* config) {
         render(&ctx);
     }
 
+    start_history(&ctx, config->store_dir);
+    start_sender(&ctx);
     run_event_loop(&ctx);
 
     cleanup(&ctx);
@@ -818,4 +1702,172 @@ int whisper_tui(const whisper_tui_config* config) {
     return WHISPER_EXIT_OK;
 }
 
+#ifdef WHISPER_BENCH
+
+#define BENCH_ROWS 50
+#define BENCH_COLS 160
+
+static int64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Time `rounds` frames of render_messages, calling change() before each */
+static double bench_frames(tui_context* ctx, int rounds, void (*change)(tui_context*, int)) {
+    int64_t total = 0;
+    for (int i = 0; i < rounds; i++) {
+        if (change) change(ctx, i);
+        int64_t t0 = bench_now_ns();
+        render_messages(ctx);
+        total += bench_now_ns() - t0;
+    }
+    return (double)total / rounds;
+}
+
+/* Every visible row moves, as for PgUp/PgDn */
+static void bench_scroll(tui_context* ctx, int i) {
+    ctx->conversations[0].scroll_offset = (i % 2) ? BENCH_ROWS : 0;
+}
+
+/* One row changes, as for a delivery receipt */
+static void bench_receipt(tui_context* ctx, int i) {
+    tui_conversation* conv = &ctx->conversations[0];
+    conv->scroll_offset = 0;
+    message_at(conv, conv->message_count - 1)->send_state = (i % 2) ? SEND_DELIVERED : SEND_PENDING;
+}
+
+int whisper_tui_bench(int messages, int rounds, whisper_tui_bench_result* result) {
+    static tui_context ctx;
+    int ret = -1;
+    FILE* devnull = NULL;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(result, 0, sizeof(*result));
+    ctx.active = -1;
+    ctx.wakeup.fds[0] = ctx.wakeup.fds[1] = -1;
+    messages_mutex_init(&ctx);
+    if (whisper_idset_init(&ctx.seen_wraps, SEEN_WRAPS) != 0 ||
+        whisper_peer_cache_init(&ctx.peers, 0) != 0) {
+        goto out;
+    }
+
+    nostr_key peer;
+    memset(&peer, 0x42, sizeof(peer));
+    messages_lock(&ctx);
+    bool have_conv = conversation_for(&ctx, &peer) != NULL;
+    messages_unlock(&ctx);
+    if (!have_conv) goto out;
+    ctx.active = 0;
+
+    /* Mostly in order with some stragglers, like relay and history pages */
+    time_t base = time(NULL) - messages;
+    uint32_t rng = 12345;
+    char content[256];
+    int64_t t0 = bench_now_ns();
+    for (int i = 0; i < messages; i++) {
+        rng = rng * 1103515245 + 12345;
+        int len = 20 + (int)(rng >> 16) % 200;
+        memset(content, 'a' + i % 26, (size_t)len);
+        content[len] = '\0';
+
+        uint8_t wrap_id[32] = {0};
+        memcpy(wrap_id, &i, sizeof(i));
+        time_t ts = base + i - (((rng >> 8) % 8 == 0) ? (time_t)((rng >> 4) % 600) : 0);
+
+        tui_message msg;
+        create_message(&ctx, &peer, ts, false, &msg);
+        add_message_sorted(&ctx, &peer, &msg, content, wrap_id);
+    }
+    result->add_ns = (double)(bench_now_ns() - t0) / messages;
+    result->messages = ctx.conversations[0].message_count;
+
+    /* Headless: output goes to /dev/null, frames are built but never shown */
+    devnull = fopen("/dev/null", "w");
+    struct notcurses_options nc_opts = {
+        .flags = NCOPTION_SUPPRESS_BANNERS | NCOPTION_NO_ALTERNATE_SCREEN |
+                 NCOPTION_NO_QUIT_SIGHANDLERS | NCOPTION_NO_WINCH_SIGHANDLER,
+    };
+    ctx.nc = devnull ? notcurses_core_init(&nc_opts, devnull) : NULL;
+    if (!ctx.nc) goto out;
+    struct ncplane_options plane_opts = { .rows = BENCH_ROWS, .cols = BENCH_COLS };
+    ctx.message_plane = ncplane_create(notcurses_stdplane(ctx.nc), &plane_opts);
+    if (!ctx.message_plane) goto out;
+
+    render_messages(&ctx);
+    result->render_full_ns = bench_frames(&ctx, rounds, bench_scroll);
+    result->render_row_ns = bench_frames(&ctx, rounds, bench_receipt);
+    result->render_idle_ns = bench_frames(&ctx, rounds, NULL);
+    ret = 0;
+
+out:
+    if (ctx.message_plane) ncplane_destroy(ctx.message_plane);
+    if (ctx.nc) notcurses_stop(ctx.nc);
+    if (devnull) fclose(devnull);
+    free_all_conversations(&ctx);
+    slab_destroy(&ctx.slab);
+    free(ctx.rows);
+    whisper_buf_free(&ctx.row_text);
+    whisper_idset_destroy(&ctx.seen_wraps);
+    whisper_peer_cache_destroy(&ctx.peers);
+    messages_mutex_destroy(&ctx);
+    return ret;
+}
+
+static int bench_message_total(tui_context* ctx) {
+    int total = 0;
+    messages_lock(ctx);
+    for (int i = 0; i < ctx->conversation_count; i++) {
+        total += ctx->conversations[i].message_count;
+    }
+    messages_unlock(ctx);
+    return total;
+}
+
+int whisper_tui_bench_ingest(const char* relay_url, const char* nsec, int jobs, int expect,
+                             int timeout_ms, whisper_tui_ingest_cb on_ingest, void* user_data) {
+    static tui_context ctx;
+    int ingested = -1;
+
+    memset(&ctx, 0, sizeof(ctx));
+    if (whisper_load_privkey(nsec, NULL, &ctx.privkey, &ctx.pubkey) != 0) return -1;
+    ctx.active = -1;
+    ctx.started_at = time(NULL);
+    ctx.relay_urls = &relay_url;
+    ctx.relay_count = 1;
+    ctx.timeout_ms = timeout_ms;
+    ctx.jobs = jobs;
+    ctx.bench_ingest = on_ingest;
+    ctx.bench_data = user_data;
+    messages_mutex_init(&ctx);
+    whisper_peer_cache_init(&ctx.peers, 0);
+    whisper_idset_init(&ctx.seen_wraps, SEEN_WRAPS);
+    whisper_wakeup_init(&ctx.wakeup);
+
+    /* The UI thread's part of ingest is only the redraw, left out here */
+    if (connect_relay(&ctx) == 0 && subscribe_dms(&ctx) == 0) {
+        int64_t deadline = whisper_now_ms() + timeout_ms;
+        while ((ingested = bench_message_total(&ctx)) < expect) {
+            int64_t remaining = deadline - whisper_now_ms();
+            if (remaining <= 0) break;
+            whisper_wakeup_wait(&ctx.wakeup, (int)remaining);
+        }
+        whisper_unwrap_wait_idle(&ctx.unwrap);
+        ingested = bench_message_total(&ctx);
+    }
+
+    whisper_pool_close(&ctx.pool);
+    whisper_unwrap_stop(&ctx.unwrap);
+    secure_wipe(&ctx.privkey, sizeof(ctx.privkey));
+    free_all_conversations(&ctx);
+    slab_destroy(&ctx.slab);
+    whisper_idset_destroy(&ctx.seen_wraps);
+    messages_mutex_destroy(&ctx);
+    whisper_peer_cache_destroy(&ctx.peers);
+    whisper_wakeup_destroy(&ctx.wakeup);
+    return ingested;
+}
+
+#endif /* WHISPER_BENCH */
+
 #endif /* HAVE_NOTCURSES */
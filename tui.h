@@ -11,11 +11,37 @@
 typedef struct {
     const char* nsec;
     const char* nsec_file;
-    const char* relay_url;
+    const char* const* relay_urls;
+    int relay_count;
     const char* recipient;
     int timeout_ms;
+    int jobs;
+    int rate_cap;
+    const char* store_dir;       /* PgUp pages this inbox first (NULL = default) */
 } whisper_tui_config;
 
 int whisper_tui(const whisper_tui_config* config);
 
+#if defined(WHISPER_BENCH) && defined(HAVE_NOTCURSES)
+/* Benchmark hook (make bench): mean ns per add_message_sorted, and per
+ * render_messages frame redrawing every row / one row / nothing */
+typedef struct {
+    int messages;
+    double add_ns;
+    double render_full_ns;
+    double render_row_ns;
+    double render_idle_ns;
+} whisper_tui_bench_result;
+
+int whisper_tui_bench(int messages, int rounds, whisper_tui_bench_result* result);
+
+/* Load-test hook (whisper_load): run the TUI's receive path, relay to
+ * conversation buffers, without a screen. on_ingest sees each DM's content
+ * once it is filed. Returns messages filed before `expect` or the timeout. */
+typedef void (*whisper_tui_ingest_cb)(const char* content, void* user_data);
+
+int whisper_tui_bench_ingest(const char* relay_url, const char* nsec, int jobs, int expect,
+                             int timeout_ms, whisper_tui_ingest_cb on_ingest, void* user_data);
+#endif
+
 #endif /* WHISPER_TUI_H */
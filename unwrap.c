@@ -0,0 +1,313 @@
+/*
+ * whisper unwrap - Gift wrap decryption off the relay threads
+ *
+ * Relay callbacks copy raw kind-1059 events into a bounded queue; a small
+ * pool of workers runs nostr_nip17_unwrap_dm (two NIP-44 layers plus ECDH
+ * each) in parallel and hands rumors to on_message one at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "whisper.h"
+
+/* Copy an event out of the relay's buffer so the callback can return */
+static nostr_event* copy_event(const nostr_event* event) {
+    char* json = NULL;
+    nostr_event* copy = NULL;
+    if (nostr_event_to_json(event, &json) != NOSTR_OK || !json) return NULL;
+    if (nostr_event_from_json(json, &copy) != NOSTR_OK) copy = NULL;
+    free(json);
+    return copy;
+}
+
+static int compare_held(const void* a, const void* b) {
+    const whisper_unwrapped* x = (const whisper_unwrapped*)a;
+    const whisper_unwrapped* y = (const whisper_unwrapped*)b;
+    if (x->rumor->created_at != y->rumor->created_at) {
+        return x->rumor->created_at < y->rumor->created_at ? -1 : 1;
+    }
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static void deliver(whisper_unwrapper* u, whisper_unwrapped* msg) {
+    whisper_mutex_lock(&u->deliver_lock);
+    u->on_message(msg, u->user_data);
+    whisper_mutex_unlock(&u->deliver_lock);
+    nostr_event_destroy(msg->rumor);
+    msg->rumor = NULL;
+}
+
+/* Deliver now, or park the rumor until whisper_unwrap_release in ordered mode */
+static void complete(whisper_unwrapper* u, whisper_unwrapped* msg) {
+    whisper_mutex_lock(&u->deliver_lock);
+    if (u->ordered) {
+        if (u->held_count == u->held_cap) {
+            size_t cap = u->held_cap ? u->held_cap * 2 : 256;
+            whisper_unwrapped* held = realloc(u->held, cap * sizeof(*held));
+            if (!held) {
+                /* Out of memory: give up on ordering rather than the message */
+                whisper_mutex_unlock(&u->deliver_lock);
+                deliver(u, msg);
+                return;
+            }
+            u->held = held;
+            u->held_cap = cap;
+        }
+        u->held[u->held_count++] = *msg;
+        whisper_mutex_unlock(&u->deliver_lock);
+        return;
+    }
+    whisper_mutex_unlock(&u->deliver_lock);
+    deliver(u, msg);
+}
+
+static void unwrap_one(whisper_unwrapper* u, const nostr_event* wrap, uint64_t seq,
+                       int identity) {
+    whisper_unwrapped msg = {0};
+    int64_t start = whisper_now_us();
+    nostr_error_t err = nostr_nip17_unwrap_dm(wrap, &u->privkeys[identity], &msg.rumor,
+                                              &msg.sender);
+    whisper_stats_observe(WHISPER_LAT_UNWRAP, whisper_now_us() - start);
+    if (err != NOSTR_OK || !msg.rumor) {
+        whisper_stats_count(WHISPER_STAT_DECRYPT_FAILED, 1);
+        whisper_mutex_lock(&u->deliver_lock);
+        u->failed++;
+        whisper_mutex_unlock(&u->deliver_lock);
+        return;
+    }
+    whisper_stats_count(WHISPER_STAT_UNWRAPPED, 1);
+    memcpy(msg.wrap_id, wrap->id, sizeof(msg.wrap_id));
+    msg.wrap_created_at = wrap->created_at;
+    msg.seq = seq;
+    msg.identity = identity;
+    complete(u, &msg);
+    secure_wipe(&msg, sizeof(msg));
+}
+
+#ifndef _WIN32
+
+static void* worker_main(void* arg) {
+    whisper_unwrapper* u = (whisper_unwrapper*)arg;
+
+    pthread_mutex_lock(&u->lock);
+    for (;;) {
+        while (u->count == 0 && !u->stopping) {
+            pthread_cond_wait(&u->not_empty, &u->lock);
+        }
+        if (u->count == 0) break;
+
+        nostr_event* wrap = u->queue[u->head];
+        uint64_t seq = u->seqs[u->head];
+        int identity = u->identities[u->head];
+        u->head = (u->head + 1) % WHISPER_UNWRAP_QUEUE;
+        u->count--;
+        u->busy++;
+        pthread_cond_signal(&u->not_full);
+        pthread_mutex_unlock(&u->lock);
+
+        unwrap_one(u, wrap, seq, identity);
+        nostr_event_destroy(wrap);
+
+        pthread_mutex_lock(&u->lock);
+        u->busy--;
+        if (u->count == 0 && u->busy == 0) pthread_cond_broadcast(&u->idle);
+    }
+    pthread_mutex_unlock(&u->lock);
+    return NULL;
+}
+
+#endif
+
+int whisper_unwrap_default_jobs(void) {
+#ifndef _WIN32
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    return n > WHISPER_MAX_JOBS ? WHISPER_MAX_JOBS : (int)n;
+#else
+    return 0;
+#endif
+}
+
+int whisper_unwrap_start(whisper_unwrapper* u, const nostr_privkey* privkeys, int key_count,
+                         int jobs, bool ordered, whisper_unwrap_cb on_message, void* user_data) {
+    memset(u, 0, sizeof(*u));
+    u->privkeys = privkeys;
+    u->key_count = key_count;
+    u->on_message = on_message;
+    u->user_data = user_data;
+    u->ordered = ordered;
+    whisper_mutex_init(&u->deliver_lock);
+
+    if (jobs <= 0) jobs = whisper_unwrap_default_jobs();
+    if (jobs > WHISPER_MAX_JOBS) jobs = WHISPER_MAX_JOBS;
+
+#ifndef _WIN32
+    pthread_mutex_init(&u->lock, NULL);
+    pthread_cond_init(&u->not_empty, NULL);
+    pthread_cond_init(&u->not_full, NULL);
+    pthread_cond_init(&u->idle, NULL);
+    u->started = true;
+
+    while (u->jobs < jobs) {
+        if (pthread_create(&u->threads[u->jobs], NULL, worker_main, u) != 0) break;
+        u->jobs++;
+    }
+    if (u->jobs == 0 && jobs > 0) {
+        fprintf(stderr, "Warning: Failed to start unwrap workers, decrypting inline\n");
+    }
+#else
+    (void)jobs;
+    u->started = true;
+#endif
+    return 0;
+}
+
+void whisper_unwrap_submit(whisper_unwrapper* u, const nostr_event* event, int identity) {
+    if (event->kind != 1059 || identity < 0 || identity >= u->key_count) return;
+
+#ifndef _WIN32
+    if (u->jobs > 0) {
+        nostr_event* copy = copy_event(event);
+        if (!copy) {
+            whisper_mutex_lock(&u->deliver_lock);
+            u->failed++;
+            whisper_mutex_unlock(&u->deliver_lock);
+            return;
+        }
+
+        pthread_mutex_lock(&u->lock);
+        /* A full queue holds back the relay thread instead of dropping events */
+        while (u->count == WHISPER_UNWRAP_QUEUE && !u->stopping) {
+            pthread_cond_wait(&u->not_full, &u->lock);
+        }
+        if (u->stopping) {
+            pthread_mutex_unlock(&u->lock);
+            nostr_event_destroy(copy);
+            return;
+        }
+        size_t tail = (u->head + u->count) % WHISPER_UNWRAP_QUEUE;
+        u->queue[tail] = copy;
+        u->seqs[tail] = u->next_seq++;
+        u->identities[tail] = (uint8_t)identity;
+        u->count++;
+        pthread_cond_signal(&u->not_empty);
+        pthread_mutex_unlock(&u->lock);
+        return;
+    }
+#endif
+
+    /* No workers: decrypt on the caller's thread (the pool serializes us) */
+    unwrap_one(u, event, u->next_seq++, identity);
+}
+
+void whisper_unwrap_wait_idle(whisper_unwrapper* u) {
+#ifndef _WIN32
+    if (u->jobs == 0) return;
+    pthread_mutex_lock(&u->lock);
+    while ((u->count > 0 || u->busy > 0) && !u->stopping) {
+        pthread_cond_wait(&u->idle, &u->lock);
+    }
+    pthread_mutex_unlock(&u->lock);
+#else
+    (void)u;
+#endif
+}
+
+bool whisper_unwrap_idle(whisper_unwrapper* u) {
+#ifndef _WIN32
+    if (u->jobs == 0) return true;
+    pthread_mutex_lock(&u->lock);
+    bool idle = u->count == 0 && u->busy == 0;
+    pthread_mutex_unlock(&u->lock);
+    return idle;
+#else
+    (void)u;
+    return true;
+#endif
+}
+
+void whisper_unwrap_release(whisper_unwrapper* u, size_t max_count) {
+    whisper_unwrap_wait_idle(u);
+
+    whisper_mutex_lock(&u->deliver_lock);
+    whisper_unwrapped* held = u->held;
+    size_t held_count = u->held_count;
+    u->held = NULL;
+    u->held_count = 0;
+    u->held_cap = 0;
+    u->ordered = false;
+    whisper_mutex_unlock(&u->deliver_lock);
+
+    if (held_count > 1) qsort(held, held_count, sizeof(*held), compare_held);
+
+    /* Keep the newest max_count, still printed oldest first; a --split
+     * message is one of them and goes whole or not at all */
+    const char** contents = NULL;
+    bool* keep = NULL;
+    if (max_count > 0 && held_count > max_count) {
+        contents = malloc(held_count * sizeof(*contents));
+        keep = malloc(held_count * sizeof(*keep));
+        if (contents && keep) {
+            for (size_t i = 0; i < held_count; i++) contents[i] = held[i].rumor->content;
+            whisper_parts_keep_newest(contents, held_count, max_count, keep);
+        } else {
+            /* Out of memory: trim by count, parts and all */
+            free(keep);
+            keep = NULL;
+        }
+    }
+    for (size_t i = 0; i < held_count; i++) {
+        bool wanted = keep ? keep[i] : max_count == 0 || i + max_count >= held_count;
+        if (wanted) {
+            deliver(u, &held[i]);
+        } else {
+            nostr_event_destroy(held[i].rumor);
+        }
+    }
+    free(contents);
+    free(keep);
+    if (held) {
+        secure_wipe(held, held_count * sizeof(*held));
+        free(held);
+    }
+}
+
+void whisper_unwrap_stop(whisper_unwrapper* u) {
+    if (!u->started) return;
+
+#ifndef _WIN32
+    pthread_mutex_lock(&u->lock);
+    u->stopping = true;
+    pthread_cond_broadcast(&u->not_empty);
+    pthread_cond_broadcast(&u->not_full);
+    pthread_cond_broadcast(&u->idle);
+    pthread_mutex_unlock(&u->lock);
+
+    /* Workers finish the queue so nothing already received is lost */
+    for (int i = 0; i < u->jobs; i++) {
+        pthread_join(u->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&u->not_empty);
+    pthread_cond_destroy(&u->not_full);
+    pthread_cond_destroy(&u->idle);
+    pthread_mutex_destroy(&u->lock);
+    u->jobs = 0;
+#endif
+
+    for (size_t i = 0; i < u->held_count; i++) {
+        nostr_event_destroy(u->held[i].rumor);
+    }
+    if (u->held) {
+        secure_wipe(u->held, u->held_count * sizeof(*u->held));
+        free(u->held);
+    }
+    u->held = NULL;
+    u->held_count = 0;
+    whisper_mutex_destroy(&u->deliver_lock);
+    u->started = false;
+}
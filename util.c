@@ -1,15 +1,58 @@
 /*
- * whisper utilities - Key loading and parsing
+ * whisper utilities - Key loading, parsing and event waiting
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <cjson/cJSON.h>
 #ifndef _WIN32
 #include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#else
+#include <windows.h>
 #endif
 #include "whisper.h"
 
+/* Key the daemon's key agent handed over, already derived */
+static const nostr_privkey* g_agent_privkey;
+static const nostr_key* g_agent_pubkey;
+
+void whisper_set_agent_key(const nostr_privkey* privkey, const nostr_key* pubkey) {
+    g_agent_privkey = privkey;
+    g_agent_pubkey = pubkey;
+}
+
+void whisper_lock_memory(void* addr, size_t len) {
+#ifndef _WIN32
+    /* Best effort: RLIMIT_MEMLOCK may be small, the wipe still happens */
+    mlock(addr, len);
+#ifdef MADV_DONTDUMP
+    long page = sysconf(_SC_PAGESIZE);
+    if (page > 0) {
+        uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(page - 1);
+        madvise((void*)start, (uintptr_t)addr + len - start, MADV_DONTDUMP);
+    }
+#endif
+#else
+    VirtualLock(addr, len);
+#endif
+}
+
+void whisper_unlock_memory(void* addr, size_t len) {
+    secure_wipe(addr, len);
+#ifndef _WIN32
+    munlock(addr, len);
+#else
+    VirtualUnlock(addr, len);
+#endif
+}
+
 /* Load private key from file, trimming whitespace */
 static char* read_key_file(const char* path) {
 #ifndef _WIN32
@@ -53,7 +96,12 @@ int whisper_load_privkey(const char* nsec_str, const char* nsec_file,
     char* file_buf = NULL;
     char* env_buf = NULL;
 
-    /* Priority: file > argument > environment */
+    /* Priority: file > key agent > argument > environment */
+    if (!nsec_file && g_agent_privkey) {
+        memcpy(privkey, g_agent_privkey, sizeof(*privkey));
+        memcpy(pubkey, g_agent_pubkey, sizeof(*pubkey));
+        return 0;
+    }
     if (nsec_file) {
         file_buf = read_key_file(nsec_file);
         if (!file_buf) {
@@ -131,6 +179,45 @@ int whisper_load_privkey(const char* nsec_str, const char* nsec_file,
     return 0;
 }
 
+int whisper_load_identities(const whisper_key_source* keys, int key_count,
+                            const char* nsec_str, const char* nsec_file,
+                            nostr_privkey* privkeys, nostr_key* pubkeys) {
+    if (key_count <= 0) {
+        return whisper_load_privkey(nsec_str, nsec_file, &privkeys[0], &pubkeys[0]) == 0 ? 1 : -1;
+    }
+    if (key_count > WHISPER_MAX_IDENTITIES) {
+        fprintf(stderr, "Error: At most %d keys\n", WHISPER_MAX_IDENTITIES);
+        return -1;
+    }
+
+    for (int i = 0; i < key_count; i++) {
+        if (keys[i].privkey) {
+            memcpy(&privkeys[i], keys[i].privkey, sizeof(privkeys[i]));
+            memcpy(&pubkeys[i], keys[i].pubkey, sizeof(pubkeys[i]));
+        } else if (!keys[i].nsec && !keys[i].nsec_file) {
+            fprintf(stderr, "Error: No private key provided\n");
+            key_count = i;
+            goto fail;
+        } else if (whisper_load_privkey(keys[i].nsec, keys[i].nsec_file,
+                                        &privkeys[i], &pubkeys[i]) != 0) {
+            key_count = i;
+            goto fail;
+        }
+        for (int j = 0; j < i; j++) {
+            if (memcmp(&pubkeys[j], &pubkeys[i], sizeof(pubkeys[i])) == 0) {
+                fprintf(stderr, "Error: The same key was given twice\n");
+                key_count = i + 1;
+                goto fail;
+            }
+        }
+    }
+    return key_count;
+
+fail:
+    secure_wipe(privkeys, (size_t)key_count * sizeof(*privkeys));
+    return -1;
+}
+
 int whisper_parse_pubkey(const char* pubkey_str, nostr_key* pubkey) {
     if (!pubkey_str) return -1;
 
@@ -155,19 +242,286 @@ int whisper_parse_pubkey(const char* pubkey_str, nostr_key* pubkey) {
     return 0;
 }
 
-char* whisper_strip_control_chars(const char* input) {
-    if (!input) return NULL;
-    size_t len = strlen(input);
-    char* output = malloc(len + 1);
-    if (!output) return NULL;
+int whisper_read_relay_file(const char* path, char** urls, int max_urls) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: Could not read relay file: %s\n", path);
+        return -1;
+    }
+
+    int count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char* start = line;
+        while (*start == ' ' || *start == '\t') start++;
+        size_t len = strlen(start);
+        while (len > 0 && isspace((unsigned char)start[len-1])) start[--len] = '\0';
+        if (len == 0 || start[0] == '#') continue;
+
+        if (count >= max_urls || !(urls[count] = strdup(start))) {
+            fprintf(stderr, "Error: Too many relays in %s (max %d)\n", path, max_urls);
+            while (count > 0) free(urls[--count]);
+            fclose(f);
+            return -1;
+        }
+        count++;
+    }
+    fclose(f);
+
+    if (count == 0) {
+        fprintf(stderr, "Error: No relays in %s\n", path);
+        return -1;
+    }
+    return count;
+}
+
+void whisper_event_id_hex(const nostr_event* event, char out[65]) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 32; i++) {
+        out[i * 2] = hex[event->id[i] >> 4];
+        out[i * 2 + 1] = hex[event->id[i] & 0x0f];
+    }
+    out[64] = '\0';
+}
+
+static bool is_event_id(const char* s) {
+    if (!s || strlen(s) != 64) return false;
+    for (int i = 0; i < 64; i++) {
+        if (!isxdigit((unsigned char)s[i])) return false;
+    }
+    return true;
+}
+
+int whisper_parse_ok(const char* data, char event_id[65], bool* accepted,
+                     char* message, size_t message_size) {
+    if (!data) return -1;
+    if (message_size > 0) message[0] = '\0';
 
-    size_t j = 0;
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = (unsigned char)input[i];
-        if (c == '\t' || c == '\n' || c >= 0x80 || (c >= 0x20 && c < 0x7F)) {
-            output[j++] = (char)c;
+    /* Either the full ["OK",<id>,<bool>,<msg>] frame or its tail */
+    cJSON* root = cJSON_Parse(data);
+    if (cJSON_IsArray(root)) {
+        const cJSON* item;
+        bool found = false;
+        int field = 0;
+        cJSON_ArrayForEach(item, root) {
+            if (!found) {
+                if (cJSON_IsString(item) && is_event_id(item->valuestring)) {
+                    memcpy(event_id, item->valuestring, 65);
+                    *accepted = true;
+                    found = true;
+                }
+            } else if (field == 0 && cJSON_IsBool(item)) {
+                *accepted = cJSON_IsTrue(item);
+                field++;
+            } else if (cJSON_IsString(item) && message_size > 0) {
+                snprintf(message, message_size, "%s", item->valuestring);
+                break;
+            }
+        }
+        cJSON_Delete(root);
+        if (found) {
+            for (int i = 0; i < 64; i++) event_id[i] = (char)tolower((unsigned char)event_id[i]);
         }
+        return found ? 0 : -1;
+    }
+    cJSON_Delete(root);
+
+    /* Plain text payload: take the first 64-char hex run as the id */
+    for (const char* p = data; *p; p++) {
+        size_t run = 0;
+        while (isxdigit((unsigned char)p[run])) run++;
+        if (run == 64) {
+            for (int i = 0; i < 64; i++) event_id[i] = (char)tolower((unsigned char)p[i]);
+            event_id[64] = '\0';
+            *accepted = strstr(p + 64, "false") == NULL;
+            return 0;
+        }
+        if (run > 0) p += run - 1;
+    }
+    return -1;
+}
+
+void whisper_mutex_init(whisper_mutex* m) {
+#ifndef _WIN32
+    pthread_mutex_init(m, NULL);
+#else
+    InitializeCriticalSection(m);
+#endif
+}
+
+void whisper_mutex_lock(whisper_mutex* m) {
+#ifndef _WIN32
+    pthread_mutex_lock(m);
+#else
+    EnterCriticalSection(m);
+#endif
+}
+
+void whisper_mutex_unlock(whisper_mutex* m) {
+#ifndef _WIN32
+    pthread_mutex_unlock(m);
+#else
+    LeaveCriticalSection(m);
+#endif
+}
+
+void whisper_mutex_destroy(whisper_mutex* m) {
+#ifndef _WIN32
+    pthread_mutex_destroy(m);
+#else
+    DeleteCriticalSection(m);
+#endif
+}
+
+int whisper_idset_init(whisper_idset* set, size_t capacity) {
+    /* Keep each generation at most half full */
+    size_t size = 64;
+    while (size < capacity * 2) size <<= 1;
+
+    set->slots[0] = calloc(size, 32);
+    set->slots[1] = calloc(size, 32);
+    if (!set->slots[0] || !set->slots[1]) {
+        whisper_idset_destroy(set);
+        return -1;
+    }
+    set->size = size;
+    set->count = 0;
+    return 0;
+}
+
+/* Ids are hashes already, so the leading bytes make a good probe start */
+static size_t idset_probe_start(const whisper_idset* set, const uint8_t id[32]) {
+    size_t h = 0;
+    for (int i = 0; i < (int)sizeof(size_t); i++) h = (h << 8) | id[i];
+    return h & (set->size - 1);
+}
+
+static bool idset_contains(const whisper_idset* set, const uint8_t* table, const uint8_t id[32]) {
+    static const uint8_t empty[32] = {0};
+    for (size_t i = idset_probe_start(set, id); ; i = (i + 1) & (set->size - 1)) {
+        const uint8_t* slot = table + i * 32;
+        if (memcmp(slot, id, 32) == 0) return true;
+        if (memcmp(slot, empty, 32) == 0) return false;
+    }
+}
+
+bool whisper_idset_contains(const whisper_idset* set, const uint8_t id[32]) {
+    if (!set->slots[0]) return false;
+    return idset_contains(set, set->slots[0], id) || idset_contains(set, set->slots[1], id);
+}
+
+bool whisper_idset_insert(whisper_idset* set, const uint8_t id[32]) {
+    static const uint8_t empty[32] = {0};
+    if (!set->slots[0] || memcmp(id, empty, 32) == 0) return true;
+
+    if (idset_contains(set, set->slots[0], id) || idset_contains(set, set->slots[1], id)) {
+        return false;
+    }
+
+    /* Current generation full: it becomes the previous one */
+    if (set->count >= set->size / 2) {
+        uint8_t* old = set->slots[1];
+        memset(old, 0, set->size * 32);
+        set->slots[1] = set->slots[0];
+        set->slots[0] = old;
+        set->count = 0;
+    }
+
+    size_t i = idset_probe_start(set, id);
+    while (memcmp(set->slots[0] + i * 32, empty, 32) != 0) {
+        i = (i + 1) & (set->size - 1);
+    }
+    memcpy(set->slots[0] + i * 32, id, 32);
+    set->count++;
+    return true;
+}
+
+void whisper_idset_destroy(whisper_idset* set) {
+    free(set->slots[0]);
+    free(set->slots[1]);
+    set->slots[0] = NULL;
+    set->slots[1] = NULL;
+    set->size = 0;
+    set->count = 0;
+}
+
+#ifndef _WIN32
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+#endif
+
+int whisper_wakeup_init(whisper_wakeup* w) {
+    w->fds[0] = -1;
+    w->fds[1] = -1;
+#ifndef _WIN32
+    if (pipe(w->fds) != 0) {
+        w->fds[0] = -1;
+        w->fds[1] = -1;
+        return -1;
+    }
+    if (set_nonblocking(w->fds[0]) != 0 || set_nonblocking(w->fds[1]) != 0) {
+        whisper_wakeup_destroy(w);
+        return -1;
     }
-    output[j] = '\0';
-    return output;
+#endif
+    return 0;
+}
+
+void whisper_wakeup_destroy(whisper_wakeup* w) {
+#ifndef _WIN32
+    if (w->fds[0] >= 0) close(w->fds[0]);
+    if (w->fds[1] >= 0) close(w->fds[1]);
+#endif
+    w->fds[0] = -1;
+    w->fds[1] = -1;
+}
+
+void whisper_wakeup_signal(whisper_wakeup* w) {
+#ifndef _WIN32
+    if (w->fds[1] < 0) return;
+    /* A full pipe already guarantees a pending wakeup, so EAGAIN is fine */
+    char c = 1;
+    ssize_t n = write(w->fds[1], &c, 1);
+    (void)n;
+#else
+    (void)w;
+#endif
+}
+
+int whisper_wakeup_wait(whisper_wakeup* w, int timeout_ms) {
+#ifndef _WIN32
+    if (w->fds[0] < 0) return 0;
+
+    struct pollfd pfd = { .fd = w->fds[0], .events = POLLIN };
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0) {
+        /* EINTR: a signal handler may have changed state, let caller re-check */
+        return 1;
+    }
+    if (rc == 0) return 0;
+
+    char drain[64];
+    while (read(w->fds[0], drain, sizeof(drain)) > 0) {
+    }
+    return 1;
+#else
+    /* No self-pipe on Windows - fall back to short sleeps */
+    (void)w;
+    Sleep((timeout_ms < 0 || timeout_ms > 10) ? 10 : (DWORD)timeout_ms);
+    return 1;
+#endif
+}
+
+int64_t whisper_now_ms(void) {
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+    return (int64_t)GetTickCount64();
+#endif
 }
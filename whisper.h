@@ -10,8 +10,17 @@
 #define WHISPER_H
 
 #include <nostr.h>
+#include <cjson/cJSON.h>
+#include "text.h"
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <signal.h>
+#ifndef _WIN32
+#include <pthread.h>
+#else
+#include <windows.h>
+#endif
 
 /* Exit codes */
 #define WHISPER_EXIT_OK              0
@@ -24,42 +33,843 @@
 /* Default timeout in milliseconds */
 #define WHISPER_DEFAULT_TIMEOUT_MS   5000
 
+/* Maximum number of relays per command */
+#define WHISPER_MAX_RELAYS           16
+
+/* Maximum keys recv and the daemon listen for at once */
+#define WHISPER_MAX_IDENTITIES       32
+
+/* One private key to load: nsec/hex string or key file (see whisper_load_privkey),
+ * or a pair the daemon's key agent already derived */
+typedef struct {
+    const char* nsec;
+    const char* nsec_file;
+    const char* keep_name;       /* keep vault name it came from, if any */
+    const nostr_privkey* privkey;
+    const nostr_key* pubkey;
+} whisper_key_source;
+
 /* Configuration for send command */
 typedef struct {
     const char* recipient;       /* npub or hex pubkey */
     const char* nsec;            /* nsec or hex private key */
     const char* nsec_file;       /* path to file containing nsec */
-    const char* relay_url;       /* relay URL */
+    const char* const* relay_urls; /* relay URLs */
+    int relay_count;             /* number of relay URLs */
+    int quorum;                  /* relay OKs required before returning */
     const char* subject;         /* optional subject */
     const char* reply_to;        /* optional event ID to reply to */
     int timeout_ms;              /* relay timeout */
+    bool batch;                  /* read NDJSON records from stdin */
+    bool split;                  /* send input too long for one DM as parts */
+    bool prewarm;                /* dial relays before loading the key and wrapping */
+    const char* socket_path;     /* hand off to daemon at this socket */
+    int window;                  /* --batch: events awaiting OK at once */
+    int jobs;                    /* --batch: wrap workers (0 = one per CPU) */
 } whisper_send_config;
 
 /* Configuration for recv command */
 typedef struct {
     const char* nsec;            /* nsec or hex private key */
     const char* nsec_file;       /* path to file containing nsec */
-    const char* relay_url;       /* relay URL */
+    const char* const* relay_urls; /* relay URLs */
+    int relay_count;             /* number of relay URLs */
     int64_t since;               /* only messages after this timestamp */
     int limit;                   /* max messages (0 = unlimited) */
     bool json_output;            /* output raw JSON */
     int timeout_ms;              /* connection timeout */
+    const char* socket_path;     /* attach to daemon at this socket */
+    int jobs;                    /* unwrap workers (0 = one per CPU) */
+    bool ordered;                /* print stored messages by created_at */
+    const char* store_dir;       /* local inbox store (NULL = none) */
+    const char* archive_dir;     /* binary message archive (NULL = none) */
+    int flush_mode;              /* WHISPER_FLUSH_* */
+    int rate_cap;                /* gift wraps per relay per second (0 = no cap) */
+    const whisper_key_source* keys; /* several identities (overrides nsec/nsec_file) */
+    int key_count;
 } whisper_recv_config;
 
+/* recv --flush: when buffered output reaches stdout */
+enum {
+    WHISPER_FLUSH_LINE = 0,      /* after every message (interactive) */
+    WHISPER_FLUSH_BATCH,         /* when 64 KiB are buffered or once a second */
+    WHISPER_FLUSH_NONE           /* only when the buffer fills and at exit */
+};
+
+/* Configuration for daemon command */
+typedef struct {
+    const char* nsec;            /* nsec or hex private key */
+    const char* nsec_file;       /* path to file containing nsec */
+    const char* const* relay_urls; /* relay URLs */
+    int relay_count;             /* number of relay URLs */
+    int quorum;                  /* relay OKs required per send */
+    const char* socket_path;     /* listen here (NULL = default) */
+    int timeout_ms;              /* relay timeout */
+    int jobs;                    /* unwrap workers (0 = one per CPU) */
+    int window;                  /* sends awaiting OK at once */
+    bool stats;                  /* print the stats summary to stderr periodically */
+    int rate_cap;                /* gift wraps per relay per second (0 = no cap) */
+    const whisper_key_source* keys; /* several identities (overrides nsec/nsec_file) */
+    int key_count;
+    bool key_agent;              /* hand keep-vault keys to same-user clients */
+} whisper_daemon_config;
+
+/* Configuration for log command */
+typedef struct {
+    const char* dir;             /* archive written by recv --archive */
+    int64_t since;               /* created_at lower bound (inclusive) */
+    int64_t until;               /* created_at upper bound (inclusive, 0 = none) */
+    const char* from;            /* only this sender (npub or hex) */
+    const char* to;              /* only this recipient (npub or hex) */
+    int limit;                   /* newest n matches (0 = all) */
+    bool json_output;            /* NDJSON instead of text lines */
+} whisper_log_config;
+
+/* Mutex usable from relay callback threads */
+#ifndef _WIN32
+typedef pthread_mutex_t whisper_mutex;
+#else
+typedef CRITICAL_SECTION whisper_mutex;
+#endif
+
+/* Set of recently seen event ids, bounded to about `capacity` entries */
+typedef struct {
+    uint8_t* slots[2];           /* current and previous generation */
+    size_t count;                /* entries in current generation */
+    size_t size;                 /* slots per generation (power of two) */
+} whisper_idset;
+
+/* Wakeup channel signalled from relay callbacks and signal handlers */
+typedef struct {
+    int fds[2];                  /* self-pipe: [0] read end, [1] write end */
+} whisper_wakeup;
+
+#define WHISPER_WAKEUP_INIT { { -1, -1 } }
+
+/* Gift wrap unwrapping in worker threads (unwrap.c) */
+#define WHISPER_MAX_JOBS 32
+#define WHISPER_UNWRAP_QUEUE 1024    /* raw events buffered before relays block */
+
+/* One decrypted gift wrap */
+typedef struct {
+    nostr_event* rumor;
+    nostr_key sender;
+    uint8_t wrap_id[32];         /* kind-1059 event id */
+    int64_t wrap_created_at;     /* randomized by the sender, see NIP-59 */
+    uint64_t seq;                /* arrival order, breaks created_at ties */
+    int identity;                /* which of the unwrapper's keys it was for */
+} whisper_unwrapped;
+
+/* Receives each message once; calls are serialized. The rumor is freed after. */
+typedef void (*whisper_unwrap_cb)(const whisper_unwrapped* msg, void* user_data);
+
+typedef struct {
+    const nostr_privkey* privkeys;
+    int key_count;
+    whisper_unwrap_cb on_message;
+    void* user_data;
+    int jobs;                    /* worker threads (0 = unwrap inline) */
+    bool started;
+#ifndef _WIN32
+    pthread_t threads[WHISPER_MAX_JOBS];
+    pthread_mutex_t lock;        /* queue state below */
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t idle;
+#endif
+    nostr_event* queue[WHISPER_UNWRAP_QUEUE];
+    uint64_t seqs[WHISPER_UNWRAP_QUEUE];
+    uint8_t identities[WHISPER_UNWRAP_QUEUE];
+    size_t head;
+    size_t count;
+    int busy;                    /* workers mid-unwrap */
+    bool stopping;
+    uint64_t next_seq;
+
+    /* Delivery: serializes on_message and guards the ordered backlog */
+    whisper_mutex deliver_lock;
+    bool ordered;                /* hold rumors until whisper_unwrap_release */
+    whisper_unwrapped* held;
+    size_t held_count;
+    size_t held_cap;
+    unsigned long failed;        /* wraps that did not decrypt */
+} whisper_unwrapper;
+
+/* Gift wrapping in worker threads (wrap.c) */
+#define WHISPER_WRAP_QUEUE 256       /* records accepted before submit blocks */
+
+/* One record's gift wrap, or why there is none */
+typedef struct {
+    nostr_event* event;          /* owned by the callback; NULL on failure */
+    void* token;
+    int code;                    /* WHISPER_EXIT_* */
+    const char* error;
+} whisper_wrapped;
+
+/* Receives each record in submission order; calls are serialized */
+typedef void (*whisper_wrap_cb)(const whisper_wrapped* result, void* user_data);
+
+typedef struct {
+    nostr_key recipient;
+    char* content;               /* owned copies, wiped when done */
+    char* subject;
+    void* token;
+    nostr_event* event;
+    int code;
+    char error[192];
+    bool done;
+} whisper_wrap_job;
+
+typedef struct {
+    const nostr_privkey* privkey;
+    whisper_wrap_cb on_wrapped;
+    void* user_data;
+    int jobs;                    /* worker threads (0 = wrap inline) */
+    bool started;
+#ifndef _WIN32
+    pthread_t threads[WHISPER_MAX_JOBS];
+    pthread_mutex_t lock;        /* queue state below */
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t idle;
+#endif
+    whisper_wrap_job queue[WHISPER_WRAP_QUEUE];
+    size_t head;
+    size_t count;                /* queued, wrapping or awaiting delivery */
+    size_t claimed;              /* of those, taken by a worker */
+    bool delivering;             /* a worker is running on_wrapped */
+    bool stopping;
+} whisper_wrapper;
+
+/* Per-peer npub/hex encoding cache (peers.c) */
+#define WHISPER_PEER_CACHE_SIZE 256
+
+typedef struct {
+    nostr_key key;
+    char npub[100];
+    char hex[65];
+    uint64_t last_used;
+} whisper_peer;
+
+typedef struct {
+    whisper_peer* entries;
+    size_t count;
+    size_t capacity;
+    uint64_t tick;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    whisper_mutex lock;
+} whisper_peer_cache;
+
+/* Local inbox store (store.c) */
+#define WHISPER_STORE_MAX_CURSORS 64
+#define WHISPER_NIP59_SKEW_S (2 * 24 * 60 * 60)  /* wraps may be backdated 2 days */
+
+typedef struct {
+    char* url;
+    int64_t since;               /* newest wrap created_at fully stored */
+} whisper_store_cursor;
+
+typedef struct {
+    FILE* fp;                    /* append handle */
+    whisper_mutex lock;
+    whisper_idset ids;           /* gift wraps already stored */
+    whisper_store_cursor cursors[WHISPER_STORE_MAX_CURSORS];
+    int cursor_count;
+    size_t message_count;
+    bool open;
+} whisper_store;
+
+/* Binary message archive (archive.c) */
+#define WHISPER_ARCHIVE_MAX_CONTENT (16 * 1024 * 1024)
+
+typedef struct {
+    int fd;                      /* append handle, flock()ed while open */
+    whisper_mutex lock;
+    whisper_idset ids;           /* gift wraps already archived */
+    uint64_t size;               /* log bytes, all complete records */
+    size_t message_count;        /* appended this session */
+    bool reindex;                /* index does not cover the log yet */
+    char dir[512];
+    bool open;
+} whisper_archive;
+
+/* Receives each stored message during whisper_store_open */
+typedef void (*whisper_store_cb)(const char* from_npub, const char* content,
+                                 int64_t created_at, void* user_data);
+
+/* Store: one message line, located for paging */
+typedef struct {
+    int64_t wrap_at;
+    long offset;
+} whisper_store_entry;
+
+/* Store: the inbox's messages indexed newest wrap first, read a page at a
+ * time without rescanning the file */
+typedef struct {
+    FILE* fp;
+    whisper_store_entry* entries;
+    size_t count;
+    size_t next;                 /* first entry not yet paged */
+} whisper_store_pager;
+
+/* Receives each message of a whisper_store_pager page */
+typedef void (*whisper_store_page_cb)(const uint8_t wrap_id[32], const char* from_npub,
+                                      const char* content, int64_t created_at,
+                                      void* user_data);
+
+typedef struct whisper_pool whisper_pool;
+typedef struct whisper_publisher whisper_publisher;
+
+/* Pre-decrypt checks on incoming gift wraps, applied in this order; the
+ * first that fails drops the event before it is queued for unwrapping */
+enum {
+    WHISPER_DROP_KIND = 0,       /* not kind 1059 */
+    WHISPER_DROP_RECIPIENT,      /* no "p" tag naming one of our keys */
+    WHISPER_DROP_SIZE,           /* content too short or long to be NIP-44 */
+    WHISPER_DROP_AGE,            /* created_at outside the window */
+    WHISPER_DROP_DUPLICATE,      /* already received from another relay */
+    WHISPER_DROP_RATE,           /* relay over its per-second cap */
+    WHISPER_DROP_STAGES
+};
+
+/* Base64 NIP-44 v2 payload: 1 + 32 + (2 + 32..65536) + 32 bytes */
+#define WHISPER_NIP44_MIN_B64 132
+#define WHISPER_NIP44_MAX_B64 87472
+
+typedef struct {
+    bool enabled;
+    char recipients[WHISPER_MAX_IDENTITIES][65];  /* our pubkeys, hex */
+    int recipient_count;
+    int64_t since;               /* the REQ's since: older wraps were not asked for */
+    int max_per_second;          /* per relay (0 = no cap) */
+} whisper_prefilter;
+
+/* One relay connection inside a pool */
+typedef struct {
+    whisper_pool* pool;
+    const char* url;
+    nostr_relay* relay;
+    int index;
+    volatile sig_atomic_t connected;  /* 0 = pending, 1 = up, -1 = failed */
+    volatile sig_atomic_t ok_state;   /* 0 = pending, 1 = accepted, -1 = rejected */
+    bool published;                   /* current event sent to this relay */
+    bool subscribed;                  /* active subscription on this relay */
+    volatile sig_atomic_t eose;       /* subscription has sent all stored events */
+    volatile sig_atomic_t page_pending; /* whisper_pool_fetch awaiting EOSE */
+    bool paged;                       /* whisper_pool_fetch subscribed here */
+    int64_t deadline_ms;              /* OK deadline for current event */
+    int64_t sent_us;                  /* current event written, for OK latency */
+    int64_t subscribed_us;            /* REQ written, for EOSE latency */
+    int64_t rate_second;              /* prefilter rate cap: current second... */
+    int rate_count;                   /* ...and wraps let through in it */
+    int64_t newest_created_at;        /* latest event created_at from this relay */
+    int64_t oldest_created_at;        /* earliest event created_at from this relay */
+    int64_t rate_floor;               /* earliest wrap dropped by the rate cap (0 = none) */
+    unsigned long events_received;    /* events from this relay, duplicates included */
+    int page_events;                  /* events in the current fetch page */
+    int64_t page_oldest;              /* earliest created_at in that page */
+    char pending_id[65];              /* event id awaiting OK */
+    char ok_message[128];             /* reason from OK / failure */
+    bool was_up;                      /* connected at least once: worth redialing */
+    int retries;                      /* redials since the last EOSE */
+    int64_t retry_at_ms;              /* next redial (0 = none scheduled) */
+    int64_t dialed_ms;                /* redial in progress since */
+    int64_t resume_since;             /* since for the resubscription (0 = as first) */
+} whisper_pool_relay;
+
+/* Pool: redial backoff, doubling per failed attempt, each wait jittered
+ * down to half so relays that dropped together don't redial together */
+#define WHISPER_RECONNECT_BASE_MS    500
+#define WHISPER_RECONNECT_MAX_MS     60000
+#define WHISPER_RECONNECT_DIAL_MS    15000  /* give up on an attempt after this */
+
+/* Set of relays connected in parallel */
+struct whisper_pool {
+    whisper_pool_relay relays[WHISPER_MAX_RELAYS];
+    int count;
+    bool open;
+    int64_t opened_ms;
+    whisper_wakeup wakeup;
+    /* Optional hooks, called on the relay threads */
+    void (*on_state)(whisper_pool_relay* conn, nostr_relay_state state, void* user_data);
+    void (*on_message)(whisper_pool_relay* conn, const char* type, const char* data,
+                       void* user_data);
+    /* Called once per distinct event id across all relays, serialized */
+    void (*on_event)(whisper_pool_relay* conn, const nostr_event* event, void* user_data);
+    void* user_data;
+
+    /* Subscription state */
+    whisper_mutex event_lock;
+    whisper_idset seen;
+    unsigned long duplicates;
+    whisper_prefilter filter;    /* set before whisper_pool_subscribe */
+    unsigned long dropped[WHISPER_DROP_STAGES];
+    const char* sub_id;
+    char* sub_filter;
+    uint32_t jitter;             /* whisper_pool_maintain's PRNG state */
+
+    /* One-shot history page (whisper_pool_fetch), guarded by event_lock */
+    const char* volatile page_id;
+    int page_events;             /* events received, duplicates included */
+    int page_fresh;              /* events that reached on_event */
+
+    /* Pipelined publisher fed this pool's OKs, if any (publish.c) */
+    whisper_publisher* volatile publisher;
+};
+
+/* Pipelined publishing (publish.c) */
+#define WHISPER_MAX_WINDOW 64
+#define WHISPER_DEFAULT_WINDOW 8
+
+/* Per-relay progress of one pipelined event */
+enum {
+    WHISPER_PUB_UNSENT = 0,
+    WHISPER_PUB_SENT,            /* awaiting OK */
+    WHISPER_PUB_SENDING,         /* write in progress with the lock dropped */
+    WHISPER_PUB_ACCEPTED,
+    WHISPER_PUB_REJECTED,
+    WHISPER_PUB_TIMEOUT,         /* sent, no OK before the deadline */
+    WHISPER_PUB_FAILED           /* never sent: relay down or write failed */
+};
+
+typedef struct {
+    nostr_event* event;
+    void* token;
+    char id[65];
+    int64_t submitted_ms;
+    int8_t state[WHISPER_MAX_RELAYS];
+    uint8_t sends[WHISPER_MAX_RELAYS];          /* rate-limited resends included */
+    int64_t deadline_ms[WHISPER_MAX_RELAYS];    /* OK, or connect, deadline */
+    int64_t sent_us[WHISPER_MAX_RELAYS];        /* last write, for OK latency */
+    char reason[128];            /* first rejection message */
+    int code;                    /* no event: failed before publishing */
+    bool done;
+} whisper_pub_entry;
+
+/* Outcome handed to on_done, in submission order */
+typedef struct {
+    const char* id;
+    void* token;
+    int accepted;
+    int published;
+    int rejected;
+    int code;                    /* WHISPER_EXIT_* as whisper_pool_send_dm */
+    char error[192];
+} whisper_publish_result;
+
+typedef void (*whisper_publish_cb)(const whisper_publish_result* result, void* user_data);
+
+struct whisper_publisher {
+    whisper_pool* pool;
+    int window;
+    int quorum;
+    int timeout_ms;
+    whisper_publish_cb on_done;
+    void* user_data;
+    bool started;
+#ifndef _WIN32
+    pthread_t thread;
+    pthread_mutex_t lock;        /* entries and relay pacing below */
+    pthread_cond_t not_full;
+    pthread_cond_t idle;
+    whisper_wakeup wakeup;
+#endif
+    whisper_pub_entry entries[WHISPER_MAX_WINDOW];
+    int head;
+    int count;
+    bool stopping;
+    int64_t paused_until[WHISPER_MAX_RELAYS];   /* after a rate-limited: OK */
+    int backoff_ms[WHISPER_MAX_RELAYS];
+    unsigned long rate_limited;
+};
+
+/* Instrumentation (stats.c): process-wide counters */
+enum {
+    WHISPER_STAT_EVENTS = 0,     /* gift wraps received, duplicates included */
+    WHISPER_STAT_DUPLICATES,     /* dropped as already seen on another relay */
+    WHISPER_STAT_UNWRAPPED,
+    WHISPER_STAT_DECRYPT_FAILED,
+    WHISPER_STAT_PUBLISHED,      /* event written to one relay */
+    WHISPER_STAT_OK_ACCEPTED,
+    WHISPER_STAT_OK_REJECTED,
+    WHISPER_STAT_OK_TIMEOUT,
+    WHISPER_STAT_DROP_KIND,      /* pre-decrypt drops, one per WHISPER_DROP_* stage */
+    WHISPER_STAT_DROP_RECIPIENT, /* (duplicates are WHISPER_STAT_DUPLICATES) */
+    WHISPER_STAT_DROP_SIZE,
+    WHISPER_STAT_DROP_AGE,
+    WHISPER_STAT_DROP_RATE,
+    WHISPER_STAT_RECONNECTS,
+    WHISPER_STAT_COUNTERS
+};
+
+/* Instrumentation: latency histograms, recorded in microseconds */
+enum {
+    WHISPER_LAT_CONNECT = 0,     /* pool open to relay up: TCP, TLS and upgrade */
+    WHISPER_LAT_EOSE,            /* REQ to EOSE */
+    WHISPER_LAT_WRAP,            /* seal + gift wrap of one DM */
+    WHISPER_LAT_UNWRAP,          /* both layers, failures included */
+    WHISPER_LAT_PUBLISH,         /* nostr_publish_event write */
+    WHISPER_LAT_OK,              /* write to OK, per relay */
+    WHISPER_LATENCIES
+};
+
+#define WHISPER_STAT_BUCKETS 16
+
 /* Send a DM, reading content from stdin */
 int whisper_send(const whisper_send_config* config);
 
+/* send --prewarm: start dialing the relays for the coming whisper_send,
+ * which picks them up. Returns 0 if any handshake started. */
+int whisper_send_prewarm(const char* const* urls, int count);
+
+/* Close relays prewarmed for a whisper_send that never ran */
+void whisper_send_prewarm_close(void);
+
 /* Receive DMs, writing to stdout */
 int whisper_recv(const whisper_recv_config* config);
 
+/* Run the resident daemon until SIGINT/SIGTERM */
+int whisper_daemon(const whisper_daemon_config* config);
+
+/* Daemon client: default socket path ($XDG_RUNTIME_DIR/whisper/daemon.sock
+ * or /tmp/whisper-<uid>/daemon.sock) */
+const char* whisper_daemon_default_socket(char* buf, size_t size);
+
+/* Daemon client: connect to the daemon socket, returns fd or -1 */
+int whisper_daemon_connect(const char* path);
+
+/* Daemon client: print the daemon's stats (Prometheus text, or JSON) */
+int whisper_daemon_stats(const char* socket_path, bool json_output);
+
+/* Daemon client: fetch the keep-vault key `name` from a daemon running with
+ * --key-agent. Quiet; returns 0, or -1 when there is no such agent or key. */
+int whisper_daemon_key(const char* socket_path, const char* name,
+                       nostr_privkey* privkey, nostr_key* pubkey);
+
+/* Daemon client: write a JSON request line / read a reply line.
+ * read returns a malloc'd parsed object or NULL on EOF/error. */
+int whisper_daemon_request(int fd, const cJSON* request);
+cJSON* whisper_daemon_read(FILE* in);
+
 /* Utility: load private key from string or file */
 int whisper_load_privkey(const char* nsec_str, const char* nsec_file,
                          nostr_privkey* privkey, nostr_key* pubkey);
 
+/* Utility: have whisper_load_privkey return this pair (owned by the caller)
+ * ahead of --nsec and NOSTR_NSEC; --nsec-file still wins */
+void whisper_set_agent_key(const nostr_privkey* privkey, const nostr_key* pubkey);
+
+/* Utility: keep key material out of swap and core dumps (best effort);
+ * unlock wipes it first */
+void whisper_lock_memory(void* addr, size_t len);
+void whisper_unlock_memory(void* addr, size_t len);
+
+/* Utility: load keys[0..key_count) into privkeys/pubkeys, in order, or the
+ * single whisper_load_privkey key when key_count is 0. Returns the number
+ * of identities loaded, or -1 (nothing left unwiped) */
+int whisper_load_identities(const whisper_key_source* keys, int key_count,
+                            const char* nsec_str, const char* nsec_file,
+                            nostr_privkey* privkeys, nostr_key* pubkeys);
+
 /* Utility: parse pubkey from npub or hex */
 int whisper_parse_pubkey(const char* pubkey_str, nostr_key* pubkey);
 
-/* Utility: strip control characters from string (returns malloc'd copy) */
-char* whisper_strip_control_chars(const char* input);
+/* Utility: format an event id as 64 hex chars + NUL */
+void whisper_event_id_hex(const nostr_event* event, char out[65]);
+
+/* Utility: parse the payload of a relay OK message.
+ * Returns 0 and fills event_id/accepted/message if an event id was found. */
+int whisper_parse_ok(const char* data, char event_id[65], bool* accepted,
+                     char* message, size_t message_size);
+
+/* Utility: mutex wrappers */
+void whisper_mutex_init(whisper_mutex* m);
+void whisper_mutex_lock(whisper_mutex* m);
+void whisper_mutex_unlock(whisper_mutex* m);
+void whisper_mutex_destroy(whisper_mutex* m);
+
+/* Utility: id set. insert returns true if the id was not seen before. */
+int whisper_idset_init(whisper_idset* set, size_t capacity);
+bool whisper_idset_insert(whisper_idset* set, const uint8_t id[32]);
+bool whisper_idset_contains(const whisper_idset* set, const uint8_t id[32]);
+void whisper_idset_destroy(whisper_idset* set);
+
+/* Utility: create/destroy a wakeup channel */
+int whisper_wakeup_init(whisper_wakeup* w);
+void whisper_wakeup_destroy(whisper_wakeup* w);
+
+/* Utility: wake any waiter (async-signal-safe) */
+void whisper_wakeup_signal(whisper_wakeup* w);
+
+/* Utility: block until signalled or timeout_ms elapses (-1 = forever).
+ * Returns 1 if woken, 0 on timeout. */
+int whisper_wakeup_wait(whisper_wakeup* w, int timeout_ms);
+
+/* Utility: monotonic clock in milliseconds */
+int64_t whisper_now_ms(void);
+
+/* Utility: read relay URLs (one per line, '#' comments) into a malloc'd
+ * array of malloc'd strings. Returns the number read or -1. */
+int whisper_read_relay_file(const char* path, char** urls, int max_urls);
+
+/* Utility: monotonic clock in microseconds */
+int64_t whisper_now_us(void);
+
+/* Stats: add n to a WHISPER_STAT_* counter (thread-safe) */
+void whisper_stats_count(int counter, unsigned long n);
+
+/* Stats: record a WHISPER_LAT_* duration (thread-safe) */
+void whisper_stats_observe(int latency, int64_t us);
+
+/* Stats: append a JSON summary (counters, per-stage count/mean/p50/p90/p99/max
+ * in ms) / the Prometheus text exposition. Return 0 or -1. */
+int whisper_stats_json(whisper_buf* out);
+int whisper_stats_prometheus(whisper_buf* out);
+
+/* Stats: write the JSON summary as one line */
+void whisper_stats_print(FILE* out);
+
+/* Pool: start connecting to every URL at once. Hooks must be set first.
+ * Returns the number of handshakes started, -1 on error. */
+int whisper_pool_open(whisper_pool* pool, const char* const* urls, int count);
+
+/* Pool: wait until min_connected relays are up, all have settled, or the
+ * timeout (counted from whisper_pool_open) passes. Returns relays up. */
+int whisper_pool_wait_connected(whisper_pool* pool, int min_connected, int timeout_ms);
+
+/* Pool: number of relays currently connected */
+int whisper_pool_connected_count(const whisper_pool* pool);
+
+/* Pool: enable the pre-decrypt checks for gift wraps to recipient that are
+ * newer than since (0 = any) with at most max_per_second per relay (0 = no
+ * cap). Further keys may be added with whisper_prefilter_add. */
+void whisper_prefilter_init(whisper_prefilter* f, const nostr_key* recipient, int64_t since,
+                            int max_per_second);
+int whisper_prefilter_add(whisper_prefilter* f, const nostr_key* recipient);
+
+/* Pool: index of the first WHISPER_DROP_* check the event fails, or -1.
+ * Duplicate and rate checks need the pool and are not applied here. */
+int whisper_prefilter_check(const whisper_prefilter* f, const nostr_event* event, int64_t now);
+
+/* Pool: which of the prefilter's keys (in the order added) the event's p tag
+ * names; 0 when it has no keys, -1 when none match */
+int whisper_prefilter_recipient(const whisper_prefilter* f, const nostr_event* event);
+
+/* Pool: REQ filter for gift wraps to every prefilter key; since/until/limit
+ * are left out when 0. Returns 0, or -1 if buf is too small. */
+#define WHISPER_DM_FILTER_SIZE (128 + WHISPER_MAX_IDENTITIES * 68)
+int whisper_dm_filter(char* buf, size_t size, const whisper_prefilter* f,
+                      int64_t since, int64_t until, int limit);
+
+/* Pool: write event to one relay, recording the write for stats.
+ * Returns true if it was sent. */
+bool whisper_pool_write(whisper_pool_relay* conn, const nostr_event* event);
+
+/* Pool: publish to every relay (including ones that connect meanwhile)
+ * until quorum relays accept or none is outstanding. Per-relay outcome is
+ * left in relays[i]. Returns the number of relays that accepted. */
+int whisper_pool_publish(whisper_pool* pool, const nostr_event* event,
+                         int quorum, int timeout_ms);
+
+/* Pool: gift-wrap content for recipient into *out. Returns an exit code,
+ * err_buf a reason on failure. */
+int whisper_wrap_dm(const nostr_privkey* privkey, const nostr_key* recipient,
+                    const char* content, const char* subject, nostr_event** out,
+                    char* err_buf, size_t err_size);
+
+/* Pool: gift-wrap content for recipient and publish it with
+ * whisper_pool_publish. Returns an exit code; id_hex receives the wrap id,
+ * err_buf a reason on failure (WHISPER_EXIT_TIMEOUT = quorum not reached). */
+int whisper_pool_send_dm(whisper_pool* pool, const nostr_privkey* privkey,
+                         const nostr_key* recipient, const char* content,
+                         const char* subject, int quorum, int timeout_ms,
+                         char id_hex[65], char* err_buf, size_t err_size);
+
+/* Pool: whisper_pool_send_dm for a gift wrap built beforehand */
+int whisper_pool_send_wrapped(whisper_pool* pool, const nostr_event* dm, int quorum,
+                              int timeout_ms, char id_hex[65], char* err_buf, size_t err_size);
+
+/* Pool: publish to every connected relay without waiting for OKs.
+ * Returns the number of relays the event was sent to. */
+int whisper_pool_broadcast(whisper_pool* pool, const nostr_event* event);
+
+/* Pool: true while at least one relay is connected */
+bool whisper_pool_alive(const whisper_pool* pool);
+
+/* Pool: subscribe on every connected relay not yet subscribed. Safe to
+ * call repeatedly to pick up relays that connected later or came back;
+ * those resume with since at their newest event less WHISPER_NIP59_SKEW_S
+ * and no limit. Events are deduplicated by id before reaching on_event,
+ * across reconnects too. Returns relays subscribed. */
+int whisper_pool_subscribe(whisper_pool* pool, const char* sub_id, const char* filter);
+
+/* Pool: redial relays that dropped after having been up, on a jittered
+ * exponential backoff; call it from the owner's loop, then
+ * whisper_pool_subscribe. Returns ms until the next redial is due, 0 if
+ * none is waiting, or -1 once no relay is up or coming back. */
+int whisper_pool_maintain(whisper_pool* pool);
+
+/* Pool: run a one-shot REQ on every connected relay and wait (up to
+ * timeout_ms) for each to send EOSE, then close it. Events go through the
+ * same dedup and on_event as the main subscription; page_events and
+ * page_fresh (pool and per relay) describe what arrived. Returns relays asked. */
+int whisper_pool_fetch(whisper_pool* pool, const char* sub_id, const char* filter,
+                       int timeout_ms);
+
+/* Pool: fetch the page of gift wraps older than *until (and from since on)
+ * and move *until back past it. *exhausted is set when no relay sent a full
+ * page. Returns the events new to the pool, or -1 if no relay was asked. */
+int whisper_pool_fetch_older(whisper_pool* pool, const char* sub_id, int64_t since,
+                             int64_t* until, int limit, int timeout_ms, bool* exhausted);
+
+/* Pool: disconnect and free every relay */
+void whisper_pool_close(whisper_pool* pool);
+
+/* Peers: LRU cache of at most capacity peers (0 = default). Thread-safe;
+ * if init fails the lookups below still work, uncached. */
+int whisper_peer_cache_init(whisper_peer_cache* cache, size_t capacity);
+void whisper_peer_cache_destroy(whisper_peer_cache* cache);
+
+/* Peers: npub for key, encoded once per peer */
+void whisper_peer_npub(whisper_peer_cache* cache, const nostr_key* key,
+                       char* out, size_t out_size);
+
+/* Peers: whisper_parse_pubkey, remembering npub/hex strings already seen */
+int whisper_peer_parse(whisper_peer_cache* cache, const char* text, nostr_key* key);
+
+/* Store: $XDG_DATA_HOME/whisper or ~/.local/share/whisper into buf */
+const char* whisper_store_default_dir(char* buf, size_t size);
+
+/* Store: open (creating) the inbox for pubkey under dir, handing every
+ * stored message to replay (may be NULL) in the order it was received. */
+int whisper_store_open(whisper_store* st, const char* dir, const nostr_key* pubkey,
+                       whisper_store_cb replay, void* user_data);
+
+/* Store: true if the gift wrap is not stored yet (and marks it as seen) */
+bool whisper_store_claim(whisper_store* st, const uint8_t id[32]);
+
+/* Store: append a decrypted message from sender_npub. Returns 0 on success. */
+int whisper_store_append(whisper_store* st, const whisper_unwrapped* msg,
+                         const char* sender_npub);
+
+/* Store: `since` for a filter covering every relay in urls, allowing for
+ * NIP-59 timestamp randomization. 0 if any relay has no cursor yet. */
+int64_t whisper_store_since(whisper_store* st, const char* const* urls, int count);
+
+/* Store: record that everything from url up to `since` has been stored */
+void whisper_store_set_cursor(whisper_store* st, const char* url, int64_t since);
+
+/* Store: index the inbox for paging, without opening it for writing.
+ * Messages appended later are not seen. Returns 0, or -1 if there is no
+ * inbox. */
+int whisper_store_pager_open(whisper_store_pager* pg, const char* dir, const nostr_key* pubkey);
+
+/* Store: hand page the next `limit` messages, newest wrap first. Messages
+ * sharing the last wrap_at are all included so none fall between pages.
+ * Returns the number delivered, 0 once the inbox is used up. */
+int whisper_store_pager_next(whisper_store_pager* pg, int limit, whisper_store_page_cb page,
+                             void* user_data);
+
+void whisper_store_pager_close(whisper_store_pager* pg);
+
+/* Store: flush and close */
+void whisper_store_close(whisper_store* st);
+
+/* Store: mkdir -p dir and its parents, private to the user */
+int whisper_make_dirs(const char* dir);
+
+/* Archive: open (creating) the log under dir for appending. Only one
+ * process may have it open; a record torn by a crash is cut off. */
+int whisper_archive_open(whisper_archive* ar, const char* dir);
+
+/* Archive: append a decrypted message received for recipient, unless its
+ * gift wrap is archived already. Returns 0 on success. */
+int whisper_archive_append(whisper_archive* ar, const whisper_unwrapped* msg,
+                           const nostr_key* recipient);
+
+/* Archive: bring the sidecar index up to date and close */
+void whisper_archive_close(whisper_archive* ar);
+
+/* Archive: print the messages config selects, oldest first */
+int whisper_log(const whisper_log_config* config);
+
+/* Pool: exit code and err_buf for a publish where `accepted` of `published`
+ * relays took the event and `rejected` refused it (reason from the first) */
+int whisper_publish_outcome(int accepted, int published, int rejected, int quorum,
+                            const char* reason, char* err_buf, size_t err_size);
+
+/* Publish: start a pipeline keeping up to `window` events (0 = default)
+ * awaiting OKs on the pool's relays. on_done runs on the publisher thread
+ * in submission order. */
+int whisper_publisher_start(whisper_publisher* p, whisper_pool* pool, int window, int quorum,
+                            int timeout_ms, whisper_publish_cb on_done, void* user_data);
+
+/* Publish: take ownership of event and queue it; blocks while the window
+ * is full. Returns 0, or -1 after stop (the event is destroyed). */
+int whisper_publisher_submit(whisper_publisher* p, nostr_event* event, void* token);
+
+/* Publish: wait until every submitted event has been reported */
+void whisper_publisher_drain(whisper_publisher* p);
+
+/* Publish: queue a record that failed before it had an event, so its error
+ * is reported in order with the events around it */
+int whisper_publisher_fail(whisper_publisher* p, int code, const char* error, void* token);
+
+/* Publish: finish outstanding events, then stop the thread */
+void whisper_publisher_stop(whisper_publisher* p);
+
+/* Publish: relay-thread hooks from the pool (OK received, state change) */
+void whisper_publisher_ok(whisper_publisher* p, int relay, const char* id_hex, bool accepted,
+                          const char* message);
+void whisper_publisher_wake(whisper_publisher* p);
+
+/* Wrap: start `jobs` workers gift-wrapping as privkey (0 = default) */
+int whisper_wrap_start(whisper_wrapper* w, const nostr_privkey* privkey, int jobs,
+                       whisper_wrap_cb on_wrapped, void* user_data);
+
+/* Wrap: copy content and subject and queue them; blocks while the queue is
+ * full. With no workers the record is wrapped and delivered right here.
+ * Returns 0, or -1 after stop (no callback will come for the record). */
+int whisper_wrap_submit(whisper_wrapper* w, const nostr_key* recipient, const char* content,
+                        const char* subject, void* token);
+
+/* Wrap: queue a record that is already known to fail, keeping its place.
+ * Returns 0, or -1 after stop. */
+int whisper_wrap_fail(whisper_wrapper* w, int code, const char* error, void* token);
+
+/* Wrap: wait until every queued record has been delivered */
+void whisper_wrap_drain(whisper_wrapper* w);
+
+/* Wrap: deliver what is queued, then stop the workers */
+void whisper_wrap_stop(whisper_wrapper* w);
+
+/* Unwrap: number of workers used for jobs = 0 (online CPUs, capped) */
+int whisper_unwrap_default_jobs(void);
+
+/* Unwrap: start `jobs` workers decrypting with privkeys[0..key_count) (0 = default).
+ * In ordered mode rumors are held back and delivered sorted by created_at
+ * on whisper_unwrap_release; afterwards they are delivered as they finish. */
+int whisper_unwrap_start(whisper_unwrapper* u, const nostr_privkey* privkeys, int key_count,
+                         int jobs, bool ordered, whisper_unwrap_cb on_message, void* user_data);
+
+/* Unwrap: queue a copy of a kind-1059 event for privkeys[identity]; blocks
+ * while the queue is full. Meant to be called from whisper_pool on_event. */
+void whisper_unwrap_submit(whisper_unwrapper* u, const nostr_event* event, int identity);
+
+/* Unwrap: wait until every queued event has been processed */
+void whisper_unwrap_wait_idle(whisper_unwrapper* u);
+
+/* Unwrap: true if every event queued so far has been processed */
+bool whisper_unwrap_idle(whisper_unwrapper* u);
+
+/* Unwrap: wait for the queue, deliver held rumors in created_at order and
+ * switch to streaming delivery. With max_count > 0 only the newest
+ * max_count messages are delivered, a --split message counting once. */
+void whisper_unwrap_release(whisper_unwrapper* u, size_t max_count);
+
+/* Unwrap: finish queued work, join workers, drop undelivered rumors */
+void whisper_unwrap_stop(whisper_unwrapper* u);
 
 #endif /* WHISPER_H */
@@ -0,0 +1,239 @@
+/*
+ * whisper wrap - Gift wrapping off the sending thread
+ *
+ * Every NIP-17 send makes two ephemeral-key layers: a NIP-44 seal signed by
+ * the sender and a gift wrap signed by a fresh key. For bulk sends a small
+ * pool of workers does that work for several records at once, ahead of the
+ * publisher, and hands finished wraps on in submission order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "whisper.h"
+
+static char* copy_secret(const char* s) {
+    if (!s) return NULL;
+    size_t len = strlen(s);
+    char* copy = malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static void free_secret(char* s) {
+    if (!s) return;
+    secure_wipe(s, strlen(s));
+    free(s);
+}
+
+static void wrap_one(whisper_wrapper* w, whisper_wrap_job* job) {
+    if (job->code != WHISPER_EXIT_OK) return;
+    job->code = whisper_wrap_dm(w->privkey, &job->recipient, job->content, job->subject,
+                                &job->event, job->error, sizeof(job->error));
+}
+
+static void deliver(whisper_wrapper* w, whisper_wrap_job* job) {
+    whisper_wrapped result = {
+        .event = job->event,
+        .token = job->token,
+        .code = job->code,
+        .error = job->error,
+    };
+    free_secret(job->content);
+    free_secret(job->subject);
+    job->content = NULL;
+    job->subject = NULL;
+    w->on_wrapped(&result, w->user_data);
+}
+
+/* Fill a job; on allocation failure it is queued as an error */
+static void prepare_job(whisper_wrap_job* job, const nostr_key* recipient, const char* content,
+                        const char* subject, void* token) {
+    memset(job, 0, sizeof(*job));
+    job->token = token;
+    job->recipient = *recipient;
+    job->content = copy_secret(content);
+    job->subject = copy_secret(subject);
+    if (!job->content || (subject && !job->subject)) {
+        job->code = WHISPER_EXIT_CRYPTO_ERROR;
+        snprintf(job->error, sizeof(job->error), "Out of memory");
+    }
+}
+
+#ifndef _WIN32
+
+/*
+ * Hand finished jobs at the head of the queue to on_wrapped. One worker
+ * delivers at a time; others that finish meanwhile leave their job for it.
+ * Called and returns with the lock held.
+ */
+static void deliver_ready(whisper_wrapper* w) {
+    if (w->delivering) return;
+    w->delivering = true;
+    while (w->count > 0 && w->queue[w->head].done) {
+        whisper_wrap_job job = w->queue[w->head];
+        w->head = (w->head + 1) % WHISPER_WRAP_QUEUE;
+        w->count--;
+        w->claimed--;
+        pthread_cond_signal(&w->not_full);
+        pthread_mutex_unlock(&w->lock);
+
+        deliver(w, &job);
+        secure_wipe(&job, sizeof(job));
+
+        pthread_mutex_lock(&w->lock);
+    }
+    w->delivering = false;
+    if (w->count == 0) pthread_cond_broadcast(&w->idle);
+}
+
+static void* worker_main(void* arg) {
+    whisper_wrapper* w = (whisper_wrapper*)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->claimed == w->count && !w->stopping) {
+            pthread_cond_wait(&w->not_empty, &w->lock);
+        }
+        if (w->claimed == w->count) break;
+
+        whisper_wrap_job* job = &w->queue[(w->head + w->claimed) % WHISPER_WRAP_QUEUE];
+        w->claimed++;
+        pthread_mutex_unlock(&w->lock);
+
+        /* The slot stays ours: delivery stops at the first job not done */
+        wrap_one(w, job);
+
+        pthread_mutex_lock(&w->lock);
+        job->done = true;
+        deliver_ready(w);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* Append a prepared job, waiting for room. Returns false after stop. */
+static bool enqueue(whisper_wrapper* w, whisper_wrap_job* job) {
+    pthread_mutex_lock(&w->lock);
+    while (w->count == WHISPER_WRAP_QUEUE && !w->stopping) {
+        pthread_cond_wait(&w->not_full, &w->lock);
+    }
+    if (w->stopping) {
+        pthread_mutex_unlock(&w->lock);
+        return false;
+    }
+    w->queue[(w->head + w->count) % WHISPER_WRAP_QUEUE] = *job;
+    w->count++;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+#endif
+
+int whisper_wrap_start(whisper_wrapper* w, const nostr_privkey* privkey, int jobs,
+                       whisper_wrap_cb on_wrapped, void* user_data) {
+    memset(w, 0, sizeof(*w));
+    w->privkey = privkey;
+    w->on_wrapped = on_wrapped;
+    w->user_data = user_data;
+
+    if (jobs <= 0) jobs = whisper_unwrap_default_jobs();
+    if (jobs > WHISPER_MAX_JOBS) jobs = WHISPER_MAX_JOBS;
+
+#ifndef _WIN32
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    pthread_cond_init(&w->idle, NULL);
+    w->started = true;
+
+    while (w->jobs < jobs) {
+        if (pthread_create(&w->threads[w->jobs], NULL, worker_main, w) != 0) break;
+        w->jobs++;
+    }
+    if (w->jobs == 0 && jobs > 0) {
+        fprintf(stderr, "Warning: Failed to start wrap workers, wrapping inline\n");
+    }
+#else
+    (void)jobs;
+    w->started = true;
+#endif
+    return 0;
+}
+
+int whisper_wrap_submit(whisper_wrapper* w, const nostr_key* recipient, const char* content,
+                        const char* subject, void* token) {
+    whisper_wrap_job job;
+    prepare_job(&job, recipient, content, subject, token);
+
+#ifndef _WIN32
+    if (w->jobs > 0) {
+        int rc = 0;
+        if (!enqueue(w, &job)) {
+            free_secret(job.content);
+            free_secret(job.subject);
+            rc = -1;
+        }
+        secure_wipe(&job, sizeof(job));
+        return rc;
+    }
+#endif
+
+    /* No workers: wrap on the caller's thread */
+    wrap_one(w, &job);
+    deliver(w, &job);
+    secure_wipe(&job, sizeof(job));
+    return 0;
+}
+
+int whisper_wrap_fail(whisper_wrapper* w, int code, const char* error, void* token) {
+    whisper_wrap_job job;
+    memset(&job, 0, sizeof(job));
+    job.token = token;
+    job.code = code;
+    snprintf(job.error, sizeof(job.error), "%s", error);
+
+#ifndef _WIN32
+    if (w->jobs > 0) return enqueue(w, &job) ? 0 : -1;
+#endif
+    deliver(w, &job);
+    return 0;
+}
+
+void whisper_wrap_drain(whisper_wrapper* w) {
+#ifndef _WIN32
+    if (w->jobs == 0) return;
+    pthread_mutex_lock(&w->lock);
+    while (w->count > 0 || w->delivering) {
+        pthread_cond_wait(&w->idle, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+#else
+    (void)w;
+#endif
+}
+
+void whisper_wrap_stop(whisper_wrapper* w) {
+    if (!w->started) return;
+
+#ifndef _WIN32
+    pthread_mutex_lock(&w->lock);
+    w->stopping = true;
+    pthread_cond_broadcast(&w->not_empty);
+    pthread_cond_broadcast(&w->not_full);
+    pthread_mutex_unlock(&w->lock);
+
+    /* Workers finish the queue so every record still gets its callback */
+    for (int i = 0; i < w->jobs; i++) {
+        pthread_join(w->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&w->not_empty);
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->idle);
+    pthread_mutex_destroy(&w->lock);
+    w->jobs = 0;
+#endif
+    w->started = false;
+}